@@ -21,7 +21,12 @@ int main(int _argc, const char** argv) {
     auto modules = getModules<Module>(dir / "modules");
 
 
-    auto module = std::find_if(modules.begin(), modules.end(), [](auto& value) { return value->create_application.has_value(); });
+    // the first argument picks the application by module name (e.g. animate_vertices), say_hello by default
+    std::string applicationName = _argc > 1 ? argv[1] : "say_hello";
+    auto module = std::find_if(modules.begin(), modules.end(), [&applicationName](auto& value) {
+        return value->create_application.has_value() &&
+               std::filesystem::path(value->loader._pathToLib).stem().string().ends_with(applicationName);
+    });
 	std::cout << (module == modules.end()) << std::endl;
     
     if (module != modules.end())
@@ -37,6 +42,10 @@ int main(int _argc, const char** argv) {
 		{
 			std::cerr << Vulkan::to_string(result) << std::endl;
 		}
+
+		// runs the module's destructors, RAII members free their GPU resources there before GLFW and glslang
+		// are terminated
+		delete vulkanApp;
    
         
         std::cin.get();
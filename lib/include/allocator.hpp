@@ -1,42 +1,300 @@
+#ifndef LIB_VULKAN_ALLOCATOR_HPP
+#define LIB_VULKAN_ALLOCATOR_HPP
 
 
 #include "vulkan.hpp"
 #include "device.hpp"
+#include "frame_scheduler.hpp"
 #include "vk_mem_alloc.h"
 #include "vulkan/vulkan.hpp"
 
+#include <array>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+
 namespace Vulkan {
+    // what an allocation is counted as in the allocator's statistics, Auto picks it from the buffer usage
+    enum class MemoryCategory {
+        Auto,
+        Vertex,
+        Index,
+        Uniform,
+        Staging,
+        Image,
+        Other,
+        Count
+    };
+
+    LIBRARY_DLL const char* to_string(MemoryCategory category);
+
+    struct HeapBudget {
+        uint32_t heapIndex = 0;
+        vk::MemoryHeapFlags flags;
+
+        // usage and budget of the whole process as the driver reports them, estimated without VK_EXT_memory_budget
+        vk::DeviceSize usage = 0;
+        vk::DeviceSize budget = 0;
+        // what this allocator has in VMA blocks and how much of that is handed out
+        vk::DeviceSize blockBytes = 0;
+        vk::DeviceSize allocationBytes = 0;
+
+        float pressure() const { return budget ? static_cast<float>(usage) / static_cast<float>(budget) : 0.0f; }
+    };
+
+    struct CategoryStats {
+        uint64_t allocations = 0;
+        vk::DeviceSize bytes = 0;
+    };
+
     struct VulkanAllocatorConfig {
         Device* device;
         vk::Instance instance;
+
+        // how many frames the GPU can still be working on, deferred destructions wait that long
+        uint32_t framesInFlight = 2;
+
+        // called from beginFrame when a heap's usage goes over budgetPressureThreshold of its budget, and again
+        // only after it went back under. Evicting caches here keeps the driver from paging memory out.
+        std::function<void(const HeapBudget&)> onBudgetPressure = {};
+        float budgetPressureThreshold = 0.9f;
+
+        // buffers are created with concurrent sharing between these queue families when there are two or more,
+        // the transfer queue can then copy and defragment them without ownership transfers
+        std::vector<uint32_t> sharedQueueFamilies = {};
     };
 
     struct Buffer
     {
-        VmaAllocation allocation;
+        VmaAllocation allocation = nullptr;
         vk::Buffer buffer;
+
+        // set for buffers created with VMA_ALLOCATION_CREATE_MAPPED_BIT, stays valid for the buffer's lifetime
+        void* mapped = nullptr;
+        // host visible memory that isn't coherent, writes through mapped need a flush before the GPU sees them
+        bool needsFlush = false;
+    };
+
+    struct Image
+    {
+        VmaAllocation allocation = nullptr;
+        vk::Image image;
+    };
+
+    struct DefragmentationConfig {
+        // copies run on transferQueue, a buffer is only moved when its queue family is transferQueue's or when
+        // it's shared with it through sharedQueueFamilies
+        QueueInformation* transferQueue;
+        QueueInformation* destinationQueue;
+
+        // when set the copies signal its transfer timeline instead of a fence and a semaphore, the scheduler's
+        // transfer queue has to be transferQueue
+        FrameScheduler* scheduler = nullptr;
+
+        // bounds of a single pass, one pass runs over a few frames
+        uint32_t maxMovesPerPass = 64;
+        vk::DeviceSize maxBytesPerPass = 16 * 1024 * 1024;
+
+        // a moved buffer gets a new handle, descriptor sets still pointing at oldBuffer have to be rewritten here
+        std::function<void(vk::Buffer oldBuffer, const Buffer& buffer)> onBufferMoved = {};
+    };
+
+    struct DefragmentationPassStats {
+        uint32_t moves = 0;
+        // what VMA wanted to move but can't be, mapped buffers, images and buffers that aren't a UniqueBuffer
+        uint32_t skipped = 0;
+        vk::DeviceSize bytesMoved = 0;
+        // device memory blocks given back once the pass ended
+        vk::DeviceSize bytesReclaimed = 0;
+    };
+
+    struct DefragmentationStep {
+        // set on the frame moved buffers switch to their new handle, the submission using them has to wait on it.
+        // timelineWait with a scheduler, waitSemaphore otherwise
+        vk::Semaphore waitSemaphore;
+        vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+        std::optional<TimelineWait> timelineWait;
+
+        std::optional<DefragmentationPassStats> pass;
+        bool finished = false;
+    };
+
+    class Allocator;
+
+    // owns a Buffer, letting go of it hands the buffer to the allocator's deferred destruction queue
+    // so it's only destroyed once no frame in flight can still use it
+    class LIBRARY_DLL UniqueBuffer {
+        public:
+        UniqueBuffer() = default;
+        UniqueBuffer(Allocator* allocator, Buffer buffer);
+        UniqueBuffer(const UniqueBuffer&) = delete;
+        UniqueBuffer& operator=(const UniqueBuffer&) = delete;
+        UniqueBuffer(UniqueBuffer&& other) noexcept = default;
+        UniqueBuffer& operator=(UniqueBuffer&& other) noexcept;
+        ~UniqueBuffer() { reset(); }
+
+        void reset();
+        // gives up ownership without destroying anything, the buffer won't be moved by defragmentation anymore
+        Buffer release();
+
+        // defragmentation can swap the handle between frames, read it from here instead of keeping a copy
+        const Buffer& get() const;
+        const Buffer* operator->() const { return &get(); }
+        explicit operator bool() const { return buffer && buffer->allocation; }
+
+        private:
+        Allocator* allocator = nullptr;
+        // heap allocated so the allocator can keep pointing at it while the UniqueBuffer moves around
+        std::unique_ptr<Buffer> buffer;
+    };
+
+    class LIBRARY_DLL UniqueImage {
+        public:
+        UniqueImage() = default;
+        UniqueImage(Allocator* allocator, Image image) : allocator{allocator}, image{image} {}
+        UniqueImage(const UniqueImage&) = delete;
+        UniqueImage& operator=(const UniqueImage&) = delete;
+        UniqueImage(UniqueImage&& other) noexcept;
+        UniqueImage& operator=(UniqueImage&& other) noexcept;
+        ~UniqueImage() { reset(); }
+
+        void reset();
+        Image release();
+
+        const Image& get() const { return image; }
+        const Image* operator->() const { return &image; }
+        explicit operator bool() const { return image.allocation != nullptr; }
+
+        private:
+        Allocator* allocator = nullptr;
+        Image image;
     };
 
     class LIBRARY_DLL Allocator {
 
-        
+
         public:
 
+        Allocator() = default;
+        Allocator(const Allocator&) = delete;
+        Allocator& operator=(const Allocator&) = delete;
+        // everything still queued is destroyed right away, the device has to be idle by then
+        ~Allocator();
+
         VulkanResult createAllocator(VulkanAllocatorConfig allocConfig);
 
         VmaAllocator getAllocator() { return allocator; }
         VulkanAllocatorConfig& getConfig() { return config; }
 
+        // pass VMA_ALLOCATION_CREATE_MAPPED_BIT to keep the buffer mapped, per frame updates are then a memcpy into Buffer::mapped
         ResultValue<Buffer> createBuffer(size_t size,
-            vk::BufferUsageFlagBits bufferUsage,
+            vk::BufferUsageFlags bufferUsage,
+            VmaAllocationCreateFlags vmaAllocFlags = {},
+            vk::MemoryPropertyFlags requiredFlags = {},
+            VmaMemoryUsage vmaUsage = {},
+            MemoryCategory category = MemoryCategory::Auto);
+
+        ResultValue<UniqueBuffer> createUniqueBuffer(size_t size,
+            vk::BufferUsageFlags bufferUsage,
+            VmaAllocationCreateFlags vmaAllocFlags = {},
+            vk::MemoryPropertyFlags requiredFlags = {},
+            VmaMemoryUsage vmaUsage = {},
+            MemoryCategory category = MemoryCategory::Auto);
+
+        ResultValue<Image> createImage(const vk::ImageCreateInfo& imageInfo,
             VmaAllocationCreateFlags vmaAllocFlags = {},
             vk::MemoryPropertyFlags requiredFlags = {},
-            VmaMemoryUsage vmaUsage = {});
+            VmaMemoryUsage vmaUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+
+        ResultValue<UniqueImage> createUniqueImage(const vk::ImageCreateInfo& imageInfo,
+            VmaAllocationCreateFlags vmaAllocFlags = {},
+            vk::MemoryPropertyFlags requiredFlags = {},
+            VmaMemoryUsage vmaUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+
+        // destroy right away, only for resources no submitted work uses anymore
+        void destroyBuffer(Buffer& buffer);
+        void destroyImage(Image& image);
+
+        // queued until framesInFlight frames after the current one, safe to call from any thread
+        void destroyBufferDeferred(Buffer& buffer);
+        void destroyImageDeferred(Image& image);
+
+        // call once the fence of frameNumber has been waited on, destroys what was queued framesInFlight frames ago,
+        // refreshes the budgets and calls onBudgetPressure
+        void beginFrame(uint64_t frameNumber);
+        // destroys the whole queue, after a waitIdle
+        void flushDeferredDestructions();
+        size_t getPendingDestructionCount();
+
+        // copies into a persistently mapped buffer and flushes the range when the memory isn't coherent
+        VulkanResult write(const Buffer& buffer, const void* data, size_t size, size_t offset = 0);
+
+        // no-op on coherent memory
+        VulkanResult flush(const Buffer& buffer, size_t offset = 0, size_t size = VK_WHOLE_SIZE);
+
+        // true when buffers are created concurrent between both families
+        bool sharesQueueFamilies(uint32_t first, uint32_t second);
+
+        // Incremental defragmentation of unmapped UniqueBuffers. Call stepDefragmentation once a frame after
+        // beginFrame: a pass copies up to maxMovesPerPass buffers on the transfer queue, switches the handles once
+        // the copy is done and frees the old memory framesInFlight frames later. Moved buffers must not be written
+        // by the GPU while a pass runs, the copy would miss it.
+        VulkanResult beginDefragmentation(const DefragmentationConfig& defragmentationConfig);
+        ResultValue<DefragmentationStep> stepDefragmentation();
+        bool isDefragmenting() { return defragmentation != nullptr; }
+
+        std::vector<HeapBudget> getBudgets();
+        CategoryStats getCategoryStats(MemoryCategory category);
+
+        // budgets, categories and VMA's own statistics string under "vma", detailedMap lists every allocation
+        std::string statsToJson(bool detailedMap = false);
 
 
         private:
 
+        struct DeferredDestruction {
+            uint64_t frame;
+            VmaAllocation allocation;
+            vk::Buffer buffer;
+            vk::Image image;
+        };
+
+        // kept in the allocation's user data
+        struct AllocationRecord {
+            MemoryCategory category;
+            vk::DeviceSize size = 0;
+            vk::BufferUsageFlags usage;
+            bool concurrent = false;
+            // the UniqueBuffer's Buffer, what defragmentation fixes up
+            Buffer* owner = nullptr;
+        };
+
+        struct DefragmentationState;
+
+        void destroy(const DeferredDestruction& destruction);
+        void track(VmaAllocation allocation, MemoryCategory category, const vk::BufferCreateInfo* bufferInfo = nullptr);
+        void untrack(VmaAllocation allocation);
+        AllocationRecord* getRecord(VmaAllocation allocation);
+        void setOwner(VmaAllocation allocation, Buffer* owner);
+        void endDefragmentation();
+
+        friend class UniqueBuffer;
+
         VulkanAllocatorConfig config;
-        VmaAllocator allocator;
+        VmaAllocator allocator = nullptr;
+
+        std::mutex deferredMutex;
+        std::deque<DeferredDestruction> deferred;
+        uint64_t currentFrame = 0;
+
+        std::mutex statsMutex;
+        std::array<CategoryStats, static_cast<size_t>(MemoryCategory::Count)> categories{};
+        std::vector<bool> heapsUnderPressure;
+
+        std::unique_ptr<DefragmentationState> defragmentation;
     } ;
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef LIB_VULKAN_ASYNC_PIPELINE_HPP
+#define LIB_VULKAN_ASYNC_PIPELINE_HPP
+
+#include "vulkan.hpp"
+#include "graphics_pipeline.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace Vulkan
+{
+	// Future-like handle to a pipeline compiled on a background thread. Cheap to copy and to poll every frame.
+	class LIBRARY_DLL PipelineHandle
+	{
+	public:
+		bool valid() const { return state != nullptr; }
+
+		// true once compilation finished, successfully or not
+		bool isReady() const;
+		bool failed() const;
+
+		void wait() const;
+
+		// only meaningful once isReady() returns true
+		VulkanResult getResult() const;
+
+		// the compiled pipeline once it's ready, otherwise the fallback it was requested with.
+		// null means there is nothing to draw with yet and the draw should be skipped.
+		GraphicsPipeline *get() const;
+
+	private:
+		friend class AsyncPipelineCompiler;
+
+		struct State
+		{
+			std::atomic<bool> ready = false;
+			VulkanResult result;
+			GraphicsPipeline pipeline;
+			GraphicsPipeline *fallback = nullptr;
+
+			std::mutex mutex;
+			std::condition_variable condition;
+		};
+
+		std::shared_ptr<State> state;
+	};
+
+	struct AsyncPipelineCompilerConfig
+	{
+		// pipeline creation is mostly driver work, a couple of threads keep it off the render thread
+		uint32_t threadCount = 2;
+
+		// used by handles that don't pass their own fallback
+		GraphicsPipeline *fallback = nullptr;
+	};
+
+	class LIBRARY_DLL AsyncPipelineCompiler
+	{
+	public:
+		VulkanResult createAsyncPipelineCompiler(const AsyncPipelineCompilerConfig &config);
+
+		// waits for every queued pipeline, call it before destroying the device
+		void shutdown();
+
+		// pipelineConfig is copied, with a stateCache set identical requests still only compile once
+		PipelineHandle compile(const GraphicsPipelineConfig &pipelineConfig, GraphicsPipeline *fallback = nullptr);
+
+		uint32_t getPendingCount() const { return pending.load(); }
+		AsyncPipelineCompilerConfig &getConfig() { return config; }
+
+	private:
+		AsyncPipelineCompilerConfig config;
+		ThreadPool pool;
+		std::atomic<uint32_t> pending = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef LIB_VULKAN_COMMAND_BUFFER_CACHE_HPP
+#define LIB_VULKAN_COMMAND_BUFFER_CACHE_HPP
+
+#include "vulkan.hpp"
+#include "device.hpp"
+
+namespace Vulkan
+{
+	struct CommandBufferCacheConfig
+	{
+		Device *device;
+		// the secondaries are executed by primaries of this queue's family
+		QueueInformation *queue;
+	};
+
+	struct CommandBufferCacheStats
+	{
+		// get calls that replayed the cached commands
+		uint64_t hits = 0;
+		uint64_t recordings = 0;
+		uint64_t invalidations = 0;
+	};
+
+	// records commands between begin and end, they're replayed until the entry is invalidated
+	using RecordCachedFunction = std::function<VulkanResult(vk::CommandBuffer commandBuffer)>;
+
+	// Secondary command buffers recorded once and executed every frame after, for passes whose commands don't
+	// change from one frame to the next. Entries are picked by a key, a swapchain image or whatever else the
+	// commands differ by, and re-recorded only once invalidated or when their stamp changes.
+	class LIBRARY_DLL CommandBufferCache
+	{
+	public:
+		CommandBufferCache() = default;
+		CommandBufferCache(const CommandBufferCache &) = delete;
+		CommandBufferCache &operator=(const CommandBufferCache &) = delete;
+
+		VulkanResult createCommandBufferCache(const CommandBufferCacheConfig &config);
+
+		// the entry's command buffer, recorded with recordCommands first if it's missing, invalidated or was recorded
+		// with another stamp. The last submission of key's command buffer has to be done, key by the frame in flight
+		// too when the previous frame may still be using it.
+		ResultValue<vk::CommandBuffer> get(uint32_t key, uint64_t stamp, const vk::CommandBufferInheritanceInfo &inheritance,
+		                                   const RecordCachedFunction &recordCommands);
+
+		// every entry is re-recorded on its next get, call when something they reference was replaced or destroyed
+		void invalidate();
+
+		CommandBufferCacheStats getStats() { return stats; }
+		CommandBufferCacheConfig &getConfig() { return config; }
+
+	private:
+		struct Entry
+		{
+			vk::UniqueCommandBuffer commandBuffer;
+			uint64_t stamp = 0;
+			// generation the entry was recorded in, older ones are stale
+			uint64_t generation = 0;
+		};
+
+		CommandBufferCacheConfig config;
+		vk::UniqueCommandPool pool;
+		std::vector<Entry> entries;
+		// starts above the entries' 0 so a fresh entry is recorded
+		uint64_t generation = 1;
+
+		CommandBufferCacheStats stats;
+	};
+}
+
+#endif
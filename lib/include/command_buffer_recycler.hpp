@@ -0,0 +1,80 @@
+#ifndef LIB_VULKAN_COMMAND_BUFFER_RECYCLER_HPP
+#define LIB_VULKAN_COMMAND_BUFFER_RECYCLER_HPP
+
+#include "vulkan.hpp"
+#include "device.hpp"
+
+namespace Vulkan
+{
+	struct CommandBufferRecyclerConfig
+	{
+		Device *device;
+		// command buffers are for this queue's family
+		QueueInformation *queue;
+
+		uint32_t framesInFlight = 2;
+	};
+
+	struct CommandBufferFrameStats
+	{
+		// newly allocated from the pool and handed out again after a reset
+		uint32_t allocated = 0;
+		uint32_t reused = 0;
+	};
+
+	struct CommandBufferRecyclerStats
+	{
+		// the last frame that was reset, what a frame costs once it's done
+		CommandBufferFrameStats lastFrame;
+		uint64_t totalAllocated = 0;
+		uint64_t totalReused = 0;
+	};
+
+	// One transient command pool per frame in flight. beginFrame resets the frame's whole pool in one call, which
+	// is cheaper than resetting buffers one by one, and its command buffers become a free list acquire hands out
+	// again. Like the pools it isn't thread safe, use one per recording thread.
+	class LIBRARY_DLL CommandBufferRecycler
+	{
+	public:
+		CommandBufferRecycler() = default;
+		CommandBufferRecycler(const CommandBufferRecycler &) = delete;
+		CommandBufferRecycler &operator=(const CommandBufferRecycler &) = delete;
+
+		VulkanResult createCommandBufferRecycler(const CommandBufferRecyclerConfig &config);
+
+		// call once the frame's fence or timeline wait returned, nothing acquired for it the last time around may
+		// still be pending
+		VulkanResult beginFrame(uint32_t frameIndex);
+
+		// reset and ready to begin, valid until the frame's next beginFrame
+		ResultValue<vk::CommandBuffer> acquire(vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary);
+
+		// what the current frame acquired so far
+		CommandBufferFrameStats getFrameStats() { return pools[currentFrame].stats; }
+		CommandBufferRecyclerStats getStats() { return stats; }
+		CommandBufferRecyclerConfig &getConfig() { return config; }
+
+	private:
+		struct FreeList
+		{
+			std::vector<vk::CommandBuffer> commandBuffers;
+			size_t used = 0;
+		};
+
+		struct FramePool
+		{
+			vk::UniqueCommandPool pool;
+			FreeList primaries;
+			FreeList secondaries;
+			CommandBufferFrameStats stats;
+		};
+
+		CommandBufferRecyclerConfig config;
+		std::vector<FramePool> pools;
+		uint32_t currentFrame = 0;
+
+		CommandBufferRecyclerStats stats;
+	};
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef LIB_VULKAN_COMPUTE_PIPELINE_HPP
+#define LIB_VULKAN_COMPUTE_PIPELINE_HPP
+
+#include "vulkan.hpp"
+#include "device.hpp"
+
+#include <array>
+#include <optional>
+
+namespace Vulkan
+{
+	struct ComputePipelineConfig
+	{
+		Device *device;
+		vk::PipelineShaderStageCreateInfo shaderStage = {};
+
+		std::vector<vk::DescriptorSetLayout> descriptorSetLayouts = {};
+		std::vector<vk::PushConstantRange> pushConstants = {};
+
+		// workgroup size of the shader, dispatch sizes are divided by it
+		std::array<uint32_t, 3> localSize = {1, 1, 1};
+
+		// specialization constant ids behind layout(local_size_x_id = ...), the dimensions that have one
+		// get localSize baked in when the pipeline is created, so it can be picked from the device limits
+		std::array<std::optional<uint32_t>, 3> localSizeConstantIds = {};
+	};
+
+	class LIBRARY_DLL ComputePipeline
+	{
+	public:
+		VulkanResult createComputePipeline(ComputePipelineConfig pipelineConfig);
+		VulkanResult recreateComputePipeline();
+
+		// workgroups needed to cover the given number of invocations in each dimension
+		std::array<uint32_t, 3> getGroupCount(uint32_t x, uint32_t y = 1, uint32_t z = 1) const;
+
+		// records a dispatch covering x * y * z invocations, the pipeline and its descriptor sets have to be bound.
+		// Fails instead of recording when the group count goes over maxComputeWorkGroupCount.
+		VulkanResult dispatch(vk::CommandBuffer commandBuffer, uint32_t x, uint32_t y = 1, uint32_t z = 1) const;
+
+		vk::Pipeline getPipeline() { return pipeline.get(); }
+		vk::PipelineLayout getPipelineLayout() { return pipelineLayout.get(); }
+		ComputePipelineConfig &getPipelineConfig() { return config; }
+
+	private:
+		VulkanResult createComputePipeline();
+
+		ComputePipelineConfig config;
+		vk::UniquePipelineLayout pipelineLayout;
+		vk::UniquePipeline pipeline;
+	};
+
+	namespace Utils
+	{
+		// largest power of two workgroup spread over the given number of dimensions that fits
+		// maxComputeWorkGroupSize and maxComputeWorkGroupInvocations, capped at preferredInvocations
+		LIBRARY_DLL std::array<uint32_t, 3> computeWorkgroupSize(Device &device, uint32_t dimensions = 1, uint32_t preferredInvocations = 256);
+	}
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef LIB_VULKAN_DESCRIPTOR_LAYOUT_CACHE_HPP
+#define LIB_VULKAN_DESCRIPTOR_LAYOUT_CACHE_HPP
+
+#include "vulkan.hpp"
+#include "device.hpp"
+
+#include <mutex>
+
+namespace Vulkan
+{
+	// Hands out one vk::DescriptorSetLayout per distinct set of bindings, so pipelines whose
+	// shaders declare the same set share the layout (and their descriptor sets stay compatible).
+	class LIBRARY_DLL DescriptorSetLayoutCache
+	{
+	public:
+		VulkanResult createDescriptorSetLayoutCache(Device *device);
+
+		// binding order doesn't matter, immutable samplers aren't supported
+		ResultValue<vk::DescriptorSetLayout> getLayout(std::vector<vk::DescriptorSetLayoutBinding> bindings);
+
+		size_t size();
+
+	private:
+		Device *device = nullptr;
+		std::unordered_map<std::string, vk::UniqueDescriptorSetLayout> layouts;
+		std::mutex mutex;
+	};
+}
+
+#endif
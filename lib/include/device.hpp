@@ -5,6 +5,8 @@
 #include "GLFW/glfw3.h"
 #include "instance.hpp"
 
+#include <chrono>
+
 namespace Vulkan {
 	struct QueueInformation
 	{
@@ -36,6 +38,24 @@ namespace Vulkan {
         SwapChainSupportDetails swapchainDetails;
     };
 
+    // which VK_EXT_extended_dynamic_state 1/2/3 states the device was created with,
+    // the third extension's states are each optional
+    struct ExtendedDynamicStateSupport {
+        // cull mode, front face, topology, depth and stencil test state
+        bool extendedDynamicState = false;
+        // rasterizer discard, depth bias enable and primitive restart
+        bool extendedDynamicState2 = false;
+        bool logicOp = false;
+
+        bool polygonMode = false;
+        bool depthClampEnable = false;
+        bool logicOpEnable = false;
+        bool alphaToCoverageEnable = false;
+        bool colorBlendEnable = false;
+        bool colorBlendEquation = false;
+        bool colorWriteMask = false;
+    };
+
     struct DeviceConfig {
         Instance* instance;
         std::vector<QueueInformation> queueRequirements = {};
@@ -50,8 +70,31 @@ namespace Vulkan {
         // if this is set to true, the swapchain KHR extension will automatically be added to the device
         bool requiresSwapchainSupport = false;
 
+        // turns on dynamic rendering when the device has it, core on Vulkan 1.3 and VK_KHR_dynamic_rendering before.
+        // It's optional, check isDynamicRenderingEnabled and fall back to render passes when it's false.
+        // Before 1.3 the instance has to be at least 1.1 or enable VK_KHR_get_physical_device_properties2.
+        bool enableDynamicRendering = false;
+
+        // turns on whatever the device supports of extended dynamic state 1, 2 and 3, see getExtendedDynamicState.
+        // Needs an instance of at least 1.1 or VK_KHR_get_physical_device_properties2 to query the features.
+        bool enableExtendedDynamicState = false;
+
+        // turns on VK_EXT_memory_budget when the device has it so the allocator sees the driver's real budget,
+        // without it VMA estimates. Reading the budget needs vkGetPhysicalDeviceMemoryProperties2 (1.1).
+        bool enableMemoryBudget = false;
+
+        // turns on timeline semaphores, core on Vulkan 1.2 and VK_KHR_timeline_semaphore before. Check
+        // isTimelineSemaphoreEnabled, the FrameScheduler needs them.
+        bool enableTimelineSemaphores = false;
+
         vk::detail::DispatchLoaderDynamic* loader = &VULKAN_HPP_DEFAULT_DISPATCHER; 
 
+        // the pipeline cache is loaded from here when the device is created and written back when it's
+        // destroyed, an empty path keeps it in memory only
+        std::filesystem::path pipelineCachePath = "pipeline_cache.bin";
+
+        // savePipelineCacheIfDue writes the cache at most this often
+        std::chrono::seconds pipelineCacheSaveInterval{60};
     };
 
     struct FoundQueues {
@@ -62,6 +105,11 @@ namespace Vulkan {
 
     class LIBRARY_DLL Device {
         public:
+            Device() = default;
+            Device(const Device&) = delete;
+            Device& operator=(const Device&) = delete;
+            ~Device();
+
             VulkanResult createDevice(DeviceConfig);
             
             VulkanResult recreateDevice();
@@ -110,6 +158,42 @@ namespace Vulkan {
                 return *config.loader;
             }
 
+            // shared by every pipeline created on this device
+            vk::PipelineCache getPipelineCache() {
+                return pipelineCache.get();
+            }
+
+            bool isDynamicRenderingEnabled() {
+                return dynamicRenderingEnabled;
+            }
+
+            const ExtendedDynamicStateSupport& getExtendedDynamicState() {
+                return extendedDynamicState;
+            }
+
+            bool isMemoryBudgetEnabled() {
+                return memoryBudgetEnabled;
+            }
+
+            bool isTimelineSemaphoreEnabled() {
+                return timelineSemaphoreEnabled;
+            }
+
+            // the lower of the device's and the instance's version, what the device can actually be used with
+            uint32_t getApiVersion() {
+                return apiVersion;
+            }
+
+            // true when the cache was loaded from disk, pipelines created now should mostly be cache hits
+            bool isPipelineCacheWarm() {
+                return pipelineCacheWarm;
+            }
+
+            VulkanResult savePipelineCache();
+
+            // meant to be called once per frame, only writes when the save interval elapsed and the cache grew
+            VulkanResult savePipelineCacheIfDue();
+
         protected:
 
             VulkanResult pickPhysicalDevice();
@@ -120,10 +204,24 @@ namespace Vulkan {
             ResultValue<std::vector<QueueInformation>> getQueueFamilies(vk::PhysicalDevice physicalDevice, const QueueInformation& match, vk::SurfaceKHR surface = nullptr);
             ResultValue<FoundQueues> selectQueueFamilies(vk::PhysicalDevice);
 
+            VulkanResult createPipelineCache();
+
         private:
 
 
         vk::UniqueDevice device;
+
+        // declared after the device so it's destroyed first
+        vk::UniquePipelineCache pipelineCache;
+        bool pipelineCacheWarm = false;
+        size_t pipelineCacheSavedSize = 0;
+        std::chrono::steady_clock::time_point pipelineCacheSavedAt;
+
+        bool dynamicRenderingEnabled = false;
+        ExtendedDynamicStateSupport extendedDynamicState;
+        bool memoryBudgetEnabled = false;
+        bool timelineSemaphoreEnabled = false;
+        uint32_t apiVersion = VK_API_VERSION_1_0;
         
         std::vector<PhysicalDevice> suitableDevices;
         PhysicalDevice physicalDevice;
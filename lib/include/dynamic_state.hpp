@@ -0,0 +1,22 @@
+#ifndef LIB_VULKAN_DYNAMIC_STATE_HPP
+#define LIB_VULKAN_DYNAMIC_STATE_HPP
+
+#include "vulkan.hpp"
+#include "graphics_pipeline.hpp"
+
+namespace Vulkan
+{
+	namespace Utils
+	{
+		// adds every extended dynamic state the device was created with to the config. Configs that only differ
+		// in dynamic state then share a pipeline in the PipelineStateCache, on devices without the extensions
+		// nothing is added and every combination keeps getting its own static pipeline.
+		LIBRARY_DLL void enableExtendedDynamicState(GraphicsPipelineConfig &config);
+
+		// records the values of config for each of its dynamic states, so the same config describes a draw
+		// whether its state is baked into the pipeline or not. Viewports and scissors are left to the caller.
+		LIBRARY_DLL void recordDynamicState(vk::CommandBuffer commandBuffer, const GraphicsPipelineConfig &config);
+	}
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef LIB_VULKAN_FRAME_ALLOCATOR_HPP
+#define LIB_VULKAN_FRAME_ALLOCATOR_HPP
+
+#include "vulkan.hpp"
+#include "allocator.hpp"
+#include "device.hpp"
+
+#include <cstring>
+
+namespace Vulkan
+{
+	struct FrameAllocatorConfig
+	{
+		Device *device;
+		Allocator *allocator;
+
+		uint32_t framesInFlight = 2;
+		// bytes every frame can hand out before allocate fails
+		vk::DeviceSize frameSize = 1024 * 1024;
+
+		vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+		                             vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer;
+		// what the buffer counts as in the allocator's statistics
+		MemoryCategory category = MemoryCategory::Uniform;
+	};
+
+	struct FrameAllocation
+	{
+		void *data = nullptr;
+		vk::Buffer buffer;
+		// from the start of the buffer, the value to pass as a dynamic descriptor offset
+		uint32_t offset = 0;
+		vk::DeviceSize size = 0;
+	};
+
+	// Transient per-frame data (uniforms, vertices) in one persistently mapped buffer split into a region per
+	// frame in flight. Allocating is a pointer bump inside the current region, there are no VMA calls after
+	// creation. A region is reused the next time its frame comes around, which is why beginFrame must only be
+	// called once that frame's fence has signaled.
+	class LIBRARY_DLL FrameAllocator
+	{
+	public:
+		FrameAllocator() = default;
+		FrameAllocator(const FrameAllocator &) = delete;
+		FrameAllocator &operator=(const FrameAllocator &) = delete;
+
+		VulkanResult createFrameAllocator(const FrameAllocatorConfig &config);
+
+		// switches to the region of frameIndex and forgets everything allocated in it the last time around
+		void beginFrame(uint32_t frameIndex);
+
+		// alignment 0 uses the largest of the uniform and storage buffer offset alignments
+		ResultValue<FrameAllocation> allocate(vk::DeviceSize size, vk::DeviceSize alignment = 0);
+
+		template <typename T>
+		    requires std::is_trivially_copyable_v<T>
+		ResultValue<FrameAllocation> push(const T &value, vk::DeviceSize alignment = 0)
+		{
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(allocate(sizeof(T), alignment), auto allocation);
+			std::memcpy(allocation.data, &value, sizeof(T));
+			return allocation;
+		}
+
+		// makes this frame's writes visible to the GPU on non-coherent memory, call it before submitting
+		VulkanResult flush();
+
+		vk::Buffer getBuffer() { return buffer->buffer; }
+		const Buffer &getAllocation() { return buffer.get(); }
+
+		// bytes used in the current region and the most any frame has used so far
+		vk::DeviceSize getUsed() { return head - regionStart; }
+		vk::DeviceSize getHighWaterMark() { return highWaterMark; }
+
+		FrameAllocatorConfig &getConfig() { return config; }
+
+	private:
+		FrameAllocatorConfig config;
+		UniqueBuffer buffer;
+		vk::DeviceSize defaultAlignment = 1;
+
+		vk::DeviceSize regionStart = 0;
+		vk::DeviceSize regionEnd = 0;
+		vk::DeviceSize head = 0;
+		vk::DeviceSize highWaterMark = 0;
+	};
+}
+
+#endif
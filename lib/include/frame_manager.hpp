@@ -0,0 +1,141 @@
+#ifndef LIB_VULKAN_FRAME_MANAGER_HPP
+#define LIB_VULKAN_FRAME_MANAGER_HPP
+
+#include "vulkan.hpp"
+#include "allocator.hpp"
+#include "command_buffer_recycler.hpp"
+#include "device.hpp"
+#include "frame_allocator.hpp"
+#include "frame_scheduler.hpp"
+
+#include <chrono>
+#include <optional>
+
+namespace Vulkan
+{
+	struct FrameManagerConfig
+	{
+		Device *device;
+		Allocator *allocator;
+		// command buffers are allocated for this queue's family
+		QueueInformation *graphicsQueue;
+		// presents wait on the frames' renderFinishedSemaphore, which fences don't cover. Waited for before the
+		// frames are destroyed, the whole device when null.
+		QueueInformation *presentQueue = nullptr;
+
+		// more frames let the CPU run ahead of the GPU at the cost of latency, the allocator's deferred
+		// destructions follow this count
+		uint32_t framesInFlight = 2;
+
+		// size of every frame's region in the frame allocator
+		vk::DeviceSize uniformFrameSize = 256 * 1024;
+
+		// when set, every frame gets a descriptor set of this layout with uniformBinding pointing at the frame
+		// allocator's buffer as a dynamic uniform buffer of uniformRange bytes
+		vk::DescriptorSetLayout descriptorSetLayout = nullptr;
+		uint32_t uniformBinding = 0;
+		vk::DeviceSize uniformRange = 0;
+
+		// when set frames are paced with the scheduler's timelines and submit goes through its graphics timeline,
+		// the frames have no fences
+		FrameScheduler *scheduler = nullptr;
+	};
+
+	struct FrameData
+	{
+		vk::UniqueSemaphore imageAvailableSemaphore;
+		vk::UniqueSemaphore renderFinishedSemaphore;
+		// null with a scheduler
+		vk::UniqueFence inFlightFence;
+		// acquired from the frame's pool by beginFrame, reset and ready to begin
+		vk::CommandBuffer commandBuffer;
+		// freed with the descriptor pool
+		vk::DescriptorSet descriptorSet;
+		// where this frame's uniforms landed in the frame allocator, the dynamic offset for descriptorSet
+		uint32_t uniformOffset = 0;
+	};
+
+	struct FrameStats
+	{
+		uint64_t frames = 0;
+
+		// time beginFrame blocked on the frame's fence or timelines, the GPU being behind the CPU
+		std::chrono::duration<double, std::milli> lastFenceWait{0};
+		std::chrono::duration<double, std::milli> totalFenceWait{0};
+		std::chrono::duration<double, std::milli> worstFenceWait{0};
+		// time claimImage blocked on an older frame still rendering to the acquired image
+		std::chrono::duration<double, std::milli> totalImageWait{0};
+
+		double averageFenceWait() const { return frames ? totalFenceWait.count() / frames : 0.0; }
+	};
+
+	// Owns the per-frame objects of a renderer: sync objects, a command pool, a region of the frame allocator and
+	// a descriptor set for every frame in flight. A frame is beginFrame, acquire a swapchain image, claimImage,
+	// record, submit and endFrame.
+	class LIBRARY_DLL FrameManager
+	{
+	public:
+		FrameManager() = default;
+		FrameManager(const FrameManager &) = delete;
+		FrameManager &operator=(const FrameManager &) = delete;
+		~FrameManager();
+
+		VulkanResult createFrameManager(const FrameManagerConfig &config);
+
+		// waits for the frame framesInFlight frames back, whose objects are about to be reused, and starts the
+		// frame allocator region
+		ResultValue<FrameData *> beginFrame();
+
+		// call once imageIndex is acquired. Swapchains can hand out images out of order, a frame still rendering to
+		// imageIndex is waited on before the image is handed to this frame. Resets the frame's fence.
+		VulkanResult claimImage(uint32_t imageIndex);
+
+		// submits to the graphics queue, signaling the frame's fence or the scheduler's graphics timeline.
+		// timelineWaits need a scheduler.
+		VulkanResult submit(const TimelineSubmitInfo &info);
+
+		void endFrame();
+
+		// waits for every frame and present then recreates the per-frame objects, the frame allocator and the descriptor sets
+		VulkanResult setFramesInFlight(uint32_t framesInFlight);
+
+		// blocks until every submitted frame is done
+		VulkanResult waitIdle();
+
+		FrameData &getFrame() { return frames[currentFrame]; }
+		uint32_t getCurrentFrame() { return currentFrame; }
+		// counts every frame since creation, what Allocator::beginFrame and UploadManager::beginFrame expect
+		uint64_t getFrameNumber() { return frameNumber; }
+		uint32_t getFramesInFlight() { return config.framesInFlight; }
+
+		FrameAllocator &getFrameAllocator() { return frameAllocator; }
+		// the frame's pool, acquire more command buffers from it between beginFrame and submit
+		CommandBufferRecycler &getCommandBuffers() { return commandBuffers; }
+		FrameStats getStats() { return stats; }
+		FrameManagerConfig &getConfig() { return config; }
+
+	private:
+		VulkanResult createFrames();
+		VulkanResult createDescriptorSets();
+		// blocks until frame is done, frames older than framesInFlight are
+		VulkanResult waitForFrame(uint64_t frame);
+		// blocks until no present waits on a renderFinishedSemaphore anymore
+		VulkanResult waitForPresentation();
+
+		FrameManagerConfig config;
+		FrameAllocator frameAllocator;
+
+		CommandBufferRecycler commandBuffers;
+		vk::UniqueDescriptorPool descriptorPool;
+		std::vector<FrameData> frames;
+		// the frame that last rendered to each swapchain image, grows with the image count
+		std::vector<std::optional<uint64_t>> imagesInFlight;
+
+		uint32_t currentFrame = 0;
+		uint64_t frameNumber = 0;
+
+		FrameStats stats;
+	};
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef LIB_VULKAN_FRAME_SCHEDULER_HPP
+#define LIB_VULKAN_FRAME_SCHEDULER_HPP
+
+#include "vulkan.hpp"
+#include "device.hpp"
+
+#include <array>
+#include <chrono>
+#include <deque>
+
+namespace Vulkan
+{
+	enum class TimelineQueue
+	{
+		Graphics,
+		Compute,
+		Transfer,
+		Count
+	};
+
+	struct FrameSchedulerConfig
+	{
+		Device *device;
+
+		// every queue gets its own timeline, null queues can't be submitted to
+		QueueInformation *graphicsQueue;
+		QueueInformation *computeQueue = nullptr;
+		QueueInformation *transferQueue = nullptr;
+	};
+
+	// waits until the timeline of queue reached value, a submission made earlier on that queue
+	struct TimelineWait
+	{
+		TimelineQueue queue;
+		uint64_t value;
+		vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eAllCommands;
+	};
+
+	struct TimelineSubmitInfo
+	{
+		std::vector<vk::CommandBuffer> commandBuffers;
+		std::vector<TimelineWait> timelineWaits;
+
+		// binary semaphores, swapchain acquire and present can't use timelines
+		std::vector<vk::Semaphore> waitSemaphores;
+		std::vector<vk::PipelineStageFlags> waitStages;
+		std::vector<vk::Semaphore> signalSemaphores;
+	};
+
+	struct FrameCompletion
+	{
+		uint64_t frameNumber = 0;
+		// endFrame of the frame and the first time its last submission was seen done, when waitForFrame blocked on
+		// it this is when the wait returned, otherwise when it was polled
+		std::chrono::steady_clock::time_point submittedAt;
+		std::chrono::steady_clock::time_point completedAt;
+
+		std::chrono::duration<double, std::milli> latency() const { return completedAt - submittedAt; }
+	};
+
+	struct FrameSchedulerStats
+	{
+		uint64_t submissions = 0;
+		uint64_t completedFrames = 0;
+
+		// time waitForFrame and wait blocked
+		std::chrono::duration<double, std::milli> totalWait{0};
+		// submission to completion over every completed frame
+		std::chrono::duration<double, std::milli> totalLatency{0};
+
+		double averageLatency() const { return completedFrames ? totalLatency.count() / completedFrames : 0.0; }
+	};
+
+	// Paces frames and orders queues with one timeline semaphore per queue. Every submission signals its queue's
+	// timeline with the next value, so a value names the submission: the CPU waits on it instead of a fence and
+	// other queues wait on it instead of a binary semaphore. Needs Device::isTimelineSemaphoreEnabled.
+	class LIBRARY_DLL FrameScheduler
+	{
+	public:
+		FrameScheduler() = default;
+		FrameScheduler(const FrameScheduler &) = delete;
+		FrameScheduler &operator=(const FrameScheduler &) = delete;
+		~FrameScheduler();
+
+		VulkanResult createFrameScheduler(const FrameSchedulerConfig &config);
+
+		// returns the value the queue's timeline reaches once the submission is done
+		ResultValue<uint64_t> submit(TimelineQueue queue, const TimelineSubmitInfo &info);
+
+		// blocks until the queue's timeline reached value
+		VulkanResult wait(TimelineQueue queue, uint64_t value);
+		ResultValue<uint64_t> getCompletedValue(TimelineQueue queue);
+		uint64_t getSubmittedValue(TimelineQueue queue) { return timelines[static_cast<size_t>(queue)].submitted; }
+		vk::Semaphore getSemaphore(TimelineQueue queue) { return timelines[static_cast<size_t>(queue)].semaphore.get(); }
+
+		// closes the current frame, everything submitted since the last endFrame belongs to it
+		void endFrame();
+		// blocks until every submission of frameNumber is done, frames count up from 0 with endFrame. Waiting for a
+		// frame that wasn't ended yet is bad usage.
+		VulkanResult waitForFrame(uint64_t frameNumber);
+		VulkanResult waitIdle();
+
+		// frames seen done since the last call, oldest first
+		std::vector<FrameCompletion> takeCompletedFrames();
+
+		uint64_t getFrameNumber() { return frameNumber; }
+		FrameSchedulerStats getStats() { return stats; }
+		FrameSchedulerConfig &getConfig() { return config; }
+
+	private:
+		struct Timeline
+		{
+			QueueInformation *queue = nullptr;
+			vk::UniqueSemaphore semaphore;
+			uint64_t submitted = 0;
+		};
+
+		struct PendingFrame
+		{
+			uint64_t frameNumber;
+			std::array<uint64_t, static_cast<size_t>(TimelineQueue::Count)> values;
+			std::chrono::steady_clock::time_point submittedAt;
+		};
+
+		VulkanResult poll();
+		void complete(const PendingFrame &frame, std::chrono::steady_clock::time_point completedAt);
+
+		FrameSchedulerConfig config;
+		std::array<Timeline, static_cast<size_t>(TimelineQueue::Count)> timelines;
+
+		uint64_t frameNumber = 0;
+		std::deque<PendingFrame> pending;
+		std::vector<FrameCompletion> completed;
+
+		FrameSchedulerStats stats;
+	};
+}
+
+#endif
@@ -7,8 +7,13 @@
 #include "vulkan/vulkan_structs.hpp"
 #include "device.hpp"
 
+#include <algorithm>
+#include <memory>
+
 namespace Vulkan {
 
+    class PipelineStateCache;
+
     struct ViewportConfig {
         bool usesDynamicViewport = false;
         uint32_t dynamicViewportCount = 0;
@@ -42,11 +47,24 @@ namespace Vulkan {
         vk::LogicOp logicOp = vk::LogicOp::eCopy;
     };
 
+    // attachment formats a pipeline renders to with dynamic rendering, there is no render pass to take them from
+    struct RenderingConfig {
+        std::vector<vk::Format> colorFormats = {};
+        vk::Format depthFormat = vk::Format::eUndefined;
+        vk::Format stencilFormat = vk::Format::eUndefined;
+        uint32_t viewMask = 0;
+    };
+
     struct GraphicsPipelineConfig {
         Device* device;
+        // leave it null to create the pipeline for dynamic rendering with renderingConfig instead
         vk::RenderPass renderPass;
         uint32_t subpass = 0;
+        RenderingConfig renderingConfig = {};
         std::vector<vk::PipelineShaderStageCreateInfo> shaderStages = {};
+        // Utils::hashSpirv of every stage's code in the same order, needed with a stateCache. The cache keys on
+        // these instead of the module handles, a destroyed module's handle can be handed out again.
+        std::vector<uint64_t> shaderHashes = {};
 
         std::vector<vk::DynamicState> dynamicStates = {};
         
@@ -85,11 +103,44 @@ namespace Vulkan {
 		    nullptr
         };
 
+        // ignored unless the render pass or rendering config has a depth or stencil attachment
+        vk::PipelineDepthStencilStateCreateInfo depthStencilInfo = {
+		    vk::PipelineDepthStencilStateCreateFlags{},
+		    false,
+		    false,
+		    vk::CompareOp::eLessOrEqual,
+		    false,
+		    false,
+		    {},
+		    {},
+		    0.0f,
+		    1.0f,
+		    nullptr
+        };
+
         ColorBlendConfig colorBlendConfig = {};
 
         std::vector<vk::DescriptorSetLayout> descriptorSetLayouts = {};
         std::vector<vk::PushConstantRange> pushConstants = {};
 
+        // when set identical configs share their pipeline and layout instead of creating new ones,
+        // it isn't part of the state that gets compared
+        PipelineStateCache* stateCache = nullptr;
+
+        bool hasDynamicState(vk::DynamicState state) const {
+            return std::find(dynamicStates.begin(), dynamicStates.end(), state) != dynamicStates.end();
+        }
+    };
+
+    // layouts and pipelines are shared between GraphicsPipelines when they come from a PipelineStateCache,
+    // the handles are destroyed once nothing references them anymore
+    struct SharedPipelineLayout {
+        vk::UniquePipelineLayout layout;
+    };
+
+    struct SharedPipeline {
+        vk::UniquePipeline pipeline;
+        std::shared_ptr<SharedPipelineLayout> layout;
     };
 
     class LIBRARY_DLL GraphicsPipeline {
@@ -98,8 +149,9 @@ namespace Vulkan {
         VulkanResult createGraphicsPipeline(GraphicsPipelineConfig pipelineConfig);
         VulkanResult recreateGraphicsPipeline();
 
-        vk::Pipeline getPipeline() { return pipeline.get(); }
-        vk::PipelineLayout getPipelineLayout() { return pipelineLayout.get(); }
+        vk::Pipeline getPipeline() { return pipeline ? pipeline->pipeline.get() : vk::Pipeline{}; }
+        vk::PipelineLayout getPipelineLayout() { return pipeline ? pipeline->layout->layout.get() : vk::PipelineLayout{}; }
+        std::shared_ptr<SharedPipeline> getSharedPipeline() { return pipeline; }
         GraphicsPipelineConfig& getPipelineConfig() { return config; }
 
 
@@ -107,10 +159,14 @@ namespace Vulkan {
         VulkanResult createGraphicsPipeline();
 
         GraphicsPipelineConfig config;
-        vk::UniquePipelineLayout pipelineLayout;
-        vk::UniquePipeline pipeline;
+        std::shared_ptr<SharedPipeline> pipeline;
 
     };
+
+    namespace Utils {
+        LIBRARY_DLL ResultValue<vk::UniquePipelineLayout> createPipelineLayout(const GraphicsPipelineConfig& config);
+        LIBRARY_DLL ResultValue<vk::UniquePipeline> createPipeline(const GraphicsPipelineConfig& config, vk::PipelineLayout layout);
+    }
 }
 
 #endif
\ No newline at end of file
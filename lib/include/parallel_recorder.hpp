@@ -0,0 +1,80 @@
+#ifndef LIB_VULKAN_PARALLEL_RECORDER_HPP
+#define LIB_VULKAN_PARALLEL_RECORDER_HPP
+
+#include "vulkan.hpp"
+#include "command_buffer_recycler.hpp"
+#include "device.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+
+namespace Vulkan
+{
+	struct ParallelRecorderConfig
+	{
+		Device *device;
+		// the secondaries are executed by primaries of this queue's family
+		QueueInformation *queue;
+		// records the slices, record must not be called from one of its workers
+		ThreadPool *threadPool;
+
+		uint32_t framesInFlight = 2;
+		// the most slices a draw list is split into, 0 uses the thread pool's thread count
+		uint32_t maxSlices = 0;
+	};
+
+	struct RecordingStats
+	{
+		uint64_t recordings = 0;
+		uint64_t slices = 0;
+		// secondaries allocated, they're reused after the frame's pools are reset
+		uint64_t commandBuffersAllocated = 0;
+		// time record spent from splitting the list to the last slice being done
+		std::chrono::duration<double, std::milli> lastRecordTime{0};
+		std::chrono::duration<double, std::milli> totalRecordTime{0};
+	};
+
+	// records items [first, last) of a draw list into commandBuffer, which is begun and ends after it returns.
+	// Nothing is inherited but the render pass or rendering state, bind the pipeline and everything else again.
+	using RecordSliceFunction = std::function<VulkanResult(vk::CommandBuffer commandBuffer, uint32_t first, uint32_t last)>;
+
+	// Splits a draw list into contiguous slices recorded into secondary command buffers on a thread pool. Every
+	// slice has its own CommandBufferRecycler, a slice is recorded by a single job so no pool is used by two
+	// threads at once. The secondaries come back in slice order, executing them in that order
+	// gives the same result as recording the list on one thread.
+	class LIBRARY_DLL ParallelRecorder
+	{
+	public:
+		ParallelRecorder() = default;
+		ParallelRecorder(const ParallelRecorder &) = delete;
+		ParallelRecorder &operator=(const ParallelRecorder &) = delete;
+
+		VulkanResult createParallelRecorder(const ParallelRecorderConfig &config);
+
+		// resets every pool of frameIndex at once, call after the frame's fence or timeline wait
+		VulkanResult beginFrame(uint32_t frameIndex);
+
+		// inheritance names the render pass and framebuffer, or chains a vk::CommandBufferInheritanceRenderingInfo
+		// with dynamic rendering. The primary has to begin them with secondary command buffer contents.
+		ResultValue<std::vector<vk::CommandBuffer>> record(uint32_t count, const vk::CommandBufferInheritanceInfo &inheritance,
+		                                                   const RecordSliceFunction &recordSlice, uint32_t slices = 0);
+
+		// record, then executes the secondaries in primary
+		VulkanResult recordInto(vk::CommandBuffer primary, uint32_t count, const vk::CommandBufferInheritanceInfo &inheritance,
+		                        const RecordSliceFunction &recordSlice, uint32_t slices = 0);
+
+		uint32_t getMaxSlices() { return maxSlices; }
+		RecordingStats getStats();
+		ParallelRecorderConfig &getConfig() { return config; }
+
+	private:
+		ParallelRecorderConfig config;
+		uint32_t maxSlices = 1;
+		// one per slice, each with a pool per frame in flight
+		std::vector<CommandBufferRecycler> recyclers;
+
+		RecordingStats stats;
+	};
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef LIB_VULKAN_PIPELINE_STATE_CACHE_HPP
+#define LIB_VULKAN_PIPELINE_STATE_CACHE_HPP
+
+#include "vulkan.hpp"
+#include "device.hpp"
+#include "graphics_pipeline.hpp"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+
+namespace Vulkan
+{
+	struct PipelineStateCacheConfig
+	{
+		Device *device;
+	};
+
+	struct PipelineStateCacheStats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t layoutHits = 0;
+		uint64_t layoutMisses = 0;
+
+		size_t pipelineCount = 0;
+		size_t layoutCount = 0;
+
+		// time spent in the driver creating pipelines and layouts for misses
+		std::chrono::duration<double, std::milli> creationTime{0};
+	};
+
+	// Device wide cache of pipelines and pipeline layouts keyed on the serialized GraphicsPipelineConfig.
+	// Every config that compares equal gets the same SharedPipeline, the driver only sees the first request.
+	// Entries stay alive until releaseUnused is called and nothing else references them.
+	class LIBRARY_DLL PipelineStateCache
+	{
+	public:
+		VulkanResult createPipelineStateCache(const PipelineStateCacheConfig &config);
+
+		// safe to call from several threads, concurrent requests for the same config wait for a single creation
+		ResultValue<std::shared_ptr<SharedPipeline>> getPipeline(const GraphicsPipelineConfig &pipelineConfig);
+		ResultValue<std::shared_ptr<SharedPipelineLayout>> getPipelineLayout(const GraphicsPipelineConfig &pipelineConfig);
+
+		// drops pipelines and layouts only the cache still references, returns how many pipelines were dropped
+		size_t releaseUnused();
+
+		PipelineStateCacheStats getStats();
+		PipelineStateCacheConfig &getConfig() { return config; }
+
+	private:
+		using PipelineResult = ResultValue<std::shared_ptr<SharedPipeline>>;
+
+		PipelineStateCacheConfig config;
+		std::unordered_map<std::string, std::shared_future<PipelineResult>> pipelines;
+		std::unordered_map<std::string, std::shared_ptr<SharedPipelineLayout>> layouts;
+		PipelineStateCacheStats stats;
+		std::mutex mutex;
+	};
+
+	namespace Utils
+	{
+		// Every field of the config that ends up in the pipeline, in a stable binary form. Shader stages are
+		// compared by their SPIR-V hash, other handles by value so two configs only match when they use the very
+		// same layouts and render pass.
+		// Values covered by one of the config's dynamic states are left out, they're set while recording.
+		LIBRARY_DLL std::string serializePipelineConfig(const GraphicsPipelineConfig &config);
+		LIBRARY_DLL std::string serializePipelineLayout(const GraphicsPipelineConfig &config);
+	}
+}
+
+#endif
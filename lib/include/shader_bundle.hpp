@@ -0,0 +1,143 @@
+#ifndef LIB_VULKAN_SHADER_BUNDLE_HPP
+#define LIB_VULKAN_SHADER_BUNDLE_HPP
+
+#include "vulkan.hpp"
+#include "utils.hpp"
+
+#include <span>
+
+namespace Vulkan
+{
+	// On disk layout of a bundle, every offset is relative to the start of the file:
+	// header | entries | dependencies | string table | SPIR-V blobs (each SHADER_BUNDLE_ALIGNMENT aligned)
+	constexpr uint32_t SHADER_BUNDLE_MAGIC = 0x4E425356; // "VSBN"
+	constexpr uint32_t SHADER_BUNDLE_VERSION = 1;
+	constexpr uint64_t SHADER_BUNDLE_ALIGNMENT = 16;
+
+	struct ShaderBundleHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t entryCount;
+		uint32_t dependencyCount;
+
+		// Utils::hashShaderCompileOptions of the options the bundle was compiled with
+		uint64_t optionsHash;
+
+		uint64_t entriesOffset;
+		uint64_t dependenciesOffset;
+		uint64_t stringsOffset;
+		uint64_t stringsSize;
+	};
+
+	// one compiled stage, paths point into the string table
+	struct ShaderBundleEntry
+	{
+		uint32_t pathOffset;
+		uint32_t pathLength;
+		uint32_t language;
+		uint32_t firstDependency;
+		uint32_t dependencyCount;
+		uint32_t reserved;
+
+		uint64_t sourceHash;
+		uint64_t spirvOffset;
+		uint64_t spirvSize;
+	};
+
+	// an #include edge, both paths are relative to the directory of the entry's source
+	struct ShaderBundleDependency
+	{
+		uint32_t includerOffset;
+		uint32_t includerLength;
+		uint32_t pathOffset;
+		uint32_t pathLength;
+		uint64_t contentHash;
+	};
+
+	struct ShaderBundleConfig
+	{
+		std::filesystem::path path = "shaders.bundle";
+	};
+
+	// A read only memory mapping of a bundle written by the ShaderCompiler tool.
+	// The SPIR-V spans stay valid until the bundle is closed or destroyed.
+	class LIBRARY_DLL ShaderBundle
+	{
+	public:
+		ShaderBundle() = default;
+		ShaderBundle(const ShaderBundle &) = delete;
+		ShaderBundle &operator=(const ShaderBundle &) = delete;
+		~ShaderBundle();
+
+		VulkanResult createShaderBundle(const ShaderBundleConfig &config);
+		void close();
+
+		bool isOpen() const { return data != nullptr; }
+		uint64_t getOptionsHash() const { return header()->optionsHash; }
+
+		const ShaderBundleEntry *findEntry(const std::filesystem::path &source, EShLanguage language) const;
+		std::span<const uint32_t> getSpirv(const ShaderBundleEntry &entry) const;
+
+		// true when the source isn't on disk (shipped without GLSL) or it and its includes still hash the same
+		bool isUpToDate(const ShaderBundleEntry &entry) const;
+
+		// include edges of the entry, resolved against the source directory like ShaderIncluder records them
+		ShaderDependencyGraph getDependencies(const ShaderBundleEntry &entry) const;
+
+		ShaderBundleConfig &getConfig() { return config; }
+
+	private:
+		const ShaderBundleHeader *header() const { return reinterpret_cast<const ShaderBundleHeader *>(data); }
+		std::span<const ShaderBundleEntry> entries() const;
+		std::span<const ShaderBundleDependency> dependencies(const ShaderBundleEntry &entry) const;
+		std::string_view string(uint32_t offset, uint32_t length) const;
+
+		ShaderBundleConfig config;
+		const uint8_t *data = nullptr;
+		size_t size = 0;
+
+#ifdef _WIN32
+		void *file = nullptr;
+		void *mapping = nullptr;
+#endif
+	};
+
+	// SPIR-V of a program that either points into a mapped bundle or owns a runtime compilation.
+	struct LoadedShaderProgram
+	{
+		// one module per source, in the same order as the sources
+		std::vector<std::span<const uint32_t>> spirv = {};
+		ShaderDependencyGraph dependencies = {};
+		bool fromBundle = false;
+
+		// backing storage when compiled at runtime, moving the program keeps the spans valid
+		std::vector<std::vector<uint32_t>> compiledSpirv = {};
+
+		LoadedShaderProgram() = default;
+		// a copy's spans would still point into the original's compiledSpirv
+		LoadedShaderProgram(const LoadedShaderProgram &) = delete;
+		LoadedShaderProgram &operator=(const LoadedShaderProgram &) = delete;
+		LoadedShaderProgram(LoadedShaderProgram &&) = default;
+		LoadedShaderProgram &operator=(LoadedShaderProgram &&) = default;
+	};
+
+	namespace Utils
+	{
+		// Packs the programs into a bundle at path, compiled is in the same order as programs.
+		LIBRARY_DLL VulkanResult writeShaderBundle(const std::filesystem::path &path,
+		                                           const std::vector<ShaderProgramSources> &programs,
+		                                           const std::vector<CompiledShaderProgram> &compiled,
+		                                           const ShaderCompileOptions &options);
+
+		// Uses the bundle's SPIR-V without copying it when every stage is in there and up to date,
+		// compiles the GLSL otherwise. bundle can be null or closed.
+		LIBRARY_DLL ResultValue<LoadedShaderProgram> loadShaderProgram(const ShaderProgramSources &sources,
+		                                                               const ShaderCompileOptions &options,
+		                                                               const ShaderBundle *bundle);
+
+		LIBRARY_DLL ResultValue<vk::UniqueShaderModule> createShaderModule(Device &device, std::span<const uint32_t> spirv);
+	}
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef LIB_VULKAN_SHADER_CACHE_HPP
+#define LIB_VULKAN_SHADER_CACHE_HPP
+
+#include "vulkan.hpp"
+#include "shader_includer.hpp"
+
+#include <mutex>
+
+namespace Vulkan
+{
+	struct ShaderCacheConfig
+	{
+		// relative paths are resolved the same way the shaders/ directory is (next to the executable)
+		std::filesystem::path directory = "shader_cache";
+
+		// once the cache grows past this size the least recently used entries are evicted
+		size_t maxSizeBytes = 64 * 1024 * 1024;
+	};
+
+	struct ShaderCacheStats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t writes = 0;
+		uint64_t evictions = 0;
+		uint64_t corruptedEntries = 0;
+
+		// entries whose key matched but one of their transitive includes changed since
+		uint64_t staleEntries = 0;
+	};
+
+	struct ShaderCacheEntry
+	{
+		std::vector<std::vector<uint32_t>> spirv = {};
+		ShaderDependencyGraph dependencies = {};
+	};
+
+	// Content addressed on-disk cache of compiled SPIR-V programs.
+	// Every entry holds the SPIR-V of all the stages of one program, keyed by a hash of
+	// the sources, stages, target environment and compile flags (see Utils::compileShaders).
+	// Included files aren't part of the key, the entry records their content hashes instead
+	// and is only returned while all of them are unchanged.
+	class LIBRARY_DLL ShaderCache
+	{
+	public:
+		VulkanResult createShaderCache(const ShaderCacheConfig &config);
+
+		std::optional<ShaderCacheEntry> load(uint64_t key);
+		VulkanResult store(uint64_t key, const ShaderCacheEntry &entry);
+
+		VulkanResult evict();
+		VulkanResult clear();
+
+		ShaderCacheConfig &getConfig() { return config; }
+		ShaderCacheStats getStats();
+
+	private:
+		std::filesystem::path entryPath(uint64_t key) const;
+
+		ShaderCacheConfig config;
+		ShaderCacheStats stats;
+		std::mutex mutex;
+	};
+}
+
+#endif
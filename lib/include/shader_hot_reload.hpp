@@ -0,0 +1,125 @@
+#ifndef LIB_VULKAN_SHADER_HOT_RELOAD_HPP
+#define LIB_VULKAN_SHADER_HOT_RELOAD_HPP
+
+#include "vulkan.hpp"
+#include "device.hpp"
+#include "graphics_pipeline.hpp"
+#include "utils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace Vulkan
+{
+	using ShaderChangeCallback = std::function<void(const std::vector<std::filesystem::path> &changedFiles)>;
+
+	struct ShaderWatcherConfig
+	{
+		std::filesystem::path directory = "shaders";
+
+		// changes arriving within this window are reported together (editors tend to write files in several steps)
+		std::chrono::milliseconds debounce{50};
+
+		ShaderChangeCallback onChange = {};
+
+		std::function<void()> onThreadStart = {};
+		std::function<void()> onThreadStop = {};
+	};
+
+	// Watches a directory (and its sub directories) from a background thread and reports modified files.
+	// Uses inotify on linux and falls back to polling modification times elsewhere.
+	class LIBRARY_DLL ShaderWatcher
+	{
+	public:
+		ShaderWatcher() = default;
+		ShaderWatcher(const ShaderWatcher &) = delete;
+		ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+		~ShaderWatcher();
+
+		VulkanResult createShaderWatcher(const ShaderWatcherConfig &config);
+		void stop();
+
+		ShaderWatcherConfig &getConfig() { return config; }
+
+	private:
+		void watchLoop();
+
+		ShaderWatcherConfig config;
+		std::thread thread;
+		std::atomic<bool> stopping = false;
+
+#ifdef __linux__
+		int inotifyFd = -1;
+		std::unordered_map<int, std::filesystem::path> watches;
+#endif
+	};
+
+	struct PipelineHotReloaderConfig
+	{
+		Device *device;
+		Utils::ShaderCompileOptions compileOptions = {};
+		std::filesystem::path directory = "shaders";
+
+		// a replaced pipeline is destroyed once this many frames went by since the swap
+		uint32_t framesInFlight = 1;
+	};
+
+	// Recompiles the programs of registered pipelines when their sources (or includes) change and
+	// builds the replacement pipelines on the watcher thread. The render thread swaps them in by
+	// calling applyPendingReloads at a frame boundary, after it waited for the frame's fence.
+	class LIBRARY_DLL PipelineHotReloader
+	{
+	public:
+		VulkanResult createPipelineHotReloader(const PipelineHotReloaderConfig &config);
+		void stop();
+
+		// the shader stages of the pipeline config are matched to the sources by stage
+		void addProgram(GraphicsPipeline *pipeline, Utils::ShaderProgramSources sources, ShaderDependencyGraph dependencies);
+
+		// returns the number of pipelines that were swapped
+		uint32_t applyPendingReloads(uint64_t frameNumber);
+
+		PipelineHotReloaderConfig &getConfig() { return config; }
+
+	private:
+		struct Program
+		{
+			GraphicsPipeline *pipeline;
+			Utils::ShaderProgramSources sources;
+			ShaderDependencyGraph dependencies;
+			GraphicsPipelineConfig pipelineConfig;
+			std::vector<vk::UniqueShaderModule> modules;
+		};
+
+		struct PendingReload
+		{
+			size_t program;
+			GraphicsPipeline pipeline;
+			ShaderDependencyGraph dependencies;
+			GraphicsPipelineConfig pipelineConfig;
+			std::vector<vk::UniqueShaderModule> modules;
+			std::chrono::steady_clock::time_point detectedAt;
+		};
+
+		struct RetiredPipeline
+		{
+			uint64_t retiredAt;
+			GraphicsPipeline pipeline;
+		};
+
+		void onShadersChanged(const std::vector<std::filesystem::path> &changedFiles);
+		VulkanResult rebuild(size_t programIndex, std::chrono::steady_clock::time_point detectedAt);
+
+		PipelineHotReloaderConfig config;
+		std::vector<Program> programs;
+		std::vector<PendingReload> pending;
+		std::vector<RetiredPipeline> retired;
+		std::mutex mutex;
+
+		ShaderWatcher watcher;
+	};
+}
+
+#endif
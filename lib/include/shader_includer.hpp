@@ -0,0 +1,56 @@
+#ifndef LIB_VULKAN_SHADER_INCLUDER_HPP
+#define LIB_VULKAN_SHADER_INCLUDER_HPP
+
+#include "vulkan.hpp"
+
+#include <set>
+
+namespace Vulkan
+{
+	struct ShaderDependency
+	{
+		// file containing the #include directive, either a program source or another include
+		std::filesystem::path includer;
+		std::filesystem::path path;
+
+		// hash of the included file contents when it was compiled
+		uint64_t contentHash = 0;
+	};
+
+	struct LIBRARY_DLL ShaderDependencyGraph
+	{
+		std::vector<ShaderDependency> edges = {};
+
+		void add(ShaderDependency dependency);
+
+		// every file reachable through #include from the program sources
+		std::set<std::filesystem::path> files() const;
+		bool dependsOn(const std::filesystem::path &file) const;
+
+		// true when every recorded include still has the contents it was compiled with
+		bool isUpToDate() const;
+	};
+
+	// Resolves #include "..." relative to the including file and then the include directories,
+	// #include <...> only against the include directories. Every include that gets resolved is
+	// recorded in the dependency graph.
+	class LIBRARY_DLL ShaderIncluder : public glslang::TShader::Includer
+	{
+	public:
+		ShaderIncluder(std::vector<std::filesystem::path> includeDirectories);
+
+		IncludeResult *includeSystem(const char *headerName, const char *includerName, size_t inclusionDepth) override;
+		IncludeResult *includeLocal(const char *headerName, const char *includerName, size_t inclusionDepth) override;
+		void releaseInclude(IncludeResult *result) override;
+
+		ShaderDependencyGraph &getDependencies() { return dependencies; }
+
+	private:
+		IncludeResult *include(const std::filesystem::path &path, const char *includerName);
+
+		std::vector<std::filesystem::path> includeDirectories;
+		ShaderDependencyGraph dependencies;
+	};
+}
+
+#endif
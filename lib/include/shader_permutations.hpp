@@ -0,0 +1,82 @@
+#ifndef LIB_VULKAN_SHADER_PERMUTATIONS_HPP
+#define LIB_VULKAN_SHADER_PERMUTATIONS_HPP
+
+#include "vulkan.hpp"
+#include "device.hpp"
+#include "graphics_pipeline.hpp"
+#include "shader_reflection.hpp"
+#include "utils.hpp"
+
+#include <memory>
+#include <mutex>
+
+namespace Vulkan
+{
+	// One bit of a permutation key backed by a specialization constant, e.g.
+	// layout(constant_id = 0) const bool VERTEX_COLOR = false;
+	// Features with more than one bit select an integer value, 2 bits give a light count of 0 to 3.
+	struct ShaderFeature
+	{
+		std::string name;
+		uint32_t constantId;
+		uint32_t bitCount = 1;
+	};
+
+	using PermutationKey = uint64_t;
+
+	struct ShaderPermutationFamilyConfig
+	{
+		Device *device;
+		Utils::ShaderProgramSources sources = {};
+		Utils::ShaderCompileOptions compileOptions = {};
+		std::vector<ShaderFeature> features = {};
+
+		// shared by every variant, the shader stages are filled in by the family
+		GraphicsPipelineConfig pipelineConfig = {};
+
+		// when set the vertex input, descriptor set layouts and push constants come from reflection
+		DescriptorSetLayoutCache *layoutCache = nullptr;
+	};
+
+	// Compiles a program once and bakes its variants through specialization constants instead of
+	// compiling every combination of defines. Variant pipelines are created the first time their
+	// key is requested and live as long as the family.
+	class LIBRARY_DLL ShaderPermutationFamily
+	{
+	public:
+		VulkanResult createShaderPermutationFamily(const ShaderPermutationFamilyConfig &config);
+
+		// features missing from the map are 0, values must fit in the feature's bits
+		ResultValue<PermutationKey> makeKey(const std::unordered_map<std::string, uint32_t> &featureValues) const;
+
+		ResultValue<GraphicsPipeline *> getVariant(PermutationKey key);
+
+		size_t getVariantCount();
+		const ShaderReflection &getReflection() const { return reflection; }
+		const Utils::CompiledShaderProgram &getProgram() const { return program; }
+		ShaderPermutationFamilyConfig &getConfig() { return config; }
+
+	private:
+		struct Variant
+		{
+			std::vector<vk::SpecializationMapEntry> mapEntries;
+			std::vector<uint32_t> data;
+			vk::SpecializationInfo specializationInfo;
+			GraphicsPipeline pipeline;
+		};
+
+		ShaderPermutationFamilyConfig config;
+		Utils::CompiledShaderProgram program;
+		ShaderReflection reflection;
+		std::vector<vk::UniqueShaderModule> modules;
+
+		// bit offset of each feature inside a key
+		std::vector<uint32_t> featureOffsets;
+		PermutationKey validBits = 0;
+
+		std::unordered_map<PermutationKey, std::unique_ptr<Variant>> variants;
+		std::mutex mutex;
+	};
+}
+
+#endif
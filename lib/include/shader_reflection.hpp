@@ -0,0 +1,85 @@
+#ifndef LIB_VULKAN_SHADER_REFLECTION_HPP
+#define LIB_VULKAN_SHADER_REFLECTION_HPP
+
+#include "vulkan.hpp"
+#include "descriptor_layout_cache.hpp"
+#include "compute_pipeline.hpp"
+#include "graphics_pipeline.hpp"
+
+#include <map>
+#include <span>
+
+namespace Vulkan
+{
+	struct ReflectedVertexInput
+	{
+		uint32_t location;
+		vk::Format format;
+		uint32_t size;
+		std::string name = "";
+	};
+
+	struct ReflectedSpecializationConstant
+	{
+		uint32_t constantId;
+		// 4 for bool, int and float constants, 8 for their 64 bit versions
+		uint32_t size;
+		vk::ShaderStageFlags stageFlags;
+		std::string name = "";
+	};
+
+	// Resources used by one or more shader stages, read back from the compiled SPIR-V.
+	struct LIBRARY_DLL ShaderReflection
+	{
+		vk::ShaderStageFlags stages = {};
+
+		// set index -> bindings of that set
+		std::map<uint32_t, std::vector<vk::DescriptorSetLayoutBinding>> descriptorSets = {};
+
+		// all push constant blocks merged into a single range visible to every stage using one
+		std::optional<vk::PushConstantRange> pushConstants = std::nullopt;
+
+		// only filled for vertex shaders, sorted by location
+		std::vector<ReflectedVertexInput> vertexInputs = {};
+
+		// sorted by constant id, names are only there if debug info wasn't stripped
+		std::vector<ReflectedSpecializationConstant> specializationConstants = {};
+
+		// only filled for compute shaders, the declared workgroup size and the specialization
+		// constant ids of the dimensions declared with local_size_x_id and friends
+		std::array<uint32_t, 3> localSize = {1, 1, 1};
+		std::array<std::optional<uint32_t>, 3> localSizeConstantIds = {};
+
+		// merges the resources of another stage, a binding used by both stages gets both stage flags
+		VulkanResult merge(const ShaderReflection &other);
+
+		// SPIR-V can't tell dynamic buffers apart, this switches a uniform or storage buffer binding to its
+		// dynamic variant for buffers bound with a per draw offset, e.g. from a FrameAllocator
+		VulkanResult useDynamicOffsets(uint32_t set, uint32_t binding);
+
+		// vertex attributes assuming a single, tightly packed, interleaved vertex buffer
+		std::vector<vk::VertexInputAttributeDescription> getVertexAttributeDescriptions(uint32_t binding = 0) const;
+		vk::VertexInputBindingDescription getVertexBindingDescription(uint32_t binding = 0, vk::VertexInputRate inputRate = vk::VertexInputRate::eVertex) const;
+
+		// one layout per set index from 0 to the highest used set, unused sets get an empty layout
+		ResultValue<std::vector<vk::DescriptorSetLayout>> getDescriptorSetLayouts(DescriptorSetLayoutCache &cache) const;
+		std::vector<vk::PushConstantRange> getPushConstantRanges() const;
+	};
+
+	namespace Utils
+	{
+		LIBRARY_DLL ResultValue<ShaderReflection> reflectShader(std::span<const uint32_t> spirv);
+
+		// reflects every stage of a program and merges them
+		LIBRARY_DLL ResultValue<ShaderReflection> reflectProgram(const std::vector<std::span<const uint32_t>> &spirv);
+		LIBRARY_DLL ResultValue<ShaderReflection> reflectProgram(const std::vector<std::vector<uint32_t>> &spirv);
+
+		// fills the vertex input, descriptor set layouts and push constants of the config from reflection
+		LIBRARY_DLL VulkanResult applyReflection(GraphicsPipelineConfig &config, const ShaderReflection &reflection, DescriptorSetLayoutCache &cache, uint32_t vertexBinding = 0);
+
+		// fills the descriptor set layouts, push constants and workgroup size of the config from reflection
+		LIBRARY_DLL VulkanResult applyReflection(ComputePipelineConfig &config, const ShaderReflection &reflection, DescriptorSetLayoutCache &cache);
+	}
+}
+
+#endif
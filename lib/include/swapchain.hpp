@@ -62,6 +62,15 @@ namespace Vulkan {
             VulkanResult recreateImageViews();
             VulkanResult recreateFramebuffers();
 
+            // dynamic rendering into a swapchain image, these also do the layout transitions a render pass
+            // would do, from undefined to color attachment and from color attachment to present
+            // pass vk::RenderingFlagBits::eContentsSecondaryCommandBuffers to draw with secondary command buffers
+            void beginRendering(vk::CommandBuffer commandBuffer, uint32_t imageIndex, vk::ClearColorValue clearColor, vk::RenderingFlags flags = {});
+            void endRendering(vk::CommandBuffer commandBuffer, uint32_t imageIndex);
+
+            // false when rendering with dynamic rendering, resizes then only recreate the image views
+            bool usesFramebuffers() { return static_cast<bool>(framebufferConfig.renderPass); }
+
             SwapchainConfig& getSwapchainConfig() { return swapchainConfig; }
             ImageViewConfig& getImageViewConfig() { return imageViewConfig; }
             FramebuffersConfig& getFramebufferConfig() { return framebufferConfig; }
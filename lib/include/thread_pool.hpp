@@ -0,0 +1,69 @@
+#ifndef LIB_THREAD_POOL_HPP
+#define LIB_THREAD_POOL_HPP
+
+#include "vulkan.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace Vulkan
+{
+	struct ThreadPoolConfig
+	{
+		// 0 means one worker per hardware thread
+		uint32_t threadCount = 0;
+
+		// run on each worker before it picks up its first job / after its last one,
+		// used for per-thread library initialization (glslang for instance)
+		std::function<void()> onThreadStart = {};
+		std::function<void()> onThreadStop = {};
+	};
+
+	class LIBRARY_DLL ThreadPool
+	{
+	public:
+		ThreadPool() = default;
+		ThreadPool(const ThreadPool &) = delete;
+		ThreadPool &operator=(const ThreadPool &) = delete;
+		~ThreadPool();
+
+		VulkanResult createThreadPool(const ThreadPoolConfig &config);
+		void shutdown();
+
+		template <typename F>
+		std::future<std::invoke_result_t<F>> submit(F &&function)
+		{
+			using ReturnType = std::invoke_result_t<F>;
+
+			auto task = std::make_shared<std::packaged_task<ReturnType()>>(std::forward<F>(function));
+			auto future = task->get_future();
+
+			{
+				std::lock_guard lock(mutex);
+				jobs.emplace_back([task]()
+				                  { (*task)(); });
+			}
+			condition.notify_one();
+
+			return future;
+		}
+
+		uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+		ThreadPoolConfig &getConfig() { return config; }
+
+	private:
+		void workerLoop();
+
+		ThreadPoolConfig config;
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> jobs;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping = false;
+	};
+}
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef LIB_VULKAN_UPLOAD_MANAGER_HPP
+#define LIB_VULKAN_UPLOAD_MANAGER_HPP
+
+#include "vulkan.hpp"
+#include "allocator.hpp"
+#include "device.hpp"
+#include "frame_scheduler.hpp"
+
+#include <chrono>
+#include <deque>
+
+namespace Vulkan
+{
+	struct UploadManagerConfig
+	{
+		Device *device;
+		Allocator *allocator;
+
+		// copies run on transferQueue, the buffers are then used on destinationQueue. When the two are different
+		// families the buffers' ownership is released and acquired, unless the allocator shares both families.
+		QueueInformation *transferQueue;
+		QueueInformation *destinationQueue;
+
+		// frames the destination queue can have in flight, a batch's semaphore is only reused after that many frames
+		uint32_t framesInFlight = 2;
+
+		// size of the staging ring, a single upload can't be bigger than this
+		vk::DeviceSize stagingSize = 16 * 1024 * 1024;
+
+		// when set batches signal its transfer timeline instead of a fence and a semaphore each, the scheduler's
+		// transfer queue has to be transferQueue
+		FrameScheduler *scheduler = nullptr;
+	};
+
+	struct UploadStats
+	{
+		uint64_t bytesUploaded = 0;
+		uint64_t uploadCount = 0;
+		uint64_t batchCount = 0;
+
+		// time with at least one batch on the transfer queue, a batch counts as done once its fence or timeline value
+		// is seen signaled in beginFrame or submit so this is an upper bound
+		std::chrono::duration<double, std::milli> transferTime{0};
+		// transferTime against the time since creation
+		double queueOccupancy = 0.0;
+
+		double megabytesPerSecond() const
+		{
+			return transferTime.count() > 0.0 ? bytesUploaded / (1024.0 * 1024.0) / (transferTime.count() / 1000.0) : 0.0;
+		}
+	};
+
+	// what the destination queue submission has to wait on before using the uploaded buffers, timelineWaits with
+	// a scheduler and the binary semaphores otherwise
+	struct UploadSubmission
+	{
+		std::vector<vk::Semaphore> semaphores;
+		std::vector<vk::PipelineStageFlags> waitStages;
+		std::vector<TimelineWait> timelineWaits;
+	};
+
+	// Batches host to device local buffer copies through a persistently mapped staging ring and runs them on the
+	// transfer queue. Uploads are copied into the ring right away and recorded when submit is called once a frame.
+	class LIBRARY_DLL UploadManager
+	{
+	public:
+		UploadManager() = default;
+		UploadManager(const UploadManager &) = delete;
+		UploadManager &operator=(const UploadManager &) = delete;
+		~UploadManager();
+
+		VulkanResult createUploadManager(const UploadManagerConfig &config);
+
+		// dstStage and dstAccess describe the first use of the buffer on the destination queue
+		VulkanResult upload(vk::Buffer destination, const void *data, vk::DeviceSize size, vk::DeviceSize destinationOffset = 0,
+		                    vk::PipelineStageFlags dstStage = vk::PipelineStageFlagBits::eVertexInput,
+		                    vk::AccessFlags dstAccess = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead);
+
+		// call after the fence wait of frameNumber, frees staging space of finished batches and recycles their semaphores
+		VulkanResult beginFrame(uint64_t frameNumber);
+
+		// submits the queued copies, the returned semaphores or timeline waits have to be waited on by the next
+		// destination queue submission
+		ResultValue<UploadSubmission> submit();
+
+		// ownership acquire barriers for the batches returned by the last submit, record them in the
+		// destination queue's command buffer before the buffers are used. Nothing is recorded for a single family.
+		void recordAcquireBarriers(vk::CommandBuffer commandBuffer);
+
+		// blocks until every submitted batch is done
+		VulkanResult waitIdle();
+
+		UploadStats getStats();
+		UploadManagerConfig &getConfig() { return config; }
+
+	private:
+		struct PendingCopy
+		{
+			vk::Buffer destination;
+			vk::BufferCopy region;
+			vk::PipelineStageFlags dstStage;
+			vk::AccessFlags dstAccess;
+		};
+
+		struct Batch
+		{
+			vk::CommandBuffer commandBuffer;
+			// null with a scheduler, timelineValue is signaled instead
+			vk::Fence fence;
+			vk::Semaphore semaphore;
+			uint64_t timelineValue = 0;
+			// staging bytes including alignment and wrap around padding
+			vk::DeviceSize stagingBytes = 0;
+			uint64_t submittedFrame = 0;
+			std::chrono::steady_clock::time_point submittedAt;
+		};
+
+		bool ownershipTransfer() const;
+		VulkanResult submitPending();
+		ResultValue<vk::DeviceSize> allocateStaging(vk::DeviceSize size);
+		VulkanResult retireBatches(bool waitForOldest);
+
+		UploadManagerConfig config;
+		UniqueBuffer staging;
+
+		vk::UniqueCommandPool commandPool;
+		std::vector<vk::UniqueCommandBuffer> commandBuffers;
+		std::vector<vk::UniqueFence> fences;
+		std::vector<vk::UniqueSemaphore> semaphores;
+		std::vector<vk::CommandBuffer> freeCommandBuffers;
+		std::vector<vk::Fence> freeFences;
+		std::vector<vk::Semaphore> freeSemaphores;
+
+		std::vector<PendingCopy> pending;
+		vk::DeviceSize pendingStagingBytes = 0;
+		std::deque<Batch> inFlight;
+		// semaphores of finished batches with the frame that waited on them
+		std::deque<std::pair<vk::Semaphore, uint64_t>> retiredSemaphores;
+		UploadSubmission ready;
+		std::vector<vk::BufferMemoryBarrier> pendingAcquires;
+		std::vector<vk::BufferMemoryBarrier> acquires;
+		vk::PipelineStageFlags acquireStages = {};
+
+		vk::DeviceSize head = 0;
+		vk::DeviceSize used = 0;
+		uint64_t currentFrame = 0;
+
+		UploadStats stats;
+		std::chrono::steady_clock::time_point createdAt;
+		std::chrono::steady_clock::time_point busySince;
+	};
+}
+
+#endif
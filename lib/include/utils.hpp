@@ -6,7 +6,12 @@
 #include "common.hpp"
 #include "device.hpp"
 #include "glslang/Public/ShaderLang.h"
+#include "shader_cache.hpp"
+#include "shader_includer.hpp"
 #include "swapchain.hpp"
+#include "thread_pool.hpp"
+
+#include <span>
 namespace Vulkan::Utils
 {
 	inline std::string readFile(std::filesystem::path fileName)
@@ -45,92 +50,169 @@ namespace Vulkan::Utils
 		return rgb(hex >> 16 & 0xff, hex >> 8 & 0xff, hex & 0xff);
 	}
 
-    inline ResultValue<std::vector<std::vector<uint32_t>>> compileShaders(std::vector<std::pair<std::filesystem::path, EShLanguage>> shaders)
-    {
-        glslang::TProgram program{};
-        EShMessages messages = static_cast<EShMessages>(
-            EShMsgDefault | EShMsgVulkanRules | EShMsgSpvRules | EShMsgDebugInfo);
-
-        std::vector<std::vector<uint32_t>> returnValue;
-        std::vector<glslang::TShader*> preparsedShaders;
-        
-        for (const auto &s : shaders)
-        {
-            auto language = s.second;
-            glslang::TShader* s1 = new glslang::TShader(language);
-            preparsedShaders.push_back(s1);
-            auto& shader = *preparsedShaders[preparsedShaders.size() - 1];
-            auto shaderSource = readFile(s.first);
-            auto shaderSources = shaderSource.c_str();
-
-            if (shaderSource == "")
-            {
-                return VulkanResult::GLSLangError("Couldn't read file " + s.first.string());
-            }
-
-            std::cout << "Parsing " << shaderSources << std::endl;
-            shader.setStrings(&shaderSources, 1);
-            shader.setEnvInput(glslang::EShSourceGlsl, language,
-                               glslang::EShClientVulkan, 100);
-            shader.setEnvClient(glslang::EShClientVulkan,
-                                glslang::EShTargetVulkan_1_0);
-            shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_0);
-
-            std::string vertOutput;
-            glslang::TShader::ForbidIncluder includer;
-
-            if (!shader.preprocess(GetDefaultResources(), 100, ENoProfile, false,
-                                   false, messages, &vertOutput, includer))
-            {
-
-                return VulkanResult::GLSLangError(
-                    std::string("Shader preprocessing failed: ") +
-                    shader.getInfoLog());
-            }
-
-            if (!shader.parse(GetDefaultResources(), 100, false, messages))
-            {
-                return VulkanResult::GLSLangError(std::string("Shader parsing failed: ") +
-                                                  shader.getInfoLog());
-            }
-        }
-
-        for (auto &shader : preparsedShaders)
-        {
-            program.addShader(shader);
-        }
-
-        if (!program.link(messages))
-        {
-            std::cout <<  program.getInfoDebugLog() << std::endl;
-
-            return VulkanResult::GLSLangError(std::string("Program linking failed: ") +
-                                              program.getInfoLog());
-        }
-
-        for (const auto &shader : shaders)
-        {
-            auto language = shader.second;
-
-
-            // Get SPIR-V code for shader
-            glslang::TIntermediate *shaderIntermediate =
-                program.getIntermediate(language);
-            if (!shaderIntermediate)
-            {
-                return VulkanResult::GLSLangError(
-                    std::string(
-                        "Failed to get intermediate representation for shader: ") +
-                    program.getInfoLog());
-            }
-
-            std::vector<unsigned int> shaderSpirv;
-            glslang::GlslangToSpv(*shaderIntermediate, shaderSpirv);
-            returnValue.push_back(shaderSpirv);
-        }
-
-        return returnValue;
-    }
+	inline vk::ShaderStageFlagBits shaderStageFromLanguage(EShLanguage language)
+	{
+		switch (language)
+		{
+		case EShLangVertex:
+			return vk::ShaderStageFlagBits::eVertex;
+		case EShLangTessControl:
+			return vk::ShaderStageFlagBits::eTessellationControl;
+		case EShLangTessEvaluation:
+			return vk::ShaderStageFlagBits::eTessellationEvaluation;
+		case EShLangGeometry:
+			return vk::ShaderStageFlagBits::eGeometry;
+		case EShLangFragment:
+			return vk::ShaderStageFlagBits::eFragment;
+		case EShLangCompute:
+			return vk::ShaderStageFlagBits::eCompute;
+		default:
+			return vk::ShaderStageFlagBits::eAll;
+		}
+	}
+
+	// stage from the naming convention used in shaders/, e.g. simple_triangle.vert.glsl
+	inline std::optional<EShLanguage> shaderLanguageFromPath(const std::filesystem::path &path)
+	{
+		auto stage = path.stem().extension().string();
+		if (path.extension() != ".glsl")
+		{
+			stage = path.extension().string();
+		}
+
+		if (stage == ".vert")
+			return EShLangVertex;
+		if (stage == ".tesc")
+			return EShLangTessControl;
+		if (stage == ".tese")
+			return EShLangTessEvaluation;
+		if (stage == ".geom")
+			return EShLangGeometry;
+		if (stage == ".frag")
+			return EShLangFragment;
+		if (stage == ".comp")
+			return EShLangCompute;
+		return std::nullopt;
+	}
+
+	constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+	// FNV-1a, only used for cache keys and corruption detection, not for anything security related.
+	inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = HASH_SEED)
+	{
+		auto bytes = static_cast<const uint8_t *>(data);
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	template <typename T>
+	    requires std::is_trivially_copyable_v<T>
+	inline uint64_t hashValue(const T &value, uint64_t seed = HASH_SEED)
+	{
+		return hashBytes(&value, sizeof(T), seed);
+	}
+
+	inline uint64_t hashString(std::string_view value, uint64_t seed = HASH_SEED)
+	{
+		return hashBytes(value.data(), value.size(), hashValue(value.size(), seed));
+	}
+
+	inline uint64_t hashSpirv(std::span<const uint32_t> spirv, uint64_t seed = HASH_SEED)
+	{
+		return hashBytes(spirv.data(), spirv.size_bytes(), hashValue(spirv.size(), seed));
+	}
+
+	LIBRARY_DLL std::optional<std::vector<char>> readBinaryFile(const std::filesystem::path &fileName);
+
+	// writes to a temporary file next to fileName and renames it over fileName,
+	// so readers never observe a partially written file.
+	LIBRARY_DLL VulkanResult writeFileAtomic(const std::filesystem::path &fileName, const void *data, size_t size);
+
+	enum class ShaderOptimization
+	{
+		None,
+		Performance,
+		Size
+	};
+
+	struct ShaderCompileOptions
+	{
+		// when set, programs are looked up in (and stored to) this cache before running glslang
+		ShaderCache *cache = nullptr;
+
+		// searched for #include <...>, and for #include "..." after the including file's directory
+		std::vector<std::filesystem::path> includeDirectories = {std::filesystem::path("shaders")};
+
+		// SPIRV-Tools optimizer passes run between GlslangToSpv and returning the modules
+		ShaderOptimization optimization = ShaderOptimization::None;
+
+		// drops debug info (names, lines, source) from the emitted SPIR-V, meant for release builds
+		bool stripDebugInfo = false;
+
+		// #define name value ahead of every source
+		std::vector<std::pair<std::string, std::string>> defines = {};
+	};
+
+	struct SpirvOptimizationReport
+	{
+		uint32_t instructionsBefore = 0;
+		uint32_t instructionsAfter = 0;
+		size_t bytesBefore = 0;
+		size_t bytesAfter = 0;
+	};
+
+	inline uint32_t countSpirvInstructions(const std::vector<uint32_t> &spirv)
+	{
+		constexpr size_t HEADER_WORDS = 5;
+
+		uint32_t count = 0;
+		for (size_t i = HEADER_WORDS; i < spirv.size();)
+		{
+			uint32_t wordCount = spirv[i] >> 16;
+			if (wordCount == 0)
+			{
+				break;
+			}
+			i += wordCount;
+			++count;
+		}
+		return count;
+	}
+
+	using ShaderProgramSources = std::vector<std::pair<std::filesystem::path, EShLanguage>>;
+
+	struct CompiledShaderProgram
+	{
+		// one SPIR-V module per source, in the same order as the sources
+		std::vector<std::vector<uint32_t>> spirv = {};
+
+		// every file pulled in through #include, transitively
+		ShaderDependencyGraph dependencies = {};
+
+		// one report per module when the optimizer ran, empty for programs loaded from the cache
+		std::vector<SpirvOptimizationReport> optimizationReports = {};
+
+		bool fromCache = false;
+	};
+
+	// hash of everything besides the sources that changes the SPIR-V a compilation produces
+	LIBRARY_DLL uint64_t hashShaderCompileOptions(const ShaderCompileOptions &options, uint64_t seed = HASH_SEED);
+
+	LIBRARY_DLL ResultValue<CompiledShaderProgram> compileShaderProgram(const ShaderProgramSources &shaders, const ShaderCompileOptions &options = {});
+
+	LIBRARY_DLL ResultValue<std::vector<std::vector<uint32_t>>> compileShaders(std::vector<std::pair<std::filesystem::path, EShLanguage>> shaders, const ShaderCompileOptions &options = {});
+
+	// thread pool configuration that sets up glslang on every worker
+	LIBRARY_DLL ThreadPoolConfig shaderCompilerThreadPoolConfig(uint32_t threadCount = 0);
+
+	// Parses and links every program concurrently, results are returned in the same order as programs.
+	// When pool is null a temporary pool with one worker per hardware thread is used.
+	LIBRARY_DLL std::vector<ResultValue<CompiledShaderProgram>> compileShaderPrograms(const std::vector<ShaderProgramSources> &programs, const ShaderCompileOptions &options = {}, ThreadPool *pool = nullptr);
 
     LIBRARY_DLL vk::Extent2D getExtentFromWindow(const vk::SurfaceCapabilitiesKHR& capabilities, GLFWwindow* window);
 
@@ -17,6 +17,9 @@ namespace Vulkan
 	class LIBRARY_DLL VulkanApplication
 	{
 	public:
+		// terminates GLFW and glslang, runs after the derived application's members freed their resources
+		virtual ~VulkanApplication();
+
 		VulkanResult run();
 		VulkanResult init_vulkan();
 		void cleanup_vulkan();
@@ -29,6 +32,10 @@ namespace Vulkan
 
 
 		// @group events
+
+	private:
+		bool glfwInitialized = false;
+		bool glslangInitialized = false;
 	};
 }
 
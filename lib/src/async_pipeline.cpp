@@ -0,0 +1,98 @@
+#include "async_pipeline.hpp"
+#include "vulkan.hpp"
+
+#include <chrono>
+
+namespace Vulkan
+{
+	bool PipelineHandle::isReady() const
+	{
+		return state && state->ready.load(std::memory_order_acquire);
+	}
+
+	bool PipelineHandle::failed() const
+	{
+		return isReady() && state->result.type() != VulkanResultVariants::Success;
+	}
+
+	void PipelineHandle::wait() const
+	{
+		if (!state)
+		{
+			return;
+		}
+
+		std::unique_lock lock(state->mutex);
+		state->condition.wait(lock, [this]()
+		                      { return state->ready.load(std::memory_order_acquire); });
+	}
+
+	VulkanResult PipelineHandle::getResult() const
+	{
+		if (!isReady())
+		{
+			return VulkanResult::BadUsage("Pipeline is still compiling");
+		}
+		return state->result;
+	}
+
+	GraphicsPipeline *PipelineHandle::get() const
+	{
+		if (!state)
+		{
+			return nullptr;
+		}
+
+		if (isReady() && !failed())
+		{
+			return &state->pipeline;
+		}
+		return state->fallback;
+	}
+
+	VulkanResult AsyncPipelineCompiler::createAsyncPipelineCompiler(const AsyncPipelineCompilerConfig &_config)
+	{
+		config = _config;
+		return pool.createThreadPool({.threadCount = config.threadCount});
+	}
+
+	void AsyncPipelineCompiler::shutdown()
+	{
+		pool.shutdown();
+	}
+
+	PipelineHandle AsyncPipelineCompiler::compile(const GraphicsPipelineConfig &pipelineConfig, GraphicsPipeline *fallback)
+	{
+		PipelineHandle handle;
+		handle.state = std::make_shared<PipelineHandle::State>();
+		handle.state->fallback = fallback ? fallback : config.fallback;
+
+		++pending;
+
+		auto queuedAt = std::chrono::steady_clock::now();
+		pool.submit([this, state = handle.state, pipelineConfig, queuedAt]()
+		            {
+			auto result = state->pipeline.createGraphicsPipeline(pipelineConfig);
+
+			{
+				std::lock_guard lock(state->mutex);
+				state->result = result;
+				// release pairs with the acquire in isReady, the render thread sees a fully built pipeline
+				state->ready.store(true, std::memory_order_release);
+			}
+			state->condition.notify_all();
+			--pending;
+
+			auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - queuedAt);
+			if (result.type() != VulkanResultVariants::Success)
+			{
+				std::cerr << "Async pipeline compilation failed after " << elapsed.count() << "ms: " << result.description() << std::endl;
+			}
+			else
+			{
+				std::cout << "Async pipeline ready " << elapsed.count() << "ms after it was requested" << std::endl;
+			} });
+
+		return handle;
+	}
+}
@@ -0,0 +1,74 @@
+#include "command_buffer_cache.hpp"
+#include "vulkan.hpp"
+
+namespace Vulkan
+{
+	VulkanResult CommandBufferCache::createCommandBufferCache(const CommandBufferCacheConfig &_config)
+	{
+		config = _config;
+
+		// the entries go before the pool they were allocated from
+		entries.clear();
+
+		vk::CommandPoolCreateInfo poolInfo{};
+		// entries are re-recorded one at a time, beginning one resets it
+		poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+		poolInfo.setQueueFamilyIndex(config.queue->queueIndex.value());
+		VULKAN_SET_AND_BAIL_RESULT_VALUE(config.device->getDevice().createCommandPoolUnique(poolInfo), pool, "Couldn't create cached command pool");
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<vk::CommandBuffer> CommandBufferCache::get(uint32_t key, uint64_t stamp, const vk::CommandBufferInheritanceInfo &inheritance,
+	                                                       const RecordCachedFunction &recordCommands)
+	{
+		if (key >= entries.size())
+		{
+			entries.resize(key + 1);
+		}
+
+		auto &entry = entries[key];
+		if (entry.commandBuffer && entry.generation == generation && entry.stamp == stamp)
+		{
+			++stats.hits;
+			return entry.commandBuffer.get();
+		}
+
+		if (!entry.commandBuffer)
+		{
+			vk::CommandBufferAllocateInfo allocateInfo{};
+			allocateInfo.setCommandPool(pool.get());
+			allocateInfo.setLevel(vk::CommandBufferLevel::eSecondary);
+			allocateInfo.setCommandBufferCount(1);
+
+			VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(config.device->getDevice().allocateCommandBuffersUnique(allocateInfo), auto allocated, "Couldn't allocate cached command buffer");
+			entry.commandBuffer = std::move(allocated[0]);
+		}
+
+		auto commandBuffer = entry.commandBuffer.get();
+
+		// no eOneTimeSubmit, it's submitted until invalidated
+		vk::CommandBufferBeginInfo beginInfo{};
+		beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue);
+		beginInfo.setPInheritanceInfo(&inheritance);
+		VULKAN_QUICK_BAIL(commandBuffer.begin(beginInfo), "Couldn't begin cached command buffer");
+
+		// left stale on failure, the next get records it again
+		entry.generation = 0;
+		LIB_QUICK_BAIL(recordCommands(commandBuffer));
+
+		VULKAN_QUICK_BAIL(commandBuffer.end(), "Couldn't end cached command buffer");
+
+		entry.stamp = stamp;
+		entry.generation = generation;
+		++stats.recordings;
+
+		return commandBuffer;
+	}
+
+	void CommandBufferCache::invalidate()
+	{
+		++generation;
+		++stats.invalidations;
+	}
+}
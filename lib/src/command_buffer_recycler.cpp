@@ -0,0 +1,76 @@
+#include "command_buffer_recycler.hpp"
+#include "vulkan.hpp"
+
+namespace Vulkan
+{
+	VulkanResult CommandBufferRecycler::createCommandBufferRecycler(const CommandBufferRecyclerConfig &_config)
+	{
+		config = _config;
+
+		if (config.framesInFlight == 0)
+		{
+			return VulkanResult::BadUsage("A command buffer recycler needs at least one frame in flight");
+		}
+
+		vk::CommandPoolCreateInfo poolInfo{};
+		// no eResetCommandBuffer, the buffers are only ever reset with their pool
+		poolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+		poolInfo.setQueueFamilyIndex(config.queue->queueIndex.value());
+
+		// destroying the old pools frees everything they handed out
+		pools = std::vector<FramePool>(config.framesInFlight);
+		for (auto &framePool : pools)
+		{
+			VULKAN_SET_AND_BAIL_RESULT_VALUE(config.device->getDevice().createCommandPoolUnique(poolInfo), framePool.pool, "Couldn't create frame command pool");
+		}
+
+		currentFrame = 0;
+		return VulkanResult::Success();
+	}
+
+	VulkanResult CommandBufferRecycler::beginFrame(uint32_t frameIndex)
+	{
+		currentFrame = frameIndex % config.framesInFlight;
+		auto &framePool = pools[currentFrame];
+
+		if (framePool.primaries.used == 0 && framePool.secondaries.used == 0)
+		{
+			return VulkanResult::Success();
+		}
+
+		VULKAN_QUICK_BAIL(config.device->getDevice().resetCommandPool(framePool.pool.get()), "Couldn't reset frame command pool");
+
+		stats.lastFrame = framePool.stats;
+		framePool.primaries.used = 0;
+		framePool.secondaries.used = 0;
+		framePool.stats = {};
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<vk::CommandBuffer> CommandBufferRecycler::acquire(vk::CommandBufferLevel level)
+	{
+		auto &framePool = pools[currentFrame];
+		auto &freeList = level == vk::CommandBufferLevel::ePrimary ? framePool.primaries : framePool.secondaries;
+
+		if (freeList.used < freeList.commandBuffers.size())
+		{
+			++framePool.stats.reused;
+			++stats.totalReused;
+			return vk::CommandBuffer(freeList.commandBuffers[freeList.used++]);
+		}
+
+		vk::CommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.setCommandPool(framePool.pool.get());
+		allocateInfo.setLevel(level);
+		allocateInfo.setCommandBufferCount(1);
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(config.device->getDevice().allocateCommandBuffers(allocateInfo), auto allocated, "Couldn't allocate frame command buffer");
+		freeList.commandBuffers.push_back(allocated[0]);
+		++freeList.used;
+
+		++framePool.stats.allocated;
+		++stats.totalAllocated;
+		return vk::CommandBuffer(allocated[0]);
+	}
+}
@@ -0,0 +1,168 @@
+#include "compute_pipeline.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace Vulkan
+{
+	VulkanResult ComputePipeline::createComputePipeline(ComputePipelineConfig pipelineConfig)
+	{
+		config = pipelineConfig;
+
+		return createComputePipeline();
+	}
+
+	VulkanResult ComputePipeline::recreateComputePipeline()
+	{
+		return createComputePipeline();
+	}
+
+	VulkanResult ComputePipeline::createComputePipeline()
+	{
+		vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.setSetLayouts(config.descriptorSetLayouts);
+		pipelineLayoutInfo.setPushConstantRanges(config.pushConstants);
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+		    config.device->getDevice().createPipelineLayoutUnique(
+		        pipelineLayoutInfo,
+		        nullptr,
+		        config.device->getDispatcher()),
+		    auto newPipelineLayout,
+		    "Couldn't create compute pipeline layout!");
+
+		// the local size is appended to whatever specialization the stage already has
+		auto stage = config.shaderStage;
+		std::vector<vk::SpecializationMapEntry> specializationEntries;
+		std::vector<uint8_t> specializationData;
+		vk::SpecializationInfo specialization{};
+
+		if (stage.pSpecializationInfo)
+		{
+			auto existing = stage.pSpecializationInfo;
+			specializationEntries.assign(existing->pMapEntries, existing->pMapEntries + existing->mapEntryCount);
+			auto data = static_cast<const uint8_t *>(existing->pData);
+			specializationData.assign(data, data + existing->dataSize);
+		}
+
+		bool specializesLocalSize = false;
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			if (!config.localSizeConstantIds[i].has_value())
+			{
+				continue;
+			}
+
+			auto constantId = config.localSizeConstantIds[i].value();
+			std::erase_if(specializationEntries, [constantId](const auto &entry)
+			              { return entry.constantID == constantId; });
+
+			auto offset = (specializationData.size() + 3) & ~size_t(3);
+			specializationData.resize(offset + sizeof(uint32_t));
+			std::memcpy(specializationData.data() + offset, &config.localSize[i], sizeof(uint32_t));
+			specializationEntries.push_back({constantId, static_cast<uint32_t>(offset), sizeof(uint32_t)});
+			specializesLocalSize = true;
+		}
+
+		if (specializesLocalSize)
+		{
+			specialization.setMapEntries(specializationEntries);
+			specialization.setDataSize(specializationData.size());
+			specialization.setPData(specializationData.data());
+			stage.setPSpecializationInfo(&specialization);
+		}
+
+		vk::ComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.setStage(stage);
+		pipelineInfo.setLayout(newPipelineLayout.get());
+
+		auto start = std::chrono::steady_clock::now();
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+		    config.device->getDevice().createComputePipelineUnique(
+		        config.device->getPipelineCache(),
+		        pipelineInfo,
+		        nullptr,
+		        config.device->getDispatcher()),
+		    auto newPipeline,
+		    "Couldn't create compute pipeline!");
+
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+		std::cout << "Created compute pipeline with a " << config.localSize[0] << "x" << config.localSize[1] << "x" << config.localSize[2]
+		          << " workgroup in " << elapsed.count() << "ms ("
+		          << (config.device->isPipelineCacheWarm() ? "warm" : "cold") << " pipeline cache)" << std::endl;
+
+		pipeline = std::move(newPipeline);
+		pipelineLayout = std::move(newPipelineLayout);
+
+		return VulkanResult::Success();
+	}
+
+	std::array<uint32_t, 3> ComputePipeline::getGroupCount(uint32_t x, uint32_t y, uint32_t z) const
+	{
+		std::array<uint32_t, 3> invocations = {x, y, z};
+		std::array<uint32_t, 3> groups{};
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			auto localSize = std::max(config.localSize[i], 1u);
+			groups[i] = (invocations[i] + localSize - 1) / localSize;
+		}
+		return groups;
+	}
+
+	VulkanResult ComputePipeline::dispatch(vk::CommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z) const
+	{
+		auto groups = getGroupCount(x, y, z);
+		const auto &limits = config.device->getPhysicalDevice().deviceProperties.limits;
+
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			if (groups[i] > limits.maxComputeWorkGroupCount[i])
+			{
+				return VulkanResult::BadUsage("Dispatch needs " + std::to_string(groups[i]) + " workgroups in dimension " + std::to_string(i) +
+				                              ", the device allows " + std::to_string(limits.maxComputeWorkGroupCount[i]));
+			}
+		}
+
+		if (groups[0] == 0 || groups[1] == 0 || groups[2] == 0)
+		{
+			return VulkanResult::Success();
+		}
+
+		commandBuffer.dispatch(groups[0], groups[1], groups[2], config.device->getDispatcher());
+		return VulkanResult::Success();
+	}
+
+	namespace Utils
+	{
+		std::array<uint32_t, 3> computeWorkgroupSize(Device &device, uint32_t dimensions, uint32_t preferredInvocations)
+		{
+			const auto &limits = device.getPhysicalDevice().deviceProperties.limits;
+			dimensions = std::clamp(dimensions, 1u, 3u);
+
+			uint32_t budget = std::max(std::min(preferredInvocations, limits.maxComputeWorkGroupInvocations), 1u);
+
+			// grow the dimensions in turn by powers of two so 2D and 3D workgroups stay close to square
+			std::array<uint32_t, 3> size = {1, 1, 1};
+			uint32_t invocations = 1;
+			bool grew = true;
+			while (grew)
+			{
+				grew = false;
+				for (uint32_t i = 0; i < dimensions; ++i)
+				{
+					if (invocations * 2 <= budget && size[i] * 2 <= limits.maxComputeWorkGroupSize[i])
+					{
+						size[i] *= 2;
+						invocations *= 2;
+						grew = true;
+					}
+				}
+			}
+
+			return size;
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#include "descriptor_layout_cache.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+
+namespace Vulkan
+{
+	VulkanResult DescriptorSetLayoutCache::createDescriptorSetLayoutCache(Device *_device)
+	{
+		device = _device;
+		return VulkanResult::Success();
+	}
+
+	ResultValue<vk::DescriptorSetLayout> DescriptorSetLayoutCache::getLayout(std::vector<vk::DescriptorSetLayoutBinding> bindings)
+	{
+		std::sort(bindings.begin(), bindings.end(), [](const auto &a, const auto &b)
+		          { return a.binding < b.binding; });
+
+		std::string key;
+		for (const auto &binding : bindings)
+		{
+			uint32_t fields[] = {
+			    binding.binding,
+			    static_cast<uint32_t>(binding.descriptorType),
+			    binding.descriptorCount,
+			    static_cast<uint32_t>(binding.stageFlags),
+			};
+			key.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+		}
+
+		std::lock_guard lock(mutex);
+
+		auto existing = layouts.find(key);
+		if (existing != layouts.end())
+		{
+			return vk::DescriptorSetLayout(existing->second.get());
+		}
+
+		vk::DescriptorSetLayoutCreateInfo createInfo{};
+		createInfo.setBindings(bindings);
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+		    device->getDevice().createDescriptorSetLayoutUnique(createInfo, nullptr, device->getDispatcher()),
+		    auto layout,
+		    "Couldn't create descriptor set layout!");
+
+		vk::DescriptorSetLayout returnValue = layout.get();
+		layouts.emplace(std::move(key), std::move(layout));
+
+		return returnValue;
+	}
+
+	size_t DescriptorSetLayoutCache::size()
+	{
+		std::lock_guard lock(mutex);
+		return layouts.size();
+	}
+}
@@ -1,8 +1,11 @@
 #include "device.hpp"
+#include "utils.hpp"
 #include "vulkan.hpp"
 #include "vulkan/vulkan_handles.hpp"
 #include "vulkan/vulkan_structs.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <set>
 
 namespace Vulkan
@@ -128,8 +131,27 @@ namespace Vulkan
 		return recreateDevice();
 	}
 
+	Device::~Device()
+	{
+		if (pipelineCache)
+		{
+			auto result = savePipelineCache();
+			if (result.type() != VulkanResultVariants::Success)
+			{
+				std::cerr << "Couldn't save pipeline cache: " << result.description() << std::endl;
+			}
+		}
+	}
+
 	VulkanResult Device::recreateDevice()
 	{
+		if (pipelineCache)
+		{
+			// the cache belongs to the old device, keep what it learned before it goes away
+			LIB_QUICK_BAIL(savePipelineCache());
+			pipelineCache.reset();
+		}
+
 		physicalDevice = suitableDevices[selectedPhysicalDevice];
 
 		std::unordered_map<uint32_t, std::vector<float>> queuePriorities = {};
@@ -156,10 +178,161 @@ namespace Vulkan
 			queueCreateInfos.push_back(std::move(queueCreateInfo));
 		}
 
+		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+		    physicalDevice.physicalDevice.enumerateDeviceExtensionProperties(nullptr, getDispatcher()),
+		    auto availableExtensions,
+		    "Couldn't enumerate device extensions!");
+
+		auto deviceExtensions = config.deviceExtensions;
+
+		// adds a group of extensions only if the device has every one of them
+		auto enableExtensions = [&](std::initializer_list<const char *> names)
+		{
+			for (auto name : names)
+			{
+				auto available = std::find_if(availableExtensions.begin(), availableExtensions.end(), [name](const auto &extension)
+				                              { return std::strcmp(extension.extensionName, name) == 0; });
+				if (available == availableExtensions.end())
+				{
+					return false;
+				}
+			}
+
+			for (auto name : names)
+			{
+				auto enabled = std::find_if(deviceExtensions.begin(), deviceExtensions.end(), [name](const auto &extension)
+				                            { return std::strcmp(extension, name) == 0; });
+				if (enabled == deviceExtensions.end())
+				{
+					deviceExtensions.push_back(name);
+				}
+			}
+			return true;
+		};
+
+		apiVersion = std::min(physicalDevice.deviceProperties.apiVersion, config.instance->getConfig().vulkanVersion);
+
+		// optional features are chained through pNext, structs stay alive until the device is created
+		void *featureChain = nullptr;
+
+		vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+		dynamicRenderingEnabled = false;
+		if (config.enableDynamicRendering)
+		{
+			dynamicRenderingEnabled = apiVersion >= VK_API_VERSION_1_3 ||
+			                          enableExtensions({VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+			                                            VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+			                                            VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+			                                            VK_KHR_MULTIVIEW_EXTENSION_NAME,
+			                                            VK_KHR_MAINTENANCE_2_EXTENSION_NAME});
+
+			if (dynamicRenderingEnabled)
+			{
+				dynamicRenderingFeatures.setDynamicRendering(true);
+				dynamicRenderingFeatures.setPNext(featureChain);
+				featureChain = &dynamicRenderingFeatures;
+			}
+
+			std::cout << "Dynamic rendering " << (dynamicRenderingEnabled ? "enabled" : "isn't supported, using render passes") << std::endl;
+		}
+
+		vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures{};
+		vk::PhysicalDeviceExtendedDynamicState2FeaturesEXT extendedDynamicState2Features{};
+		vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features{};
+		extendedDynamicState = {};
+		if (config.enableExtendedDynamicState && !getDispatcher().vkGetPhysicalDeviceFeatures2)
+		{
+			std::cout << "Can't query extended dynamic state features without vkGetPhysicalDeviceFeatures2, using static state" << std::endl;
+		}
+		else if (config.enableExtendedDynamicState)
+		{
+			// only structs of extensions the device has can be queried and enabled
+			void *queryChain = nullptr;
+			std::vector<void *> queried;
+			auto chain = [&](auto &features)
+			{
+				features.setPNext(queryChain);
+				queryChain = &features;
+				queried.push_back(&features);
+			};
+
+			if (enableExtensions({VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME}))
+			{
+				chain(extendedDynamicStateFeatures);
+			}
+			if (enableExtensions({VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME}))
+			{
+				chain(extendedDynamicState2Features);
+			}
+			if (enableExtensions({VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME}))
+			{
+				chain(extendedDynamicState3Features);
+			}
+
+			vk::PhysicalDeviceFeatures2 features{};
+			features.setPNext(queryChain);
+			physicalDevice.physicalDevice.getFeatures2(&features, getDispatcher());
+
+			// the base functionality of the first two is core in 1.3 even without the extensions
+			bool core = apiVersion >= VK_API_VERSION_1_3;
+			extendedDynamicState.extendedDynamicState = core || extendedDynamicStateFeatures.extendedDynamicState;
+			extendedDynamicState.extendedDynamicState2 = core || extendedDynamicState2Features.extendedDynamicState2;
+			extendedDynamicState.logicOp = extendedDynamicState2Features.extendedDynamicState2LogicOp;
+
+			extendedDynamicState.polygonMode = extendedDynamicState3Features.extendedDynamicState3PolygonMode;
+			extendedDynamicState.depthClampEnable = extendedDynamicState3Features.extendedDynamicState3DepthClampEnable;
+			extendedDynamicState.logicOpEnable = extendedDynamicState3Features.extendedDynamicState3LogicOpEnable;
+			extendedDynamicState.alphaToCoverageEnable = extendedDynamicState3Features.extendedDynamicState3AlphaToCoverageEnable;
+			extendedDynamicState.colorBlendEnable = extendedDynamicState3Features.extendedDynamicState3ColorBlendEnable;
+			extendedDynamicState.colorBlendEquation = extendedDynamicState3Features.extendedDynamicState3ColorBlendEquation;
+			extendedDynamicState.colorWriteMask = extendedDynamicState3Features.extendedDynamicState3ColorWriteMask;
+
+			// enabling every supported feature of the queried structs costs nothing, they go in as they came back
+			if (queryChain)
+			{
+				auto last = static_cast<vk::BaseOutStructure *>(queried.front());
+				last->pNext = static_cast<vk::BaseOutStructure *>(featureChain);
+				featureChain = queryChain;
+			}
+
+			std::cout << "Extended dynamic state " << (extendedDynamicState.extendedDynamicState ? "1 supported" : "1 unsupported")
+			          << ", " << (extendedDynamicState.extendedDynamicState2 ? "2 supported" : "2 unsupported")
+			          << ", " << (extendedDynamicState.colorBlendEnable ? "3 supported" : "3 unsupported") << std::endl;
+		}
+
+		memoryBudgetEnabled = false;
+		if (config.enableMemoryBudget)
+		{
+			memoryBudgetEnabled = getDispatcher().vkGetPhysicalDeviceMemoryProperties2 && enableExtensions({VK_EXT_MEMORY_BUDGET_EXTENSION_NAME});
+			std::cout << "Memory budget " << (memoryBudgetEnabled ? "enabled" : "isn't supported, the allocator estimates it") << std::endl;
+		}
+
+		vk::PhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures{};
+		timelineSemaphoreEnabled = false;
+		if (config.enableTimelineSemaphores && getDispatcher().vkGetPhysicalDeviceFeatures2 &&
+		    (apiVersion >= VK_API_VERSION_1_2 || enableExtensions({VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME})))
+		{
+			vk::PhysicalDeviceFeatures2 features{};
+			features.setPNext(&timelineSemaphoreFeatures);
+			physicalDevice.physicalDevice.getFeatures2(&features, getDispatcher());
+
+			timelineSemaphoreEnabled = timelineSemaphoreFeatures.timelineSemaphore;
+			if (timelineSemaphoreEnabled)
+			{
+				timelineSemaphoreFeatures.setPNext(featureChain);
+				featureChain = &timelineSemaphoreFeatures;
+			}
+		}
+		if (config.enableTimelineSemaphores)
+		{
+			std::cout << "Timeline semaphores " << (timelineSemaphoreEnabled ? "enabled" : "aren't supported, frames are paced with fences") << std::endl;
+		}
+
 		vk::DeviceCreateInfo deviceCreateInfo{};
 		deviceCreateInfo.setFlags(vk::DeviceCreateFlags{});
 		deviceCreateInfo.setQueueCreateInfos(queueCreateInfos);
-		deviceCreateInfo.setPEnabledExtensionNames(config.deviceExtensions);
+		deviceCreateInfo.setPEnabledExtensionNames(deviceExtensions);
+		deviceCreateInfo.setPNext(featureChain);
 		if (config.instance->getConfig().enableLayers)
 		{
 			deviceCreateInfo.setPEnabledLayerNames(config.instance->getConfig().requiredLayers);
@@ -197,9 +370,115 @@ namespace Vulkan
 
 		getDispatcher().init(device.get());
 
+		return createPipelineCache();
+	}
+
+	VulkanResult Device::createPipelineCache()
+	{
+		std::vector<char> initialData;
+		pipelineCacheWarm = false;
+
+		if (!config.pipelineCachePath.empty())
+		{
+			auto data = Utils::readBinaryFile(config.pipelineCachePath);
+			const auto &properties = physicalDevice.deviceProperties;
+
+			vk::PipelineCacheHeaderVersionOne header{};
+			if (!data.has_value())
+			{
+				std::cout << "No pipeline cache at " << config.pipelineCachePath.string() << ", starting cold" << std::endl;
+			}
+			else if (data->size() < sizeof(header))
+			{
+				std::cout << "Pipeline cache " << config.pipelineCachePath.string() << " is truncated, starting cold" << std::endl;
+			}
+			else
+			{
+				std::memcpy(&header, data->data(), sizeof(header));
+
+				// drivers are supposed to reject foreign data themselves, not all of them do it gracefully
+				if (header.headerSize < sizeof(header) ||
+				    header.headerVersion != vk::PipelineCacheHeaderVersion::eOne ||
+				    header.vendorID != properties.vendorID ||
+				    header.deviceID != properties.deviceID ||
+				    std::memcmp(header.pipelineCacheUUID.data(), properties.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0)
+				{
+					std::cout << "Pipeline cache " << config.pipelineCachePath.string() << " was written by another device or driver, starting cold" << std::endl;
+				}
+				else
+				{
+					initialData = std::move(data.value());
+				}
+			}
+		}
+
+		vk::PipelineCacheCreateInfo createInfo{};
+		createInfo.setInitialDataSize(initialData.size());
+		createInfo.setPInitialData(initialData.empty() ? nullptr : initialData.data());
+
+		auto result = device->createPipelineCacheUnique(createInfo, nullptr, getDispatcher());
+		if (result.result != vk::Result::eSuccess && !initialData.empty())
+		{
+			std::cout << "Driver rejected the pipeline cache, starting cold" << std::endl;
+			createInfo.setInitialDataSize(0);
+			createInfo.setPInitialData(nullptr);
+			initialData.clear();
+			result = device->createPipelineCacheUnique(createInfo, nullptr, getDispatcher());
+		}
+
+		VULKAN_QUICK_BAIL(result.result, "Couldn't create pipeline cache!");
+
+		result.value.swap(pipelineCache);
+		pipelineCacheWarm = !initialData.empty();
+		pipelineCacheSavedSize = initialData.size();
+		pipelineCacheSavedAt = std::chrono::steady_clock::now();
+
+		if (pipelineCacheWarm)
+		{
+			std::cout << "Loaded " << initialData.size() << " bytes of pipeline cache" << std::endl;
+		}
+
 		return VulkanResult::Success();
 	}
 
+	VulkanResult Device::savePipelineCache()
+	{
+		if (!pipelineCache || config.pipelineCachePath.empty())
+		{
+			return VulkanResult::Success();
+		}
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+		    device->getPipelineCacheData(pipelineCache.get(), getDispatcher()),
+		    auto data,
+		    "Couldn't get pipeline cache data!");
+
+		pipelineCacheSavedAt = std::chrono::steady_clock::now();
+
+		if (data.size() == pipelineCacheSavedSize)
+		{
+			// nothing new was compiled since the last save
+			return VulkanResult::Success();
+		}
+
+		LIB_QUICK_BAIL(Utils::writeFileAtomic(config.pipelineCachePath, data.data(), data.size()));
+		pipelineCacheSavedSize = data.size();
+
+		std::cout << "Saved " << data.size() << " bytes of pipeline cache to " << config.pipelineCachePath.string() << std::endl;
+
+		return VulkanResult::Success();
+	}
+
+	VulkanResult Device::savePipelineCacheIfDue()
+	{
+		if (std::chrono::steady_clock::now() - pipelineCacheSavedAt < config.pipelineCacheSaveInterval)
+		{
+			return VulkanResult::Success();
+		}
+
+		return savePipelineCache();
+	}
+
 	ResultValue<bool> Device::checkDeviceExtension(vk::PhysicalDevice physicalDevice)
 	{
 		std::set<vk::ExtensionProperties> extensions;
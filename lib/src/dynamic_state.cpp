@@ -0,0 +1,209 @@
+#include "dynamic_state.hpp"
+#include "vulkan.hpp"
+
+namespace Vulkan
+{
+	namespace Utils
+	{
+		void enableExtendedDynamicState(GraphicsPipelineConfig &config)
+		{
+			const auto &support = config.device->getExtendedDynamicState();
+
+			std::vector<vk::DynamicState> states;
+			if (support.extendedDynamicState)
+			{
+				states.insert(states.end(), {
+				                                vk::DynamicState::eCullMode,
+				                                vk::DynamicState::eFrontFace,
+				                                vk::DynamicState::ePrimitiveTopology,
+				                                vk::DynamicState::eDepthTestEnable,
+				                                vk::DynamicState::eDepthWriteEnable,
+				                                vk::DynamicState::eDepthCompareOp,
+				                                vk::DynamicState::eDepthBoundsTestEnable,
+				                                vk::DynamicState::eStencilTestEnable,
+				                                vk::DynamicState::eStencilOp,
+				                            });
+			}
+			if (support.extendedDynamicState2)
+			{
+				states.insert(states.end(), {
+				                                vk::DynamicState::eRasterizerDiscardEnable,
+				                                vk::DynamicState::eDepthBiasEnable,
+				                                vk::DynamicState::ePrimitiveRestartEnable,
+				                            });
+			}
+			if (support.logicOp)
+			{
+				states.push_back(vk::DynamicState::eLogicOpEXT);
+			}
+			if (support.polygonMode)
+			{
+				states.push_back(vk::DynamicState::ePolygonModeEXT);
+			}
+			if (support.depthClampEnable)
+			{
+				states.push_back(vk::DynamicState::eDepthClampEnableEXT);
+			}
+			if (support.logicOpEnable)
+			{
+				states.push_back(vk::DynamicState::eLogicOpEnableEXT);
+			}
+			if (support.alphaToCoverageEnable)
+			{
+				states.push_back(vk::DynamicState::eAlphaToCoverageEnableEXT);
+			}
+			if (support.colorBlendEnable)
+			{
+				states.push_back(vk::DynamicState::eColorBlendEnableEXT);
+			}
+			if (support.colorBlendEquation)
+			{
+				states.push_back(vk::DynamicState::eColorBlendEquationEXT);
+			}
+			if (support.colorWriteMask)
+			{
+				states.push_back(vk::DynamicState::eColorWriteMaskEXT);
+			}
+
+			for (auto state : states)
+			{
+				if (!config.hasDynamicState(state))
+				{
+					config.dynamicStates.push_back(state);
+				}
+			}
+		}
+
+		void recordDynamicState(vk::CommandBuffer commandBuffer, const GraphicsPipelineConfig &config)
+		{
+			auto &dispatcher = config.device->getDispatcher();
+			const auto &rasterization = config.razterizationInfo;
+			const auto &depthStencil = config.depthStencilInfo;
+			const auto &attachments = config.colorBlendConfig.attachments;
+
+			for (auto state : config.dynamicStates)
+			{
+				switch (state)
+				{
+				case vk::DynamicState::eLineWidth:
+					commandBuffer.setLineWidth(rasterization.lineWidth, dispatcher);
+					break;
+				case vk::DynamicState::eDepthBias:
+					commandBuffer.setDepthBias(rasterization.depthBiasConstantFactor, rasterization.depthBiasClamp, rasterization.depthBiasSlopeFactor, dispatcher);
+					break;
+				case vk::DynamicState::eBlendConstants:
+					commandBuffer.setBlendConstants(config.colorBlendConfig.constants.data(), dispatcher);
+					break;
+				case vk::DynamicState::eDepthBounds:
+					commandBuffer.setDepthBounds(depthStencil.minDepthBounds, depthStencil.maxDepthBounds, dispatcher);
+					break;
+				case vk::DynamicState::eStencilCompareMask:
+					commandBuffer.setStencilCompareMask(vk::StencilFaceFlagBits::eFront, depthStencil.front.compareMask, dispatcher);
+					commandBuffer.setStencilCompareMask(vk::StencilFaceFlagBits::eBack, depthStencil.back.compareMask, dispatcher);
+					break;
+				case vk::DynamicState::eStencilWriteMask:
+					commandBuffer.setStencilWriteMask(vk::StencilFaceFlagBits::eFront, depthStencil.front.writeMask, dispatcher);
+					commandBuffer.setStencilWriteMask(vk::StencilFaceFlagBits::eBack, depthStencil.back.writeMask, dispatcher);
+					break;
+				case vk::DynamicState::eStencilReference:
+					commandBuffer.setStencilReference(vk::StencilFaceFlagBits::eFront, depthStencil.front.reference, dispatcher);
+					commandBuffer.setStencilReference(vk::StencilFaceFlagBits::eBack, depthStencil.back.reference, dispatcher);
+					break;
+
+				// extended dynamic state, the dispatcher falls back to the EXT entry points before 1.3
+				case vk::DynamicState::eCullMode:
+					commandBuffer.setCullMode(rasterization.cullMode, dispatcher);
+					break;
+				case vk::DynamicState::eFrontFace:
+					commandBuffer.setFrontFace(rasterization.frontFace, dispatcher);
+					break;
+				case vk::DynamicState::ePrimitiveTopology:
+					commandBuffer.setPrimitiveTopology(config.topology, dispatcher);
+					break;
+				case vk::DynamicState::eDepthTestEnable:
+					commandBuffer.setDepthTestEnable(depthStencil.depthTestEnable, dispatcher);
+					break;
+				case vk::DynamicState::eDepthWriteEnable:
+					commandBuffer.setDepthWriteEnable(depthStencil.depthWriteEnable, dispatcher);
+					break;
+				case vk::DynamicState::eDepthCompareOp:
+					commandBuffer.setDepthCompareOp(depthStencil.depthCompareOp, dispatcher);
+					break;
+				case vk::DynamicState::eDepthBoundsTestEnable:
+					commandBuffer.setDepthBoundsTestEnable(depthStencil.depthBoundsTestEnable, dispatcher);
+					break;
+				case vk::DynamicState::eStencilTestEnable:
+					commandBuffer.setStencilTestEnable(depthStencil.stencilTestEnable, dispatcher);
+					break;
+				case vk::DynamicState::eStencilOp:
+					commandBuffer.setStencilOp(vk::StencilFaceFlagBits::eFront, depthStencil.front.failOp, depthStencil.front.passOp,
+					                           depthStencil.front.depthFailOp, depthStencil.front.compareOp, dispatcher);
+					commandBuffer.setStencilOp(vk::StencilFaceFlagBits::eBack, depthStencil.back.failOp, depthStencil.back.passOp,
+					                           depthStencil.back.depthFailOp, depthStencil.back.compareOp, dispatcher);
+					break;
+
+				// extended dynamic state 2
+				case vk::DynamicState::eRasterizerDiscardEnable:
+					commandBuffer.setRasterizerDiscardEnable(rasterization.rasterizerDiscardEnable, dispatcher);
+					break;
+				case vk::DynamicState::eDepthBiasEnable:
+					commandBuffer.setDepthBiasEnable(rasterization.depthBiasEnable, dispatcher);
+					break;
+				case vk::DynamicState::ePrimitiveRestartEnable:
+					commandBuffer.setPrimitiveRestartEnable(config.primitiveRestart, dispatcher);
+					break;
+				case vk::DynamicState::eLogicOpEXT:
+					commandBuffer.setLogicOpEXT(config.colorBlendConfig.logicOp, dispatcher);
+					break;
+
+				// extended dynamic state 3
+				case vk::DynamicState::ePolygonModeEXT:
+					commandBuffer.setPolygonModeEXT(rasterization.polygonMode, dispatcher);
+					break;
+				case vk::DynamicState::eDepthClampEnableEXT:
+					commandBuffer.setDepthClampEnableEXT(rasterization.depthClampEnable, dispatcher);
+					break;
+				case vk::DynamicState::eLogicOpEnableEXT:
+					commandBuffer.setLogicOpEnableEXT(config.colorBlendConfig.enableLogicOp, dispatcher);
+					break;
+				case vk::DynamicState::eAlphaToCoverageEnableEXT:
+					commandBuffer.setAlphaToCoverageEnableEXT(config.multiSampling.alphaToCoverageEnable, dispatcher);
+					break;
+				case vk::DynamicState::eColorBlendEnableEXT:
+				{
+					std::vector<vk::Bool32> enables;
+					for (const auto &attachment : attachments)
+					{
+						enables.push_back(attachment.blendEnable);
+					}
+					commandBuffer.setColorBlendEnableEXT(0, enables, dispatcher);
+					break;
+				}
+				case vk::DynamicState::eColorBlendEquationEXT:
+				{
+					std::vector<vk::ColorBlendEquationEXT> equations;
+					for (const auto &attachment : attachments)
+					{
+						equations.push_back({attachment.srcColorBlendFactor, attachment.dstColorBlendFactor, attachment.colorBlendOp,
+						                     attachment.srcAlphaBlendFactor, attachment.dstAlphaBlendFactor, attachment.alphaBlendOp});
+					}
+					commandBuffer.setColorBlendEquationEXT(0, equations, dispatcher);
+					break;
+				}
+				case vk::DynamicState::eColorWriteMaskEXT:
+				{
+					std::vector<vk::ColorComponentFlags> masks;
+					for (const auto &attachment : attachments)
+					{
+						masks.push_back(attachment.colorWriteMask);
+					}
+					commandBuffer.setColorWriteMaskEXT(0, masks, dispatcher);
+					break;
+				}
+				default:
+					break;
+				}
+			}
+		}
+	}
+}
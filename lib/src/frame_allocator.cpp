@@ -0,0 +1,80 @@
+#include "frame_allocator.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+
+namespace Vulkan
+{
+	VulkanResult FrameAllocator::createFrameAllocator(const FrameAllocatorConfig &_config)
+	{
+		config = _config;
+
+		if (config.framesInFlight == 0)
+		{
+			return VulkanResult::BadUsage("A frame allocator needs at least one frame in flight");
+		}
+
+		const auto &limits = config.device->getPhysicalDevice().deviceProperties.limits;
+		defaultAlignment = std::max({limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment, vk::DeviceSize(4)});
+
+		// every region starts aligned, offsets inside it only have to be aligned relative to its start
+		config.frameSize = (config.frameSize + defaultAlignment - 1) / defaultAlignment * defaultAlignment;
+
+		// a previous buffer goes through the deferred queue, frames in flight may still read from it
+		LIB_SET_AND_BAIL_RESULT_VALUE(config.allocator->createUniqueBuffer(
+		                                  config.frameSize * config.framesInFlight, config.usage,
+		                                  VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		                                  vk::MemoryPropertyFlagBits::eHostVisible,
+		                                  VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, config.category),
+		                              buffer);
+
+		std::cout << "Created frame allocator with " << config.framesInFlight << " regions of " << config.frameSize << " bytes"
+		          << (buffer->needsFlush ? " (non-coherent)" : "") << std::endl;
+
+		beginFrame(0);
+
+		return VulkanResult::Success();
+	}
+
+	void FrameAllocator::beginFrame(uint32_t frameIndex)
+	{
+		regionStart = (frameIndex % config.framesInFlight) * config.frameSize;
+		regionEnd = regionStart + config.frameSize;
+		head = regionStart;
+	}
+
+	ResultValue<FrameAllocation> FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+	{
+		if (alignment == 0)
+		{
+			alignment = defaultAlignment;
+		}
+
+		auto offset = (head + alignment - 1) / alignment * alignment;
+		if (offset + size > regionEnd)
+		{
+			return VulkanResult::BadUsage("Frame allocator ran out of space, " + std::to_string(size) + " bytes requested with " +
+			                              std::to_string(regionEnd - head) + " left of " + std::to_string(config.frameSize));
+		}
+
+		head = offset + size;
+		highWaterMark = std::max(highWaterMark, head - regionStart);
+
+		FrameAllocation allocation{};
+		allocation.data = static_cast<char *>(buffer->mapped) + offset;
+		allocation.buffer = buffer->buffer;
+		allocation.offset = static_cast<uint32_t>(offset);
+		allocation.size = size;
+		return allocation;
+	}
+
+	VulkanResult FrameAllocator::flush()
+	{
+		if (head == regionStart)
+		{
+			return VulkanResult::Success();
+		}
+
+		return config.allocator->flush(buffer.get(), regionStart, head - regionStart);
+	}
+}
@@ -0,0 +1,276 @@
+#include "frame_manager.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+
+namespace Vulkan
+{
+	FrameManager::~FrameManager()
+	{
+		if (!frames.empty())
+		{
+			auto _ = waitIdle();
+			_ = waitForPresentation();
+		}
+	}
+
+	VulkanResult FrameManager::createFrameManager(const FrameManagerConfig &_config)
+	{
+		config = _config;
+
+		if (config.framesInFlight == 0)
+		{
+			return VulkanResult::BadUsage("A frame manager needs at least one frame in flight");
+		}
+
+		return createFrames();
+	}
+
+	VulkanResult FrameManager::createFrames()
+	{
+		auto &device = config.device->getDevice();
+
+		// only called with every frame done
+		imagesInFlight.clear();
+		frames.clear();
+		frames.resize(config.framesInFlight);
+
+		// the old pools and every command buffer they handed out go away here
+		LIB_QUICK_BAIL(commandBuffers.createCommandBufferRecycler({
+		    .device = config.device,
+		    .queue = config.graphicsQueue,
+		    .framesInFlight = config.framesInFlight,
+		}));
+
+		for (auto &frame : frames)
+		{
+			VULKAN_SET_AND_BAIL_RESULT_VALUE(device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}), frame.imageAvailableSemaphore, "Couldn't create imageAvailableSemaphore");
+			VULKAN_SET_AND_BAIL_RESULT_VALUE(device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}), frame.renderFinishedSemaphore, "Couldn't create renderFinishedSemaphore");
+			if (!config.scheduler)
+			{
+				// signaled so the first wait on every frame returns right away
+				VULKAN_SET_AND_BAIL_RESULT_VALUE(device.createFenceUnique(vk::FenceCreateInfo{vk::FenceCreateFlagBits::eSignaled}), frame.inFlightFence, "Couldn't create inFlightFence");
+			}
+		}
+
+		// anything queued for destruction now has to wait for the new number of frames
+		config.allocator->getConfig().framesInFlight = config.framesInFlight;
+
+		LIB_QUICK_BAIL(frameAllocator.createFrameAllocator({
+		    .device = config.device,
+		    .allocator = config.allocator,
+		    .framesInFlight = config.framesInFlight,
+		    .frameSize = config.uniformFrameSize,
+		}));
+
+		LIB_QUICK_BAIL(createDescriptorSets());
+
+		currentFrame = static_cast<uint32_t>(frameNumber % config.framesInFlight);
+		frameAllocator.beginFrame(currentFrame);
+
+		std::cout << "Created " << config.framesInFlight << " frames in flight" << std::endl;
+		return VulkanResult::Success();
+	}
+
+	VulkanResult FrameManager::createDescriptorSets()
+	{
+		if (!config.descriptorSetLayout)
+		{
+			return VulkanResult::Success();
+		}
+
+		auto &device = config.device->getDevice();
+
+		// the sets of the previous frames go with their pool
+		descriptorPool.reset();
+
+		vk::DescriptorPoolSize poolSize{vk::DescriptorType::eUniformBufferDynamic, config.framesInFlight};
+		vk::DescriptorPoolCreateInfo poolInfo{};
+		poolInfo.setPoolSizes(poolSize);
+		poolInfo.setMaxSets(config.framesInFlight);
+		VULKAN_SET_AND_BAIL_RESULT_VALUE(device.createDescriptorPoolUnique(poolInfo), descriptorPool, "Couldn't create frame descriptor pool");
+
+		std::vector<vk::DescriptorSetLayout> layouts(config.framesInFlight, config.descriptorSetLayout);
+		vk::DescriptorSetAllocateInfo allocateInfo{};
+		allocateInfo.setDescriptorPool(descriptorPool.get());
+		allocateInfo.setSetLayouts(layouts);
+
+		std::vector<vk::DescriptorSet> descriptorSets;
+		VULKAN_SET_AND_BAIL_RESULT_VALUE(device.allocateDescriptorSets(allocateInfo), descriptorSets, "Couldn't allocate frame descriptor sets");
+
+		vk::DescriptorBufferInfo bufferInfo{frameAllocator.getBuffer(), 0, config.uniformRange};
+		std::vector<vk::WriteDescriptorSet> writes;
+		for (uint32_t i = 0; i < config.framesInFlight; ++i)
+		{
+			frames[i].descriptorSet = descriptorSets[i];
+
+			vk::WriteDescriptorSet write{};
+			write.setDstSet(descriptorSets[i]);
+			write.setDstBinding(config.uniformBinding);
+			write.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic);
+			write.setBufferInfo(bufferInfo);
+			writes.push_back(write);
+		}
+		device.updateDescriptorSets(writes, {});
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<FrameData *> FrameManager::beginFrame()
+	{
+		auto &frame = frames[currentFrame];
+
+		auto start = std::chrono::steady_clock::now();
+		if (!config.scheduler)
+		{
+			VULKAN_QUICK_BAIL(config.device->getDevice().waitForFences(frame.inFlightFence.get(), true, UINT64_MAX), "Couldn't wait for inflight fence");
+		}
+		else if (frameNumber >= config.framesInFlight)
+		{
+			LIB_QUICK_BAIL(config.scheduler->waitForFrame(frameNumber - config.framesInFlight));
+		}
+		std::chrono::duration<double, std::milli> wait = std::chrono::steady_clock::now() - start;
+
+		++stats.frames;
+		stats.lastFenceWait = wait;
+		stats.totalFenceWait += wait;
+		stats.worstFenceWait = std::max(stats.worstFenceWait, wait);
+
+		// the wait covers everything this frame's region was used for last time around
+		frameAllocator.beginFrame(currentFrame);
+		// and everything recorded into the frame's pool, one reset for all of it
+		LIB_QUICK_BAIL(commandBuffers.beginFrame(currentFrame));
+		LIB_SET_AND_BAIL_RESULT_VALUE(commandBuffers.acquire(), frame.commandBuffer);
+
+		return &frame;
+	}
+
+	VulkanResult FrameManager::claimImage(uint32_t imageIndex)
+	{
+		if (imageIndex >= imagesInFlight.size())
+		{
+			imagesInFlight.resize(imageIndex + 1);
+		}
+
+		// with more frames in flight than swapchain images, or an image returned out of order
+		auto &previous = imagesInFlight[imageIndex];
+		if (previous && *previous != frameNumber)
+		{
+			auto start = std::chrono::steady_clock::now();
+			LIB_QUICK_BAIL(waitForFrame(*previous));
+			stats.totalImageWait += std::chrono::steady_clock::now() - start;
+		}
+		previous = frameNumber;
+
+		if (!config.scheduler)
+		{
+			VULKAN_QUICK_BAIL(config.device->getDevice().resetFences(frames[currentFrame].inFlightFence.get()), "Couldn't reset inflightfence!");
+		}
+		return VulkanResult::Success();
+	}
+
+	VulkanResult FrameManager::submit(const TimelineSubmitInfo &info)
+	{
+		if (config.scheduler)
+		{
+			LIB_QUICK_BAIL(config.scheduler->submit(TimelineQueue::Graphics, info).result);
+			return VulkanResult::Success();
+		}
+
+		if (!info.timelineWaits.empty())
+		{
+			return VulkanResult::BadUsage("Timeline waits need the frame manager to be created with a scheduler");
+		}
+
+		vk::SubmitInfo submitInfo{};
+		submitInfo.setWaitSemaphores(info.waitSemaphores);
+		submitInfo.setWaitDstStageMask(info.waitStages);
+		submitInfo.setCommandBuffers(info.commandBuffers);
+		submitInfo.setSignalSemaphores(info.signalSemaphores);
+
+		VULKAN_QUICK_BAIL(config.graphicsQueue->queue.submit(submitInfo, frames[currentFrame].inFlightFence.get()), "Couldn't submit to graphics queue");
+		return VulkanResult::Success();
+	}
+
+	void FrameManager::endFrame()
+	{
+		if (config.scheduler)
+		{
+			config.scheduler->endFrame();
+		}
+
+		++frameNumber;
+		currentFrame = static_cast<uint32_t>(frameNumber % config.framesInFlight);
+	}
+
+	VulkanResult FrameManager::waitForFrame(uint64_t frame)
+	{
+		if (config.scheduler)
+		{
+			return config.scheduler->waitForFrame(frame);
+		}
+
+		// its slot was reused since, beginFrame of the frame reusing it waited for it
+		if (frame + config.framesInFlight <= frameNumber)
+		{
+			return VulkanResult::Success();
+		}
+
+		auto fence = frames[frame % config.framesInFlight].inFlightFence.get();
+		VULKAN_QUICK_BAIL(config.device->getDevice().waitForFences(fence, true, UINT64_MAX), "Couldn't wait for inflight fence");
+		return VulkanResult::Success();
+	}
+
+	VulkanResult FrameManager::setFramesInFlight(uint32_t framesInFlight)
+	{
+		if (framesInFlight == 0)
+		{
+			return VulkanResult::BadUsage("A frame manager needs at least one frame in flight");
+		}
+		if (framesInFlight == config.framesInFlight)
+		{
+			return VulkanResult::Success();
+		}
+
+		LIB_QUICK_BAIL(waitIdle());
+		// createFrames destroys the semaphores presents may still be waiting on
+		LIB_QUICK_BAIL(waitForPresentation());
+
+		config.framesInFlight = framesInFlight;
+		return createFrames();
+	}
+
+	VulkanResult FrameManager::waitForPresentation()
+	{
+		if (config.presentQueue)
+		{
+			VULKAN_QUICK_BAIL(config.presentQueue->queue.waitIdle(), "Couldn't wait for the present queue");
+			return VulkanResult::Success();
+		}
+
+		VULKAN_QUICK_BAIL(config.device->getDevice().waitIdle(), "Couldn't wait for the device");
+		return VulkanResult::Success();
+	}
+
+	VulkanResult FrameManager::waitIdle()
+	{
+		if (config.scheduler)
+		{
+			return config.scheduler->waitIdle();
+		}
+
+		std::vector<vk::Fence> fences;
+		for (auto &frame : frames)
+		{
+			fences.push_back(frame.inFlightFence.get());
+		}
+
+		if (fences.empty())
+		{
+			return VulkanResult::Success();
+		}
+
+		VULKAN_QUICK_BAIL(config.device->getDevice().waitForFences(fences, true, UINT64_MAX), "Couldn't wait for frames in flight");
+		return VulkanResult::Success();
+	}
+}
@@ -0,0 +1,252 @@
+#include "frame_scheduler.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace Vulkan
+{
+	// completions nobody takes are dropped past this, oldest first
+	static constexpr size_t MAX_COMPLETED_FRAMES = 1024;
+
+	FrameScheduler::~FrameScheduler()
+	{
+		if (config.device)
+		{
+			auto _ = waitIdle();
+		}
+	}
+
+	VulkanResult FrameScheduler::createFrameScheduler(const FrameSchedulerConfig &_config)
+	{
+		config = _config;
+
+		if (!config.device->isTimelineSemaphoreEnabled())
+		{
+			return VulkanResult::BadUsage("The frame scheduler needs a device created with timeline semaphores enabled");
+		}
+
+		std::array<QueueInformation *, static_cast<size_t>(TimelineQueue::Count)> queues = {config.graphicsQueue, config.computeQueue, config.transferQueue};
+		for (size_t i = 0; i < timelines.size(); ++i)
+		{
+			auto &timeline = timelines[i];
+			timeline.queue = queues[i];
+			timeline.submitted = 0;
+			if (!timeline.queue)
+			{
+				continue;
+			}
+
+			vk::SemaphoreTypeCreateInfo typeInfo{vk::SemaphoreType::eTimeline, 0};
+			vk::SemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.setPNext(&typeInfo);
+			VULKAN_SET_AND_BAIL_RESULT_VALUE(config.device->getDevice().createSemaphoreUnique(semaphoreInfo), timeline.semaphore, "Couldn't create timeline semaphore");
+		}
+
+		frameNumber = 0;
+		pending.clear();
+		completed.clear();
+		stats = {};
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<uint64_t> FrameScheduler::submit(TimelineQueue queue, const TimelineSubmitInfo &info)
+	{
+		auto &timeline = timelines[static_cast<size_t>(queue)];
+		if (!timeline.queue)
+		{
+			return VulkanResult::BadUsage("The frame scheduler wasn't given a queue for this timeline");
+		}
+
+		// binary semaphores come first, their values are ignored
+		std::vector<vk::Semaphore> waitSemaphores = info.waitSemaphores;
+		std::vector<vk::PipelineStageFlags> waitStages = info.waitStages;
+		std::vector<uint64_t> waitValues(waitSemaphores.size(), 0);
+		for (const auto &wait : info.timelineWaits)
+		{
+			auto &waitTimeline = timelines[static_cast<size_t>(wait.queue)];
+			if (!waitTimeline.queue || wait.value == 0)
+			{
+				continue;
+			}
+			waitSemaphores.push_back(waitTimeline.semaphore.get());
+			waitStages.push_back(wait.stage);
+			waitValues.push_back(wait.value);
+		}
+
+		std::vector<vk::Semaphore> signalSemaphores = info.signalSemaphores;
+		std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+		signalSemaphores.push_back(timeline.semaphore.get());
+		signalValues.push_back(timeline.submitted + 1);
+
+		vk::TimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.setWaitSemaphoreValues(waitValues);
+		timelineInfo.setSignalSemaphoreValues(signalValues);
+
+		vk::SubmitInfo submitInfo{};
+		submitInfo.setPNext(&timelineInfo);
+		submitInfo.setWaitSemaphores(waitSemaphores);
+		submitInfo.setWaitDstStageMask(waitStages);
+		submitInfo.setCommandBuffers(info.commandBuffers);
+		submitInfo.setSignalSemaphores(signalSemaphores);
+
+		VULKAN_QUICK_BAIL(timeline.queue->queue.submit(submitInfo), "Couldn't submit to timeline queue");
+
+		++stats.submissions;
+		++timeline.submitted;
+		return uint64_t(timeline.submitted);
+	}
+
+	VulkanResult FrameScheduler::wait(TimelineQueue queue, uint64_t value)
+	{
+		auto &timeline = timelines[static_cast<size_t>(queue)];
+		if (!timeline.queue || value == 0)
+		{
+			return VulkanResult::Success();
+		}
+
+		auto semaphore = timeline.semaphore.get();
+		vk::SemaphoreWaitInfo waitInfo{};
+		waitInfo.setSemaphores(semaphore);
+		waitInfo.setValues(value);
+
+		auto start = std::chrono::steady_clock::now();
+		VULKAN_QUICK_BAIL(config.device->getDevice().waitSemaphores(waitInfo, UINT64_MAX), "Couldn't wait for timeline semaphore");
+		stats.totalWait += std::chrono::steady_clock::now() - start;
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<uint64_t> FrameScheduler::getCompletedValue(TimelineQueue queue)
+	{
+		auto &timeline = timelines[static_cast<size_t>(queue)];
+		if (!timeline.queue)
+		{
+			return uint64_t(0);
+		}
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(config.device->getDevice().getSemaphoreCounterValue(timeline.semaphore.get()), auto value, "Couldn't read timeline semaphore");
+		return value;
+	}
+
+	void FrameScheduler::endFrame()
+	{
+		PendingFrame frame{};
+		frame.frameNumber = frameNumber++;
+		for (size_t i = 0; i < timelines.size(); ++i)
+		{
+			frame.values[i] = timelines[i].submitted;
+		}
+		frame.submittedAt = std::chrono::steady_clock::now();
+		pending.push_back(frame);
+
+		// a cheap query per queue, keeps completion times close for frames nobody waits on
+		auto _ = poll();
+	}
+
+	VulkanResult FrameScheduler::waitForFrame(uint64_t waitedFrame)
+	{
+		// nothing to wait on yet, returning would claim a frame that is still being recorded is done
+		if (waitedFrame >= frameNumber)
+		{
+			return VulkanResult::BadUsage("Waiting for frame " + std::to_string(waitedFrame) + " which wasn't ended yet, the last ended frame is " +
+			                              (frameNumber ? std::to_string(frameNumber - 1) : std::string("none")));
+		}
+
+		auto frame = std::find_if(pending.begin(), pending.end(), [waitedFrame](const auto &pendingFrame)
+		                          { return pendingFrame.frameNumber == waitedFrame; });
+		if (frame == pending.end())
+		{
+			// done already
+			return VulkanResult::Success();
+		}
+
+		std::vector<vk::Semaphore> semaphores;
+		std::vector<uint64_t> values;
+		for (size_t i = 0; i < timelines.size(); ++i)
+		{
+			if (timelines[i].queue && frame->values[i] > 0)
+			{
+				semaphores.push_back(timelines[i].semaphore.get());
+				values.push_back(frame->values[i]);
+			}
+		}
+
+		if (!semaphores.empty())
+		{
+			vk::SemaphoreWaitInfo waitInfo{};
+			waitInfo.setSemaphores(semaphores);
+			waitInfo.setValues(values);
+
+			auto start = std::chrono::steady_clock::now();
+			VULKAN_QUICK_BAIL(config.device->getDevice().waitSemaphores(waitInfo, UINT64_MAX), "Couldn't wait for frame timelines");
+			stats.totalWait += std::chrono::steady_clock::now() - start;
+		}
+
+		// timelines only go up, every frame before this one is done as well
+		auto now = std::chrono::steady_clock::now();
+		while (!pending.empty() && pending.front().frameNumber <= waitedFrame)
+		{
+			complete(pending.front(), now);
+			pending.pop_front();
+		}
+
+		return VulkanResult::Success();
+	}
+
+	VulkanResult FrameScheduler::waitIdle()
+	{
+		for (size_t i = 0; i < timelines.size(); ++i)
+		{
+			LIB_QUICK_BAIL(wait(static_cast<TimelineQueue>(i), timelines[i].submitted));
+		}
+		return poll();
+	}
+
+	std::vector<FrameCompletion> FrameScheduler::takeCompletedFrames()
+	{
+		return std::exchange(completed, {});
+	}
+
+	VulkanResult FrameScheduler::poll()
+	{
+		std::array<uint64_t, static_cast<size_t>(TimelineQueue::Count)> values{};
+		for (size_t i = 0; i < timelines.size(); ++i)
+		{
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(getCompletedValue(static_cast<TimelineQueue>(i)), values[i]);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		while (!pending.empty())
+		{
+			auto &frame = pending.front();
+			for (size_t i = 0; i < timelines.size(); ++i)
+			{
+				if (frame.values[i] > values[i])
+				{
+					return VulkanResult::Success();
+				}
+			}
+
+			complete(frame, now);
+			pending.pop_front();
+		}
+
+		return VulkanResult::Success();
+	}
+
+	void FrameScheduler::complete(const PendingFrame &frame, std::chrono::steady_clock::time_point completedAt)
+	{
+		FrameCompletion completion{frame.frameNumber, frame.submittedAt, completedAt};
+
+		++stats.completedFrames;
+		stats.totalLatency += completion.latency();
+
+		if (completed.size() >= MAX_COMPLETED_FRAMES)
+		{
+			completed.erase(completed.begin());
+		}
+		completed.push_back(completion);
+	}
+}
@@ -1,8 +1,10 @@
 #include "graphics_pipeline.hpp"
+#include "pipeline_state_cache.hpp"
 #include "vulkan.hpp"
 #include "vulkan/vulkan_core.h"
 #include "vulkan/vulkan_structs.hpp"
 
+#include <chrono>
 
 namespace Vulkan {
 
@@ -13,92 +15,125 @@ namespace Vulkan {
     }
 
     VulkanResult GraphicsPipeline::createGraphicsPipeline() {
-		vk::PipelineVertexInputStateCreateInfo vertexInfo{};
+        if(config.stateCache) {
+            LIB_SET_AND_BAIL_RESULT_VALUE(config.stateCache->getPipeline(config), pipeline);
+            return VulkanResult::Success();
+        }
 
-        vertexInfo.setVertexAttributeDescriptions(config.vertexAttributeDescriptions);
-        vertexInfo.setVertexBindingDescriptions(config.vertexBindingDescriptions);
+        LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createPipelineLayout(config), auto pipelineLayout);
 
-        vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
-        inputAssemblyInfo.setTopology(config.topology);
-        inputAssemblyInfo.setPrimitiveRestartEnable(config.primitiveRestart);
+        auto layout = std::make_shared<SharedPipelineLayout>(SharedPipelineLayout{std::move(pipelineLayout)});
 
-		vk::PipelineViewportStateCreateInfo viewportStateInfo{};
-        
-        if(config.viewportConfig.usesDynamicViewport) {
-            viewportStateInfo.viewportCount = config.viewportConfig.dynamicViewportCount;
-        }
-        else {
-            viewportStateInfo.setViewports(config.viewportConfig.viewports);
-        }
+        LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createPipeline(config, layout->layout.get()), auto newPipeline);
 
-        if(config.scissorConfig.usesDynamicScissors) {
-            viewportStateInfo.scissorCount = config.scissorConfig.dynamicScissorsCount;
-        }
-        else {
-            viewportStateInfo.setScissors(config.scissorConfig.scissors);
+        pipeline = std::make_shared<SharedPipeline>(SharedPipeline{std::move(newPipeline), std::move(layout)});
+
+		return VulkanResult();
+    }
+
+    VulkanResult GraphicsPipeline::recreateGraphicsPipeline() {
+        return createGraphicsPipeline();
+    }
+
+    namespace Utils {
+        ResultValue<vk::UniquePipelineLayout> createPipelineLayout(const GraphicsPipelineConfig& config) {
+		    vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
+            pipelineLayoutInfo.setSetLayouts(config.descriptorSetLayouts);
+            pipelineLayoutInfo.setPushConstantRanges(config.pushConstants);
+
+		    VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+                config.device->getDevice().createPipelineLayoutUnique(
+                    pipelineLayoutInfo,
+                    nullptr,
+                    config.device->getDispatcher()),
+                auto pipelineLayout,
+                "Couldn't create pipeline layout!");
+
+		    std::cout << "Created pipeline layout" << std::endl;
+
+            return pipelineLayout;
         }
 
-        vk::PipelineDynamicStateCreateInfo dynamicStateInfo {};
+        ResultValue<vk::UniquePipeline> createPipeline(const GraphicsPipelineConfig& config, vk::PipelineLayout layout) {
+		    vk::PipelineVertexInputStateCreateInfo vertexInfo{};
 
-        dynamicStateInfo.setDynamicStates(config.dynamicStates);
+            vertexInfo.setVertexAttributeDescriptions(config.vertexAttributeDescriptions);
+            vertexInfo.setVertexBindingDescriptions(config.vertexBindingDescriptions);
 
-		vk::PipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.setSetLayouts(config.descriptorSetLayouts);
-        pipelineLayoutInfo.setPushConstantRanges(config.pushConstants);
+            vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
+            inputAssemblyInfo.setTopology(config.topology);
+            inputAssemblyInfo.setPrimitiveRestartEnable(config.primitiveRestart);
 
-		VULKAN_SET_AND_BAIL_RESULT_VALUE(
-            config.device->getDevice().createPipelineLayoutUnique(
-                pipelineLayoutInfo,
-                nullptr, 
-                config.device->getDispatcher()),
-            pipelineLayout, 
-            "Couldn't create pipeline layout!");
+		    vk::PipelineViewportStateCreateInfo viewportStateInfo{};
 
-		std::cout << "Created pipeline layout" << std::endl;
+            if(config.viewportConfig.usesDynamicViewport) {
+                viewportStateInfo.viewportCount = config.viewportConfig.dynamicViewportCount;
+            }
+            else {
+                viewportStateInfo.setViewports(config.viewportConfig.viewports);
+            }
 
-		vk::PipelineColorBlendStateCreateInfo colorBlend{};
+            if(config.scissorConfig.usesDynamicScissors) {
+                viewportStateInfo.scissorCount = config.scissorConfig.dynamicScissorsCount;
+            }
+            else {
+                viewportStateInfo.setScissors(config.scissorConfig.scissors);
+            }
 
-        colorBlend.setBlendConstants(config.colorBlendConfig.constants);
-        colorBlend.setLogicOpEnable(config.colorBlendConfig.enableLogicOp);
-        colorBlend.setLogicOp(config.colorBlendConfig.logicOp);
-        colorBlend.setAttachments(config.colorBlendConfig.attachments);
+            vk::PipelineDynamicStateCreateInfo dynamicStateInfo {};
 
+            dynamicStateInfo.setDynamicStates(config.dynamicStates);
 
+		    vk::PipelineColorBlendStateCreateInfo colorBlend{};
 
-		vk::GraphicsPipelineCreateInfo pipelineInfo{};
+            colorBlend.setBlendConstants(config.colorBlendConfig.constants);
+            colorBlend.setLogicOpEnable(config.colorBlendConfig.enableLogicOp);
+            colorBlend.setLogicOp(config.colorBlendConfig.logicOp);
+            colorBlend.setAttachments(config.colorBlendConfig.attachments);
 
-        pipelineInfo.setStages(config.shaderStages);
-        pipelineInfo.setPVertexInputState(&vertexInfo);
-        pipelineInfo.setPInputAssemblyState(&inputAssemblyInfo);
-        pipelineInfo.setPViewportState(&viewportStateInfo);
-        pipelineInfo.setPRasterizationState(&config.razterizationInfo);
-        pipelineInfo.setPMultisampleState(&config.multiSampling);
 
-        pipelineInfo.setPColorBlendState(&colorBlend);
-        pipelineInfo.setPDynamicState(&dynamicStateInfo);
-        pipelineInfo.setLayout(pipelineLayout.get());
-        pipelineInfo.setRenderPass(config.renderPass);
-        pipelineInfo.setSubpass(config.subpass);
-        pipelineInfo.setBasePipelineHandle(pipeline.get() == VK_NULL_HANDLE ? pipeline.get() : VK_NULL_HANDLE);
 
+		    vk::GraphicsPipelineCreateInfo pipelineInfo{};
 
-		VULKAN_SET_AND_BAIL_RESULT_VALUE(
-            config.device->getDevice().createGraphicsPipelineUnique(
-                nullptr,
-                pipelineInfo,
-                nullptr, 
-                config.device->getDispatcher()),
-            pipeline, 
-            "Couldn't create pipeline!");
+            pipelineInfo.setStages(config.shaderStages);
+            pipelineInfo.setPVertexInputState(&vertexInfo);
+            pipelineInfo.setPInputAssemblyState(&inputAssemblyInfo);
+            pipelineInfo.setPViewportState(&viewportStateInfo);
+            pipelineInfo.setPRasterizationState(&config.razterizationInfo);
+            pipelineInfo.setPMultisampleState(&config.multiSampling);
+            pipelineInfo.setPDepthStencilState(&config.depthStencilInfo);
 
-		std::cout << "Created graphics pipeline !" << std::endl;
+            pipelineInfo.setPColorBlendState(&colorBlend);
+            pipelineInfo.setPDynamicState(&dynamicStateInfo);
+            pipelineInfo.setLayout(layout);
+            pipelineInfo.setRenderPass(config.renderPass);
+            pipelineInfo.setSubpass(config.subpass);
 
+            vk::PipelineRenderingCreateInfoKHR renderingInfo{};
+            if(!config.renderPass) {
+                renderingInfo.setViewMask(config.renderingConfig.viewMask);
+                renderingInfo.setColorAttachmentFormats(config.renderingConfig.colorFormats);
+                renderingInfo.setDepthAttachmentFormat(config.renderingConfig.depthFormat);
+                renderingInfo.setStencilAttachmentFormat(config.renderingConfig.stencilFormat);
+                pipelineInfo.setPNext(&renderingInfo);
+            }
 
-		return VulkanResult();
-        
-    }
+            auto start = std::chrono::steady_clock::now();
 
-    VulkanResult GraphicsPipeline::recreateGraphicsPipeline() {
-        return createGraphicsPipeline();
+		    VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+                config.device->getDevice().createGraphicsPipelineUnique(
+                    config.device->getPipelineCache(),
+                    pipelineInfo,
+                    nullptr,
+                    config.device->getDispatcher()),
+                auto pipeline,
+                "Couldn't create pipeline!");
+
+            auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+		    std::cout << "Created graphics pipeline in " << elapsed.count() << "ms ("
+                      << (config.device->isPipelineCacheWarm() ? "warm" : "cold") << " pipeline cache)" << std::endl;
+
+		    return pipeline;
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,127 @@
+#include "parallel_recorder.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+
+namespace Vulkan
+{
+	VulkanResult ParallelRecorder::createParallelRecorder(const ParallelRecorderConfig &_config)
+	{
+		config = _config;
+
+		if (config.framesInFlight == 0)
+		{
+			return VulkanResult::BadUsage("A parallel recorder needs at least one frame in flight");
+		}
+
+		maxSlices = config.maxSlices ? config.maxSlices : std::max(1u, config.threadPool->getThreadCount());
+
+		recyclers = std::vector<CommandBufferRecycler>(maxSlices);
+		for (auto &recycler : recyclers)
+		{
+			LIB_QUICK_BAIL(recycler.createCommandBufferRecycler({
+			    .device = config.device,
+			    .queue = config.queue,
+			    .framesInFlight = config.framesInFlight,
+			}));
+		}
+
+		std::cout << "Created parallel recorder with " << maxSlices << " slices per frame" << std::endl;
+		return VulkanResult::Success();
+	}
+
+	VulkanResult ParallelRecorder::beginFrame(uint32_t frameIndex)
+	{
+		for (auto &recycler : recyclers)
+		{
+			LIB_QUICK_BAIL(recycler.beginFrame(frameIndex));
+		}
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<std::vector<vk::CommandBuffer>> ParallelRecorder::record(uint32_t count, const vk::CommandBufferInheritanceInfo &inheritance,
+	                                                                     const RecordSliceFunction &recordSlice, uint32_t slices)
+	{
+		std::vector<vk::CommandBuffer> commandBuffers;
+		if (count == 0)
+		{
+			return commandBuffers;
+		}
+
+		slices = std::min({slices ? slices : maxSlices, maxSlices, count});
+
+		auto start = std::chrono::steady_clock::now();
+
+		// allocated here, the workers only record
+		for (uint32_t i = 0; i < slices; ++i)
+		{
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(recyclers[i].acquire(vk::CommandBufferLevel::eSecondary), auto commandBuffer);
+			commandBuffers.push_back(commandBuffer);
+		}
+
+		std::vector<std::future<VulkanResult>> jobs;
+		jobs.reserve(slices);
+		for (uint32_t i = 0; i < slices; ++i)
+		{
+			// even slices, the first ones take the remainder
+			uint32_t first = static_cast<uint32_t>(uint64_t(count) * i / slices);
+			uint32_t last = static_cast<uint32_t>(uint64_t(count) * (i + 1) / slices);
+			auto commandBuffer = commandBuffers[i];
+
+			jobs.push_back(config.threadPool->submit([commandBuffer, first, last, &inheritance, &recordSlice]() -> VulkanResult
+			                                         {
+				vk::CommandBufferBeginInfo beginInfo{};
+				beginInfo.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue);
+				beginInfo.setPInheritanceInfo(&inheritance);
+				VULKAN_QUICK_BAIL(commandBuffer.begin(beginInfo), "Couldn't begin secondary command buffer");
+
+				LIB_QUICK_BAIL(recordSlice(commandBuffer, first, last));
+
+				VULKAN_QUICK_BAIL(commandBuffer.end(), "Couldn't end secondary command buffer");
+				return VulkanResult::Success(); }));
+		}
+
+		// every job has to be done before returning, they reference inheritance and recordSlice
+		VulkanResult result = VulkanResult::Success();
+		for (auto &job : jobs)
+		{
+			auto jobResult = job.get();
+			if (result.type() == VulkanResultVariants::Success)
+			{
+				result = jobResult;
+			}
+		}
+		LIB_QUICK_BAIL(result);
+
+		std::chrono::duration<double, std::milli> recordTime = std::chrono::steady_clock::now() - start;
+		++stats.recordings;
+		stats.slices += slices;
+		stats.lastRecordTime = recordTime;
+		stats.totalRecordTime += recordTime;
+
+		return commandBuffers;
+	}
+
+	RecordingStats ParallelRecorder::getStats()
+	{
+		auto result = stats;
+		result.commandBuffersAllocated = 0;
+		for (auto &recycler : recyclers)
+		{
+			result.commandBuffersAllocated += recycler.getStats().totalAllocated;
+		}
+		return result;
+	}
+
+	VulkanResult ParallelRecorder::recordInto(vk::CommandBuffer primary, uint32_t count, const vk::CommandBufferInheritanceInfo &inheritance,
+	                                          const RecordSliceFunction &recordSlice, uint32_t slices)
+	{
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(record(count, inheritance, recordSlice, slices), auto commandBuffers);
+		if (!commandBuffers.empty())
+		{
+			primary.executeCommands(commandBuffers);
+		}
+		return VulkanResult::Success();
+	}
+}
@@ -0,0 +1,439 @@
+#include "pipeline_state_cache.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+
+namespace Vulkan
+{
+	// appends values to a byte string, structs with pNext or padding are written field by field
+	class PipelineKeyWriter
+	{
+	public:
+		template <typename T>
+		    requires std::is_trivially_copyable_v<T>
+		void write(const T &value)
+		{
+			bytes.append(reinterpret_cast<const char *>(&value), sizeof(T));
+		}
+
+		void write(std::string_view value)
+		{
+			write(value.size());
+			bytes.append(value);
+		}
+
+		template <typename T>
+		void writeArray(const std::vector<T> &values)
+		{
+			write(values.size());
+			for (const auto &value : values)
+			{
+				write(value);
+			}
+		}
+
+		std::string bytes;
+	};
+
+	// with a dynamic topology the pipeline only fixes the topology class, unless the device
+	// reports dynamicPrimitiveTopologyUnrestricted which we don't rely on
+	static uint32_t topologyClass(vk::PrimitiveTopology topology)
+	{
+		switch (topology)
+		{
+		case vk::PrimitiveTopology::ePointList:
+			return 0;
+		case vk::PrimitiveTopology::eLineList:
+		case vk::PrimitiveTopology::eLineStrip:
+		case vk::PrimitiveTopology::eLineListWithAdjacency:
+		case vk::PrimitiveTopology::eLineStripWithAdjacency:
+			return 1;
+		case vk::PrimitiveTopology::ePatchList:
+			return 3;
+		default:
+			return 2;
+		}
+	}
+
+	static void writeStencilOpState(PipelineKeyWriter &writer, const GraphicsPipelineConfig &config, const vk::StencilOpState &state)
+	{
+		if (!config.hasDynamicState(vk::DynamicState::eStencilOp))
+		{
+			writer.write(state.failOp);
+			writer.write(state.passOp);
+			writer.write(state.depthFailOp);
+			writer.write(state.compareOp);
+		}
+		if (!config.hasDynamicState(vk::DynamicState::eStencilCompareMask))
+		{
+			writer.write(state.compareMask);
+		}
+		if (!config.hasDynamicState(vk::DynamicState::eStencilWriteMask))
+		{
+			writer.write(state.writeMask);
+		}
+		if (!config.hasDynamicState(vk::DynamicState::eStencilReference))
+		{
+			writer.write(state.reference);
+		}
+	}
+
+	PipelineStateCacheStats PipelineStateCache::getStats()
+	{
+		std::lock_guard lock(mutex);
+		auto result = stats;
+		result.pipelineCount = pipelines.size();
+		result.layoutCount = layouts.size();
+		return result;
+	}
+
+	VulkanResult PipelineStateCache::createPipelineStateCache(const PipelineStateCacheConfig &_config)
+	{
+		config = _config;
+		return VulkanResult::Success();
+	}
+
+	ResultValue<std::shared_ptr<SharedPipelineLayout>> PipelineStateCache::getPipelineLayout(const GraphicsPipelineConfig &pipelineConfig)
+	{
+		auto key = Utils::serializePipelineLayout(pipelineConfig);
+
+		std::lock_guard lock(mutex);
+
+		auto existing = layouts.find(key);
+		if (existing != layouts.end())
+		{
+			++stats.layoutHits;
+			return std::shared_ptr(existing->second);
+		}
+
+		++stats.layoutMisses;
+
+		auto start = std::chrono::steady_clock::now();
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createPipelineLayout(pipelineConfig), auto pipelineLayout);
+		stats.creationTime += std::chrono::steady_clock::now() - start;
+
+		auto layout = std::make_shared<SharedPipelineLayout>(SharedPipelineLayout{std::move(pipelineLayout)});
+		layouts.emplace(std::move(key), layout);
+
+		return layout;
+	}
+
+	ResultValue<std::shared_ptr<SharedPipeline>> PipelineStateCache::getPipeline(const GraphicsPipelineConfig &pipelineConfig)
+	{
+		if (pipelineConfig.shaderHashes.size() != pipelineConfig.shaderStages.size())
+		{
+			return VulkanResult::BadUsage("Pipelines from a state cache need the SPIR-V hash of every shader stage");
+		}
+
+		auto key = Utils::serializePipelineConfig(pipelineConfig);
+
+		std::promise<PipelineResult> promise;
+		std::shared_future<PipelineResult> pending;
+		{
+			std::lock_guard lock(mutex);
+
+			auto existing = pipelines.find(key);
+			if (existing != pipelines.end())
+			{
+				++stats.hits;
+				pending = existing->second;
+			}
+			else
+			{
+				++stats.misses;
+				pipelines.emplace(key, promise.get_future().share());
+			}
+		}
+
+		if (pending.valid())
+		{
+			// either already created or being created by another thread right now
+			return pending.get();
+		}
+
+		// created outside of the lock so unrelated pipelines can be built concurrently
+		auto create = [&]() -> PipelineResult
+		{
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(getPipelineLayout(pipelineConfig), auto layout);
+
+			auto start = std::chrono::steady_clock::now();
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createPipeline(pipelineConfig, layout->layout.get()), auto pipeline);
+			auto elapsed = std::chrono::steady_clock::now() - start;
+
+			{
+				std::lock_guard lock(mutex);
+				stats.creationTime += elapsed;
+			}
+
+			return std::make_shared<SharedPipeline>(SharedPipeline{std::move(pipeline), std::move(layout)});
+		};
+
+		auto result = create();
+		promise.set_value(result);
+
+		if (result.result.type() != VulkanResultVariants::Success)
+		{
+			// let a later request try again instead of caching the failure
+			std::lock_guard lock(mutex);
+			pipelines.erase(key);
+		}
+
+		return result;
+	}
+
+	size_t PipelineStateCache::releaseUnused()
+	{
+		std::lock_guard lock(mutex);
+
+		size_t released = std::erase_if(pipelines, [](const auto &entry)
+		                                {
+			const auto &future = entry.second;
+			if (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				return false;
+			}
+			// the future's shared state holds the only reference left
+			return future.get().value.use_count() == 1; });
+
+		std::erase_if(layouts, [](const auto &entry)
+		              { return entry.second.use_count() == 1; });
+
+		return released;
+	}
+
+	namespace Utils
+	{
+		std::string serializePipelineLayout(const GraphicsPipelineConfig &config)
+		{
+			PipelineKeyWriter writer;
+
+			writer.write(config.descriptorSetLayouts.size());
+			for (const auto &layout : config.descriptorSetLayouts)
+			{
+				writer.write(static_cast<VkDescriptorSetLayout>(layout));
+			}
+			writer.writeArray(config.pushConstants);
+
+			return std::move(writer.bytes);
+		}
+
+		std::string serializePipelineConfig(const GraphicsPipelineConfig &config)
+		{
+			PipelineKeyWriter writer;
+
+			writer.write(static_cast<VkRenderPass>(config.renderPass));
+			if (config.renderPass)
+			{
+				writer.write(config.subpass);
+			}
+			else
+			{
+				writer.writeArray(config.renderingConfig.colorFormats);
+				writer.write(config.renderingConfig.depthFormat);
+				writer.write(config.renderingConfig.stencilFormat);
+				writer.write(config.renderingConfig.viewMask);
+			}
+
+			writer.write(config.shaderStages.size());
+			for (size_t i = 0; i < config.shaderStages.size(); ++i)
+			{
+				const auto &stage = config.shaderStages[i];
+				writer.write(stage.flags);
+				writer.write(stage.stage);
+				// the code rather than the module, which can be destroyed and its handle reused
+				if (i < config.shaderHashes.size())
+				{
+					writer.write(config.shaderHashes[i]);
+				}
+				else
+				{
+					writer.write(static_cast<VkShaderModule>(stage.module));
+				}
+				writer.write(std::string_view(stage.pName ? stage.pName : ""));
+
+				auto specialization = stage.pSpecializationInfo;
+				writer.write(specialization != nullptr);
+				if (specialization)
+				{
+					writer.write(specialization->mapEntryCount);
+					for (uint32_t i = 0; i < specialization->mapEntryCount; ++i)
+					{
+						const auto &entry = specialization->pMapEntries[i];
+						writer.write(entry.constantID);
+						writer.write(entry.offset);
+						writer.write(entry.size);
+					}
+					writer.write(std::string_view(static_cast<const char *>(specialization->pData), specialization->dataSize));
+				}
+			}
+
+			// the order of dynamic states doesn't change the pipeline
+			auto dynamicStates = config.dynamicStates;
+			std::sort(dynamicStates.begin(), dynamicStates.end());
+			writer.writeArray(dynamicStates);
+
+			writer.writeArray(config.vertexBindingDescriptions);
+			writer.writeArray(config.vertexAttributeDescriptions);
+
+			if (config.hasDynamicState(vk::DynamicState::ePrimitiveTopology))
+			{
+				writer.write(topologyClass(config.topology));
+			}
+			else
+			{
+				writer.write(config.topology);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::ePrimitiveRestartEnable))
+			{
+				writer.write(config.primitiveRestart);
+			}
+
+			// values covered by a dynamic state are set while recording, they don't make a different pipeline
+			writer.write(config.viewportConfig.usesDynamicViewport);
+			if (config.viewportConfig.usesDynamicViewport)
+			{
+				writer.write(config.viewportConfig.dynamicViewportCount);
+			}
+			else
+			{
+				writer.writeArray(config.viewportConfig.viewports);
+			}
+
+			writer.write(config.scissorConfig.usesDynamicScissors);
+			if (config.scissorConfig.usesDynamicScissors)
+			{
+				writer.write(config.scissorConfig.dynamicScissorsCount);
+			}
+			else
+			{
+				writer.writeArray(config.scissorConfig.scissors);
+			}
+
+			const auto &rasterization = config.razterizationInfo;
+			writer.write(rasterization.flags);
+			if (!config.hasDynamicState(vk::DynamicState::eDepthClampEnableEXT))
+			{
+				writer.write(rasterization.depthClampEnable);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eRasterizerDiscardEnable))
+			{
+				writer.write(rasterization.rasterizerDiscardEnable);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::ePolygonModeEXT))
+			{
+				writer.write(rasterization.polygonMode);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eCullMode))
+			{
+				writer.write(rasterization.cullMode);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eFrontFace))
+			{
+				writer.write(rasterization.frontFace);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eDepthBiasEnable))
+			{
+				writer.write(rasterization.depthBiasEnable);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eDepthBias))
+			{
+				writer.write(rasterization.depthBiasConstantFactor);
+				writer.write(rasterization.depthBiasClamp);
+				writer.write(rasterization.depthBiasSlopeFactor);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eLineWidth))
+			{
+				writer.write(rasterization.lineWidth);
+			}
+
+			const auto &multiSampling = config.multiSampling;
+			writer.write(multiSampling.flags);
+			writer.write(multiSampling.rasterizationSamples);
+			writer.write(multiSampling.sampleShadingEnable);
+			writer.write(multiSampling.minSampleShading);
+			writer.write(multiSampling.pSampleMask != nullptr);
+			if (multiSampling.pSampleMask)
+			{
+				// one 32 bit mask word per 32 samples
+				auto words = (static_cast<uint32_t>(multiSampling.rasterizationSamples) + 31) / 32;
+				for (uint32_t i = 0; i < words; ++i)
+				{
+					writer.write(multiSampling.pSampleMask[i]);
+				}
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eAlphaToCoverageEnableEXT))
+			{
+				writer.write(multiSampling.alphaToCoverageEnable);
+			}
+			writer.write(multiSampling.alphaToOneEnable);
+
+			const auto &depthStencil = config.depthStencilInfo;
+			writer.write(depthStencil.flags);
+			if (!config.hasDynamicState(vk::DynamicState::eDepthTestEnable))
+			{
+				writer.write(depthStencil.depthTestEnable);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eDepthWriteEnable))
+			{
+				writer.write(depthStencil.depthWriteEnable);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eDepthCompareOp))
+			{
+				writer.write(depthStencil.depthCompareOp);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eDepthBoundsTestEnable))
+			{
+				writer.write(depthStencil.depthBoundsTestEnable);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eStencilTestEnable))
+			{
+				writer.write(depthStencil.stencilTestEnable);
+			}
+			writeStencilOpState(writer, config, depthStencil.front);
+			writeStencilOpState(writer, config, depthStencil.back);
+			if (!config.hasDynamicState(vk::DynamicState::eDepthBounds))
+			{
+				writer.write(depthStencil.minDepthBounds);
+				writer.write(depthStencil.maxDepthBounds);
+			}
+
+			writer.write(config.colorBlendConfig.attachments.size());
+			for (const auto &attachment : config.colorBlendConfig.attachments)
+			{
+				if (!config.hasDynamicState(vk::DynamicState::eColorBlendEnableEXT))
+				{
+					writer.write(attachment.blendEnable);
+				}
+				if (!config.hasDynamicState(vk::DynamicState::eColorBlendEquationEXT))
+				{
+					writer.write(attachment.srcColorBlendFactor);
+					writer.write(attachment.dstColorBlendFactor);
+					writer.write(attachment.colorBlendOp);
+					writer.write(attachment.srcAlphaBlendFactor);
+					writer.write(attachment.dstAlphaBlendFactor);
+					writer.write(attachment.alphaBlendOp);
+				}
+				if (!config.hasDynamicState(vk::DynamicState::eColorWriteMaskEXT))
+				{
+					writer.write(attachment.colorWriteMask);
+				}
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eBlendConstants))
+			{
+				writer.write(config.colorBlendConfig.constants);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eLogicOpEnableEXT))
+			{
+				writer.write(config.colorBlendConfig.enableLogicOp);
+			}
+			if (!config.hasDynamicState(vk::DynamicState::eLogicOpEXT))
+			{
+				writer.write(config.colorBlendConfig.logicOp);
+			}
+
+			writer.bytes += serializePipelineLayout(config);
+
+			return std::move(writer.bytes);
+		}
+	}
+}
@@ -0,0 +1,417 @@
+#include "shader_bundle.hpp"
+#include "vulkan.hpp"
+
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Vulkan
+{
+	static std::filesystem::path normalizeBundlePath(const std::filesystem::path &path)
+	{
+		std::error_code error;
+		auto canonical = std::filesystem::weakly_canonical(path, error);
+		return error ? path.lexically_normal() : canonical;
+	}
+
+	ShaderBundle::~ShaderBundle()
+	{
+		close();
+	}
+
+	VulkanResult ShaderBundle::createShaderBundle(const ShaderBundleConfig &_config)
+	{
+		close();
+		config = _config;
+
+#ifdef _WIN32
+		file = CreateFileW(config.path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			file = nullptr;
+			return VulkanResult::BadUsage("Couldn't open shader bundle " + config.path.string());
+		}
+
+		LARGE_INTEGER fileSize{};
+		GetFileSizeEx(file, &fileSize);
+		size = static_cast<size_t>(fileSize.QuadPart);
+
+		if (size > 0)
+		{
+			mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			data = mapping ? static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		}
+#else
+		int fd = open(config.path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			return VulkanResult::BadUsage("Couldn't open shader bundle " + config.path.string());
+		}
+
+		struct stat fileInfo{};
+		fstat(fd, &fileInfo);
+		size = static_cast<size_t>(fileInfo.st_size);
+
+		if (size > 0)
+		{
+			void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			data = mapped == MAP_FAILED ? nullptr : static_cast<const uint8_t *>(mapped);
+		}
+
+		// the mapping keeps its own reference to the file
+		::close(fd);
+#endif
+
+		if (!data)
+		{
+			close();
+			return VulkanResult::BadUsage("Couldn't map shader bundle " + config.path.string());
+		}
+
+		auto fail = [this](const std::string &reason)
+		{
+			auto path = config.path.string();
+			close();
+			return VulkanResult::BadUsage("Shader bundle " + path + " is corrupted: " + reason);
+		};
+
+		if (size < sizeof(ShaderBundleHeader) || header()->magic != SHADER_BUNDLE_MAGIC)
+		{
+			return fail("bad magic");
+		}
+		if (header()->version != SHADER_BUNDLE_VERSION)
+		{
+			return fail("version " + std::to_string(header()->version) + ", expected " + std::to_string(SHADER_BUNDLE_VERSION));
+		}
+
+		auto inBounds = [this](uint64_t offset, uint64_t length)
+		{ return offset <= size && length <= size - offset; };
+
+		const auto &bundleHeader = *header();
+		if (!inBounds(bundleHeader.entriesOffset, uint64_t(bundleHeader.entryCount) * sizeof(ShaderBundleEntry)) ||
+		    !inBounds(bundleHeader.dependenciesOffset, uint64_t(bundleHeader.dependencyCount) * sizeof(ShaderBundleDependency)) ||
+		    !inBounds(bundleHeader.stringsOffset, bundleHeader.stringsSize) ||
+		    bundleHeader.entriesOffset % alignof(ShaderBundleEntry) != 0 ||
+		    bundleHeader.dependenciesOffset % alignof(ShaderBundleDependency) != 0)
+		{
+			return fail("tables out of bounds");
+		}
+
+		for (const auto &entry : entries())
+		{
+			if (!inBounds(entry.spirvOffset, entry.spirvSize) || entry.spirvOffset % sizeof(uint32_t) != 0 ||
+			    entry.spirvSize % sizeof(uint32_t) != 0 ||
+			    uint64_t(entry.pathOffset) + entry.pathLength > bundleHeader.stringsSize ||
+			    uint64_t(entry.firstDependency) + entry.dependencyCount > bundleHeader.dependencyCount)
+			{
+				return fail("entry out of bounds");
+			}
+		}
+
+		auto allDependencies = std::span(reinterpret_cast<const ShaderBundleDependency *>(data + bundleHeader.dependenciesOffset), bundleHeader.dependencyCount);
+		for (const auto &dependency : allDependencies)
+		{
+			if (uint64_t(dependency.includerOffset) + dependency.includerLength > bundleHeader.stringsSize ||
+			    uint64_t(dependency.pathOffset) + dependency.pathLength > bundleHeader.stringsSize)
+			{
+				return fail("dependency out of bounds");
+			}
+		}
+
+		std::cout << "Mapped shader bundle " << config.path.string() << " (" << bundleHeader.entryCount << " shaders, " << size << " bytes)" << std::endl;
+
+		return VulkanResult::Success();
+	}
+
+	void ShaderBundle::close()
+	{
+#ifdef _WIN32
+		if (data)
+		{
+			UnmapViewOfFile(data);
+		}
+		if (mapping)
+		{
+			CloseHandle(mapping);
+			mapping = nullptr;
+		}
+		if (file)
+		{
+			CloseHandle(file);
+			file = nullptr;
+		}
+#else
+		if (data)
+		{
+			munmap(const_cast<uint8_t *>(data), size);
+		}
+#endif
+		data = nullptr;
+		size = 0;
+	}
+
+	std::span<const ShaderBundleEntry> ShaderBundle::entries() const
+	{
+		return {reinterpret_cast<const ShaderBundleEntry *>(data + header()->entriesOffset), header()->entryCount};
+	}
+
+	std::span<const ShaderBundleDependency> ShaderBundle::dependencies(const ShaderBundleEntry &entry) const
+	{
+		auto first = reinterpret_cast<const ShaderBundleDependency *>(data + header()->dependenciesOffset) + entry.firstDependency;
+		return {first, entry.dependencyCount};
+	}
+
+	std::string_view ShaderBundle::string(uint32_t offset, uint32_t length) const
+	{
+		return {reinterpret_cast<const char *>(data + header()->stringsOffset + offset), length};
+	}
+
+	const ShaderBundleEntry *ShaderBundle::findEntry(const std::filesystem::path &source, EShLanguage language) const
+	{
+		if (!isOpen())
+		{
+			return nullptr;
+		}
+
+		auto name = source.lexically_normal().generic_string();
+		for (const auto &entry : entries())
+		{
+			if (entry.language == static_cast<uint32_t>(language) && string(entry.pathOffset, entry.pathLength) == name)
+			{
+				return &entry;
+			}
+		}
+
+		return nullptr;
+	}
+
+	std::span<const uint32_t> ShaderBundle::getSpirv(const ShaderBundleEntry &entry) const
+	{
+		return {reinterpret_cast<const uint32_t *>(data + entry.spirvOffset), entry.spirvSize / sizeof(uint32_t)};
+	}
+
+	bool ShaderBundle::isUpToDate(const ShaderBundleEntry &entry) const
+	{
+		std::filesystem::path source = string(entry.pathOffset, entry.pathLength);
+
+		auto contents = Utils::readBinaryFile(source);
+		if (!contents.has_value())
+		{
+			// release builds ship the bundle without the GLSL, there is nothing to compare against
+			return true;
+		}
+
+		if (Utils::hashBytes(contents->data(), contents->size()) != entry.sourceHash)
+		{
+			return false;
+		}
+
+		return getDependencies(entry).isUpToDate();
+	}
+
+	ShaderDependencyGraph ShaderBundle::getDependencies(const ShaderBundleEntry &entry) const
+	{
+		auto directory = std::filesystem::path(string(entry.pathOffset, entry.pathLength)).parent_path();
+
+		ShaderDependencyGraph graph{};
+		for (const auto &dependency : dependencies(entry))
+		{
+			graph.add({
+			    .includer = normalizeBundlePath(directory / string(dependency.includerOffset, dependency.includerLength)),
+			    .path = normalizeBundlePath(directory / string(dependency.pathOffset, dependency.pathLength)),
+			    .contentHash = dependency.contentHash,
+			});
+		}
+		return graph;
+	}
+
+	namespace Utils
+	{
+		static uint64_t alignUp(uint64_t value, uint64_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		VulkanResult writeShaderBundle(const std::filesystem::path &path,
+		                               const std::vector<ShaderProgramSources> &programs,
+		                               const std::vector<CompiledShaderProgram> &compiled,
+		                               const ShaderCompileOptions &options)
+		{
+			if (programs.size() != compiled.size())
+			{
+				return VulkanResult::BadUsage("Every program needs its compiled SPIR-V to be bundled");
+			}
+
+			std::vector<ShaderBundleEntry> entries;
+			std::vector<ShaderBundleDependency> dependencies;
+			std::string strings;
+			std::vector<const std::vector<uint32_t> *> blobs;
+
+			auto addString = [&strings](const std::string &value)
+			{
+				auto offset = static_cast<uint32_t>(strings.size());
+				strings += value;
+				return std::pair{offset, static_cast<uint32_t>(value.size())};
+			};
+
+			for (size_t program = 0; program < programs.size(); ++program)
+			{
+				if (programs[program].size() != compiled[program].spirv.size())
+				{
+					return VulkanResult::BadUsage("Compiled program doesn't match its sources");
+				}
+
+				for (size_t i = 0; i < programs[program].size(); ++i)
+				{
+					const auto &[source, language] = programs[program][i];
+
+					auto contents = readBinaryFile(source);
+					if (!contents.has_value())
+					{
+						return VulkanResult::BadUsage("Couldn't read " + source.string());
+					}
+
+					ShaderBundleEntry entry{};
+					std::tie(entry.pathOffset, entry.pathLength) = addString(source.lexically_normal().generic_string());
+					entry.language = static_cast<uint32_t>(language);
+					entry.sourceHash = hashBytes(contents->data(), contents->size());
+					entry.firstDependency = static_cast<uint32_t>(dependencies.size());
+
+					// stored relative to the source so the bundle doesn't depend on where it was built
+					auto directory = normalizeBundlePath(source).parent_path();
+					for (const auto &edge : compiled[program].dependencies.edges)
+					{
+						ShaderBundleDependency dependency{};
+						std::tie(dependency.includerOffset, dependency.includerLength) = addString(edge.includer.lexically_relative(directory).generic_string());
+						std::tie(dependency.pathOffset, dependency.pathLength) = addString(edge.path.lexically_relative(directory).generic_string());
+						dependency.contentHash = edge.contentHash;
+						dependencies.push_back(dependency);
+					}
+					entry.dependencyCount = static_cast<uint32_t>(dependencies.size()) - entry.firstDependency;
+
+					entries.push_back(entry);
+					blobs.push_back(&compiled[program].spirv[i]);
+				}
+			}
+
+			ShaderBundleHeader header{};
+			header.magic = SHADER_BUNDLE_MAGIC;
+			header.version = SHADER_BUNDLE_VERSION;
+			header.entryCount = static_cast<uint32_t>(entries.size());
+			header.dependencyCount = static_cast<uint32_t>(dependencies.size());
+			header.optionsHash = hashShaderCompileOptions(options);
+			header.entriesOffset = alignUp(sizeof(ShaderBundleHeader), alignof(ShaderBundleEntry));
+			header.dependenciesOffset = alignUp(header.entriesOffset + entries.size() * sizeof(ShaderBundleEntry), alignof(ShaderBundleDependency));
+			header.stringsOffset = header.dependenciesOffset + dependencies.size() * sizeof(ShaderBundleDependency);
+			header.stringsSize = strings.size();
+
+			uint64_t offset = header.stringsOffset + header.stringsSize;
+			for (size_t i = 0; i < entries.size(); ++i)
+			{
+				offset = alignUp(offset, SHADER_BUNDLE_ALIGNMENT);
+				entries[i].spirvOffset = offset;
+				entries[i].spirvSize = blobs[i]->size() * sizeof(uint32_t);
+				offset += entries[i].spirvSize;
+			}
+
+			std::vector<uint8_t> bundle(offset, 0);
+			std::memcpy(bundle.data(), &header, sizeof(header));
+			std::memcpy(bundle.data() + header.entriesOffset, entries.data(), entries.size() * sizeof(ShaderBundleEntry));
+			std::memcpy(bundle.data() + header.dependenciesOffset, dependencies.data(), dependencies.size() * sizeof(ShaderBundleDependency));
+			std::memcpy(bundle.data() + header.stringsOffset, strings.data(), strings.size());
+			for (size_t i = 0; i < entries.size(); ++i)
+			{
+				std::memcpy(bundle.data() + entries[i].spirvOffset, blobs[i]->data(), entries[i].spirvSize);
+			}
+
+			return writeFileAtomic(path, bundle.data(), bundle.size());
+		}
+
+		ResultValue<LoadedShaderProgram> loadShaderProgram(const ShaderProgramSources &sources,
+		                                                   const ShaderCompileOptions &options,
+		                                                   const ShaderBundle *bundle)
+		{
+			auto start = std::chrono::steady_clock::now();
+
+			if (bundle && bundle->isOpen())
+			{
+				LoadedShaderProgram program;
+				program.fromBundle = true;
+				std::string staleReason;
+
+				if (bundle->getOptionsHash() != hashShaderCompileOptions(options))
+				{
+					staleReason = "it was compiled with different options";
+				}
+
+				for (const auto &[source, language] : sources)
+				{
+					if (!staleReason.empty())
+					{
+						break;
+					}
+
+					auto entry = bundle->findEntry(source, language);
+					if (!entry)
+					{
+						staleReason = source.string() + " isn't in it";
+					}
+					else if (!bundle->isUpToDate(*entry))
+					{
+						staleReason = source.string() + " changed since it was built";
+					}
+					else
+					{
+						program.spirv.push_back(bundle->getSpirv(*entry));
+						for (const auto &edge : bundle->getDependencies(*entry).edges)
+						{
+							program.dependencies.add(edge);
+						}
+					}
+				}
+
+				if (staleReason.empty())
+				{
+					auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+					std::cout << "Loaded " << sources.size() << " shaders from bundle in " << elapsed.count() << "ms" << std::endl;
+					return program;
+				}
+
+				std::cout << "Not using shader bundle " << bundle->getConfig().path.string() << ", " << staleReason << std::endl;
+			}
+
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(compileShaderProgram(sources, options), auto compiled);
+
+			LoadedShaderProgram program;
+			program.dependencies = std::move(compiled.dependencies);
+			program.compiledSpirv = std::move(compiled.spirv);
+			for (const auto &spirv : program.compiledSpirv)
+			{
+				program.spirv.emplace_back(spirv);
+			}
+
+			return program;
+		}
+
+		ResultValue<vk::UniqueShaderModule> createShaderModule(Device &device, std::span<const uint32_t> spirv)
+		{
+			vk::ShaderModuleCreateInfo moduleInfo{};
+			moduleInfo.setCodeSize(spirv.size_bytes());
+			moduleInfo.setPCode(spirv.data());
+
+			VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+			    device.getDevice().createShaderModuleUnique(moduleInfo, nullptr, device.getDispatcher()),
+			    auto module, "Couldn't create shader module: ");
+
+			return module;
+		}
+	}
+}
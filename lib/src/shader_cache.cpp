@@ -0,0 +1,320 @@
+#include "shader_cache.hpp"
+#include "utils.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace Vulkan
+{
+	constexpr uint32_t SHADER_CACHE_MAGIC = 0x43535056; // "VPSC"
+	constexpr uint32_t SHADER_CACHE_VERSION = 2;
+	constexpr const char *SHADER_CACHE_EXTENSION = ".spvcache";
+
+	struct ShaderCacheEntryHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint64_t payloadChecksum;
+		uint32_t stageCount;
+		uint32_t payloadSize;
+	};
+
+	VulkanResult ShaderCache::createShaderCache(const ShaderCacheConfig &_config)
+	{
+		config = _config;
+
+		std::error_code error;
+		std::filesystem::create_directories(config.directory, error);
+		if (error)
+		{
+			return VulkanResult::BadUsage("Couldn't create shader cache directory " + config.directory.string() + ": " + error.message());
+		}
+
+		return evict();
+	}
+
+	std::filesystem::path ShaderCache::entryPath(uint64_t key) const
+	{
+		std::ostringstream name;
+		name << std::hex << std::setw(16) << std::setfill('0') << key << SHADER_CACHE_EXTENSION;
+		return config.directory / name.str();
+	}
+
+	struct ShaderCachePayloadReader
+	{
+		const char *data;
+		size_t size;
+		size_t offset = 0;
+
+		bool read(void *destination, size_t count)
+		{
+			if (offset + count > size)
+			{
+				return false;
+			}
+			std::memcpy(destination, data + offset, count);
+			offset += count;
+			return true;
+		}
+
+		bool readPath(std::filesystem::path &path)
+		{
+			uint32_t length;
+			if (!read(&length, sizeof(length)) || offset + length > size)
+			{
+				return false;
+			}
+			path = std::filesystem::path(std::u8string(reinterpret_cast<const char8_t *>(data + offset), length));
+			offset += length;
+			return true;
+		}
+	};
+
+	struct ShaderCachePayloadWriter
+	{
+		std::vector<char> data = {};
+
+		void write(const void *source, size_t count)
+		{
+			auto offset = data.size();
+			data.resize(offset + count);
+			std::memcpy(data.data() + offset, source, count);
+		}
+
+		void writePath(const std::filesystem::path &path)
+		{
+			auto string = path.u8string();
+			uint32_t length = static_cast<uint32_t>(string.size());
+			write(&length, sizeof(length));
+			write(string.data(), string.size());
+		}
+	};
+
+	std::optional<ShaderCacheEntry> ShaderCache::load(uint64_t key)
+	{
+		std::lock_guard lock(mutex);
+		auto path = entryPath(key);
+
+		auto contents = Utils::readBinaryFile(path);
+		if (!contents.has_value())
+		{
+			++stats.misses;
+			return std::nullopt;
+		}
+
+		auto corrupted = [&]() -> std::optional<ShaderCacheEntry>
+		{
+			std::cerr << "Shader cache entry " << path.string() << " is corrupted, discarding it" << std::endl;
+			std::error_code ignored;
+			std::filesystem::remove(path, ignored);
+			++stats.corruptedEntries;
+			++stats.misses;
+			return std::nullopt;
+		};
+
+		ShaderCacheEntryHeader header{};
+		if (contents->size() < sizeof(header))
+		{
+			return corrupted();
+		}
+
+		std::memcpy(&header, contents->data(), sizeof(header));
+		ShaderCachePayloadReader reader{
+		    .data = contents->data() + sizeof(header),
+		    .size = contents->size() - sizeof(header),
+		};
+
+		if (header.magic != SHADER_CACHE_MAGIC || header.version != SHADER_CACHE_VERSION || header.key != key ||
+		    header.payloadSize != reader.size ||
+		    header.payloadChecksum != Utils::hashBytes(reader.data, reader.size))
+		{
+			return corrupted();
+		}
+
+		ShaderCacheEntry entry{};
+		entry.spirv.resize(header.stageCount);
+		for (auto &stage : entry.spirv)
+		{
+			uint32_t wordCount;
+			if (!reader.read(&wordCount, sizeof(wordCount)) || wordCount > reader.size / sizeof(uint32_t))
+			{
+				return corrupted();
+			}
+			stage.resize(wordCount);
+			if (!reader.read(stage.data(), wordCount * sizeof(uint32_t)))
+			{
+				return corrupted();
+			}
+		}
+
+		uint32_t dependencyCount;
+		if (!reader.read(&dependencyCount, sizeof(dependencyCount)))
+		{
+			return corrupted();
+		}
+
+		for (uint32_t i = 0; i < dependencyCount; ++i)
+		{
+			ShaderDependency dependency{};
+			if (!reader.readPath(dependency.includer) || !reader.readPath(dependency.path) ||
+			    !reader.read(&dependency.contentHash, sizeof(dependency.contentHash)))
+			{
+				return corrupted();
+			}
+			entry.dependencies.edges.push_back(std::move(dependency));
+		}
+
+		if (!entry.dependencies.isUpToDate())
+		{
+			// not corrupted, the next store for this key simply replaces it
+			++stats.staleEntries;
+			++stats.misses;
+			return std::nullopt;
+		}
+
+		// bump the modification time so eviction treats it as recently used
+		std::error_code ignored;
+		std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ignored);
+
+		++stats.hits;
+		return entry;
+	}
+
+	VulkanResult ShaderCache::store(uint64_t key, const ShaderCacheEntry &entry)
+	{
+		ShaderCachePayloadWriter payload{};
+		for (const auto &stage : entry.spirv)
+		{
+			uint32_t wordCount = static_cast<uint32_t>(stage.size());
+			payload.write(&wordCount, sizeof(wordCount));
+			payload.write(stage.data(), stage.size() * sizeof(uint32_t));
+		}
+
+		uint32_t dependencyCount = static_cast<uint32_t>(entry.dependencies.edges.size());
+		payload.write(&dependencyCount, sizeof(dependencyCount));
+		for (const auto &dependency : entry.dependencies.edges)
+		{
+			payload.writePath(dependency.includer);
+			payload.writePath(dependency.path);
+			payload.write(&dependency.contentHash, sizeof(dependency.contentHash));
+		}
+
+		ShaderCacheEntryHeader header{
+		    .magic = SHADER_CACHE_MAGIC,
+		    .version = SHADER_CACHE_VERSION,
+		    .key = key,
+		    .payloadChecksum = Utils::hashBytes(payload.data.data(), payload.data.size()),
+		    .stageCount = static_cast<uint32_t>(entry.spirv.size()),
+		    .payloadSize = static_cast<uint32_t>(payload.data.size()),
+		};
+
+		std::vector<char> contents(sizeof(header) + payload.data.size());
+		std::memcpy(contents.data(), &header, sizeof(header));
+		std::memcpy(contents.data() + sizeof(header), payload.data.data(), payload.data.size());
+
+		{
+			std::lock_guard lock(mutex);
+			LIB_QUICK_BAIL(Utils::writeFileAtomic(entryPath(key), contents.data(), contents.size()));
+			++stats.writes;
+		}
+
+		return evict();
+	}
+
+	VulkanResult ShaderCache::evict()
+	{
+		std::lock_guard lock(mutex);
+
+		struct Entry
+		{
+			std::filesystem::path path;
+			std::filesystem::file_time_type lastUse;
+			uintmax_t size;
+		};
+
+		std::vector<Entry> entries;
+		uintmax_t totalSize = 0;
+
+		std::error_code error;
+		for (const auto &file : std::filesystem::directory_iterator{config.directory, error})
+		{
+			if (file.path().extension() != SHADER_CACHE_EXTENSION)
+			{
+				continue;
+			}
+
+			std::error_code fileError;
+			auto size = file.file_size(fileError);
+			auto lastUse = file.last_write_time(fileError);
+			if (fileError)
+			{
+				continue;
+			}
+
+			entries.push_back({file.path(), lastUse, size});
+			totalSize += size;
+		}
+
+		if (error)
+		{
+			return VulkanResult::BadUsage("Couldn't list shader cache directory " + config.directory.string() + ": " + error.message());
+		}
+
+		if (totalSize <= config.maxSizeBytes)
+		{
+			return VulkanResult::Success();
+		}
+
+		std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+		          { return a.lastUse < b.lastUse; });
+
+		for (const auto &entry : entries)
+		{
+			if (totalSize <= config.maxSizeBytes)
+			{
+				break;
+			}
+
+			std::error_code removeError;
+			if (std::filesystem::remove(entry.path, removeError))
+			{
+				totalSize -= entry.size;
+				++stats.evictions;
+			}
+		}
+
+		return VulkanResult::Success();
+	}
+
+	VulkanResult ShaderCache::clear()
+	{
+		std::lock_guard lock(mutex);
+
+		std::error_code error;
+		for (const auto &file : std::filesystem::directory_iterator{config.directory, error})
+		{
+			if (file.path().extension() == SHADER_CACHE_EXTENSION)
+			{
+				std::error_code ignored;
+				std::filesystem::remove(file.path(), ignored);
+			}
+		}
+
+		if (error)
+		{
+			return VulkanResult::BadUsage("Couldn't list shader cache directory " + config.directory.string() + ": " + error.message());
+		}
+
+		return VulkanResult::Success();
+	}
+
+	ShaderCacheStats ShaderCache::getStats()
+	{
+		std::lock_guard lock(mutex);
+		return stats;
+	}
+}
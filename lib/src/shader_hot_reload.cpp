@@ -0,0 +1,391 @@
+#include "shader_hot_reload.hpp"
+#include "pipeline_state_cache.hpp"
+#include "vulkan.hpp"
+
+#include <map>
+#include <set>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace Vulkan
+{
+	ShaderWatcher::~ShaderWatcher()
+	{
+		stop();
+	}
+
+	VulkanResult ShaderWatcher::createShaderWatcher(const ShaderWatcherConfig &_config)
+	{
+		config = _config;
+		stopping = false;
+
+		if (!std::filesystem::is_directory(config.directory))
+		{
+			return VulkanResult::BadUsage("Can't watch " + config.directory.string() + ", it isn't a directory");
+		}
+
+#ifdef __linux__
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyFd < 0)
+		{
+			return VulkanResult::BadUsage("Couldn't initialize inotify");
+		}
+
+		constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+		auto addWatch = [this](const std::filesystem::path &directory)
+		{
+			int wd = inotify_add_watch(inotifyFd, directory.c_str(), mask);
+			if (wd >= 0)
+			{
+				watches[wd] = directory;
+			}
+		};
+
+		addWatch(config.directory);
+
+		std::error_code error;
+		for (const auto &entry : std::filesystem::recursive_directory_iterator{config.directory, error})
+		{
+			if (entry.is_directory())
+			{
+				addWatch(entry.path());
+			}
+		}
+#endif
+
+		thread = std::thread([this]()
+		                     { watchLoop(); });
+
+		return VulkanResult::Success();
+	}
+
+	void ShaderWatcher::stop()
+	{
+		stopping = true;
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+
+#ifdef __linux__
+		if (inotifyFd >= 0)
+		{
+			close(inotifyFd);
+			inotifyFd = -1;
+		}
+		watches.clear();
+#endif
+	}
+
+#ifdef __linux__
+	void ShaderWatcher::watchLoop()
+	{
+		if (config.onThreadStart)
+		{
+			config.onThreadStart();
+		}
+
+		alignas(inotify_event) char buffer[4096];
+		std::set<std::filesystem::path> changed;
+		auto lastEvent = std::chrono::steady_clock::now();
+
+		while (!stopping)
+		{
+			pollfd fd{inotifyFd, POLLIN, 0};
+			// wake up regularly to notice stop() and to flush debounced changes
+			poll(&fd, 1, static_cast<int>(config.debounce.count()));
+
+			ssize_t length;
+			while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+			{
+				for (char *ptr = buffer; ptr < buffer + length;)
+				{
+					auto event = reinterpret_cast<const inotify_event *>(ptr);
+					ptr += sizeof(inotify_event) + event->len;
+
+					if (event->len == 0 || !watches.contains(event->wd))
+					{
+						continue;
+					}
+
+					auto path = watches[event->wd] / event->name;
+					if (event->mask & IN_ISDIR)
+					{
+						if (event->mask & IN_CREATE)
+						{
+							int wd = inotify_add_watch(inotifyFd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+							if (wd >= 0)
+							{
+								watches[wd] = path;
+							}
+						}
+						continue;
+					}
+
+					// IN_CREATE alone is followed by an IN_CLOSE_WRITE once the content is there
+					if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+					{
+						changed.insert(path);
+						lastEvent = std::chrono::steady_clock::now();
+					}
+				}
+			}
+
+			if (!changed.empty() && std::chrono::steady_clock::now() - lastEvent >= config.debounce)
+			{
+				if (config.onChange)
+				{
+					config.onChange(std::vector<std::filesystem::path>(changed.begin(), changed.end()));
+				}
+				changed.clear();
+			}
+		}
+
+		if (config.onThreadStop)
+		{
+			config.onThreadStop();
+		}
+	}
+#else
+	void ShaderWatcher::watchLoop()
+	{
+		if (config.onThreadStart)
+		{
+			config.onThreadStart();
+		}
+
+		auto snapshot = [this]()
+		{
+			std::map<std::filesystem::path, std::filesystem::file_time_type> files;
+			std::error_code error;
+			for (const auto &entry : std::filesystem::recursive_directory_iterator{config.directory, error})
+			{
+				std::error_code fileError;
+				if (entry.is_regular_file(fileError))
+				{
+					auto time = entry.last_write_time(fileError);
+					if (!fileError)
+					{
+						files[entry.path()] = time;
+					}
+				}
+			}
+			return files;
+		};
+
+		auto previous = snapshot();
+		auto pollInterval = std::max(config.debounce, std::chrono::milliseconds(250));
+
+		while (!stopping)
+		{
+			std::this_thread::sleep_for(pollInterval);
+
+			auto current = snapshot();
+			std::vector<std::filesystem::path> changed;
+			for (const auto &[path, time] : current)
+			{
+				auto old = previous.find(path);
+				if (old == previous.end() || old->second != time)
+				{
+					changed.push_back(path);
+				}
+			}
+			previous = std::move(current);
+
+			if (!changed.empty() && config.onChange)
+			{
+				config.onChange(changed);
+			}
+		}
+
+		if (config.onThreadStop)
+		{
+			config.onThreadStop();
+		}
+	}
+#endif
+
+	VulkanResult PipelineHotReloader::createPipelineHotReloader(const PipelineHotReloaderConfig &_config)
+	{
+		config = _config;
+
+		auto threadConfig = Utils::shaderCompilerThreadPoolConfig();
+
+		return watcher.createShaderWatcher({
+		    .directory = config.directory,
+		    .debounce = std::chrono::milliseconds(50),
+		    .onChange = [this](const std::vector<std::filesystem::path> &changedFiles)
+		    { onShadersChanged(changedFiles); },
+		    .onThreadStart = threadConfig.onThreadStart,
+		    .onThreadStop = threadConfig.onThreadStop,
+		});
+	}
+
+	void PipelineHotReloader::stop()
+	{
+		watcher.stop();
+	}
+
+	void PipelineHotReloader::addProgram(GraphicsPipeline *pipeline, Utils::ShaderProgramSources sources, ShaderDependencyGraph dependencies)
+	{
+		std::lock_guard lock(mutex);
+		programs.push_back({
+		    .pipeline = pipeline,
+		    .sources = std::move(sources),
+		    .dependencies = std::move(dependencies),
+		    .pipelineConfig = pipeline->getPipelineConfig(),
+		    .modules = {},
+		});
+	}
+
+	void PipelineHotReloader::onShadersChanged(const std::vector<std::filesystem::path> &changedFiles)
+	{
+		auto detectedAt = std::chrono::steady_clock::now();
+
+		std::vector<size_t> affected;
+		{
+			std::lock_guard lock(mutex);
+			for (size_t i = 0; i < programs.size(); ++i)
+			{
+				auto &program = programs[i];
+				bool isAffected = false;
+				for (const auto &file : changedFiles)
+				{
+					std::error_code error;
+					isAffected = isAffected || program.dependencies.dependsOn(file);
+					for (const auto &source : program.sources)
+					{
+						isAffected = isAffected || std::filesystem::equivalent(source.first, file, error);
+					}
+				}
+
+				if (isAffected)
+				{
+					affected.push_back(i);
+				}
+			}
+		}
+
+		for (auto programIndex : affected)
+		{
+			auto result = rebuild(programIndex, detectedAt);
+			if (result.type() != VulkanResultVariants::Success)
+			{
+				// keep rendering with the previous pipeline until the shader is fixed
+				std::cerr << "Shader hot reload failed: " << result.description() << std::endl;
+			}
+		}
+	}
+
+	VulkanResult PipelineHotReloader::rebuild(size_t programIndex, std::chrono::steady_clock::time_point detectedAt)
+	{
+		Utils::ShaderProgramSources sources;
+		GraphicsPipelineConfig pipelineConfig;
+		{
+			std::lock_guard lock(mutex);
+			sources = programs[programIndex].sources;
+			pipelineConfig = programs[programIndex].pipelineConfig;
+		}
+
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::compileShaderProgram(sources, config.compileOptions), auto compiled);
+
+		std::vector<vk::UniqueShaderModule> modules;
+		for (size_t i = 0; i < sources.size(); ++i)
+		{
+			vk::ShaderModuleCreateInfo moduleInfo{};
+			moduleInfo.setCode(compiled.spirv[i]);
+
+			VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+			    config.device->getDevice().createShaderModuleUnique(moduleInfo, nullptr, config.device->getDispatcher()),
+			    auto module, "Couldn't create shader module for " + sources[i].first.string() + ": ");
+
+			auto stage = Utils::shaderStageFromLanguage(sources[i].second);
+			pipelineConfig.shaderHashes.resize(pipelineConfig.shaderStages.size());
+			for (size_t j = 0; j < pipelineConfig.shaderStages.size(); ++j)
+			{
+				if (pipelineConfig.shaderStages[j].stage == stage)
+				{
+					pipelineConfig.shaderStages[j].setModule(module.get());
+					pipelineConfig.shaderHashes[j] = Utils::hashSpirv(compiled.spirv[i]);
+				}
+			}
+
+			modules.push_back(std::move(module));
+		}
+
+		GraphicsPipeline pipeline;
+		LIB_QUICK_BAIL(pipeline.createGraphicsPipeline(pipelineConfig));
+
+		std::lock_guard lock(mutex);
+
+		// a newer edit supersedes a reload that wasn't swapped in yet
+		std::erase_if(pending, [programIndex](const PendingReload &reload)
+		              { return reload.program == programIndex; });
+
+		pending.push_back({
+		    .program = programIndex,
+		    .pipeline = std::move(pipeline),
+		    .dependencies = std::move(compiled.dependencies),
+		    .pipelineConfig = std::move(pipelineConfig),
+		    .modules = std::move(modules),
+		    .detectedAt = detectedAt,
+		});
+
+		return VulkanResult::Success();
+	}
+
+	uint32_t PipelineHotReloader::applyPendingReloads(uint64_t frameNumber)
+	{
+		std::unique_lock lock(mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+		{
+			// the watcher thread is publishing, pick it up next frame instead of stalling this one
+			return 0;
+		}
+
+		std::set<PipelineStateCache *> stateCaches;
+		std::erase_if(retired, [this, frameNumber, &stateCaches](RetiredPipeline &pipeline)
+		              {
+			if (pipeline.retiredAt + config.framesInFlight > frameNumber)
+			{
+				return false;
+			}
+			if (pipeline.pipeline.getPipelineConfig().stateCache)
+			{
+				stateCaches.insert(pipeline.pipeline.getPipelineConfig().stateCache);
+			}
+			return true; });
+
+		// the state cache still references pipelines built from the old shaders
+		for (auto stateCache : stateCaches)
+		{
+			stateCache->releaseUnused();
+		}
+
+		uint32_t swapped = 0;
+		for (auto &reload : pending)
+		{
+			auto &program = programs[reload.program];
+
+			std::swap(*program.pipeline, reload.pipeline);
+			retired.push_back({frameNumber, std::move(reload.pipeline)});
+
+			program.dependencies = std::move(reload.dependencies);
+			program.pipelineConfig = std::move(reload.pipelineConfig);
+			program.modules = std::move(reload.modules);
+
+			auto latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - reload.detectedAt);
+			std::cout << "Hot reloaded pipeline for " << program.sources.front().first.string() << " in " << latency.count() << "ms" << std::endl;
+
+			++swapped;
+		}
+		pending.clear();
+
+		return swapped;
+	}
+}
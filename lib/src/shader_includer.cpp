@@ -0,0 +1,124 @@
+#include "shader_includer.hpp"
+#include "utils.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+
+namespace Vulkan
+{
+	static std::filesystem::path normalizeShaderPath(const std::filesystem::path &path)
+	{
+		std::error_code error;
+		auto canonical = std::filesystem::weakly_canonical(path, error);
+		return error ? path.lexically_normal() : canonical;
+	}
+
+	void ShaderDependencyGraph::add(ShaderDependency dependency)
+	{
+		auto existing = std::find_if(edges.begin(), edges.end(), [&dependency](const ShaderDependency &edge)
+		                             { return edge.includer == dependency.includer && edge.path == dependency.path; });
+
+		if (existing == edges.end())
+		{
+			edges.push_back(std::move(dependency));
+		}
+	}
+
+	std::set<std::filesystem::path> ShaderDependencyGraph::files() const
+	{
+		std::set<std::filesystem::path> result;
+		for (const auto &edge : edges)
+		{
+			result.insert(edge.path);
+		}
+		return result;
+	}
+
+	bool ShaderDependencyGraph::dependsOn(const std::filesystem::path &file) const
+	{
+		auto normalized = normalizeShaderPath(file);
+		return std::any_of(edges.begin(), edges.end(), [&normalized](const ShaderDependency &edge)
+		                   { return edge.path == normalized || edge.includer == normalized; });
+	}
+
+	bool ShaderDependencyGraph::isUpToDate() const
+	{
+		for (const auto &file : files())
+		{
+			auto edge = std::find_if(edges.begin(), edges.end(), [&file](const ShaderDependency &edge)
+			                         { return edge.path == file; });
+
+			auto contents = Utils::readBinaryFile(file);
+			if (!contents.has_value() || Utils::hashBytes(contents->data(), contents->size()) != edge->contentHash)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	ShaderIncluder::ShaderIncluder(std::vector<std::filesystem::path> _includeDirectories)
+	    : includeDirectories{std::move(_includeDirectories)}
+	{
+	}
+
+	glslang::TShader::Includer::IncludeResult *ShaderIncluder::includeSystem(const char *headerName, const char *includerName, size_t)
+	{
+		for (const auto &directory : includeDirectories)
+		{
+			auto candidate = directory / headerName;
+			if (std::filesystem::is_regular_file(candidate))
+			{
+				return include(candidate, includerName);
+			}
+		}
+
+		return nullptr;
+	}
+
+	glslang::TShader::Includer::IncludeResult *ShaderIncluder::includeLocal(const char *headerName, const char *includerName, size_t inclusionDepth)
+	{
+		if (includerName && *includerName)
+		{
+			auto candidate = std::filesystem::path(includerName).parent_path() / headerName;
+			if (std::filesystem::is_regular_file(candidate))
+			{
+				return include(candidate, includerName);
+			}
+		}
+
+		return includeSystem(headerName, includerName, inclusionDepth);
+	}
+
+	glslang::TShader::Includer::IncludeResult *ShaderIncluder::include(const std::filesystem::path &path, const char *includerName)
+	{
+		auto contents = Utils::readBinaryFile(path);
+		if (!contents.has_value())
+		{
+			return nullptr;
+		}
+
+		auto normalized = normalizeShaderPath(path);
+
+		dependencies.add({
+		    .includer = normalizeShaderPath(includerName ? includerName : ""),
+		    .path = normalized,
+		    .contentHash = Utils::hashBytes(contents->data(), contents->size()),
+		});
+
+		// the include name is what glslang hands back as includerName for nested includes,
+		// so it has to be a path the nested include can be resolved against.
+		auto data = new std::vector<char>(std::move(contents.value()));
+		return new IncludeResult(normalized.string(), data->data(), data->size(), data);
+	}
+
+	void ShaderIncluder::releaseInclude(IncludeResult *result)
+	{
+		if (result)
+		{
+			delete static_cast<std::vector<char> *>(result->userData);
+			delete result;
+		}
+	}
+}
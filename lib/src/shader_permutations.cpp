@@ -0,0 +1,183 @@
+#include "shader_permutations.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Vulkan
+{
+	VulkanResult ShaderPermutationFamily::createShaderPermutationFamily(const ShaderPermutationFamilyConfig &_config)
+	{
+		config = _config;
+		variants.clear();
+		modules.clear();
+		featureOffsets.clear();
+		validBits = 0;
+
+		if (config.sources.empty())
+		{
+			return VulkanResult::BadUsage("A shader permutation family needs at least one source");
+		}
+
+		uint32_t offset = 0;
+		for (const auto &feature : config.features)
+		{
+			if (feature.bitCount == 0 || feature.bitCount > 32 || offset + feature.bitCount > 64)
+			{
+				return VulkanResult::BadUsage("Shader feature " + feature.name + " doesn't fit in a 64 bit permutation key");
+			}
+
+			featureOffsets.push_back(offset);
+			offset += feature.bitCount;
+		}
+		validBits = offset == 64 ? ~PermutationKey(0) : (PermutationKey(1) << offset) - 1;
+
+		auto start = std::chrono::steady_clock::now();
+
+		LIB_SET_AND_BAIL_RESULT_VALUE(Utils::compileShaderProgram(config.sources, config.compileOptions), program);
+		LIB_SET_AND_BAIL_RESULT_VALUE(Utils::reflectProgram(program.spirv), reflection);
+
+		for (const auto &feature : config.features)
+		{
+			auto constant = std::find_if(reflection.specializationConstants.begin(), reflection.specializationConstants.end(), [&feature](const auto &constant)
+			                             { return constant.constantId == feature.constantId; });
+
+			if (constant == reflection.specializationConstants.end())
+			{
+				// the optimizer drops constants nothing reads, the feature just has no effect then
+				std::cerr << "Shader feature " << feature.name << " (constant_id = " << feature.constantId << ") isn't used by " << config.sources.front().first.string() << std::endl;
+				continue;
+			}
+
+			if (constant->size != sizeof(uint32_t))
+			{
+				return VulkanResult::BadUsage("Shader feature " + feature.name + " must be a 32 bit bool, int or uint constant");
+			}
+		}
+
+		config.pipelineConfig.device = config.device;
+		config.pipelineConfig.shaderStages.clear();
+		config.pipelineConfig.shaderHashes.clear();
+
+		size_t spirvBytes = 0;
+		for (size_t i = 0; i < config.sources.size(); ++i)
+		{
+			vk::ShaderModuleCreateInfo moduleInfo{};
+			moduleInfo.setCode(program.spirv[i]);
+
+			VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+			    config.device->getDevice().createShaderModuleUnique(moduleInfo, nullptr, config.device->getDispatcher()),
+			    auto module, "Couldn't create shader module for " + config.sources[i].first.string() + ": ");
+
+			vk::PipelineShaderStageCreateInfo stageInfo{};
+			stageInfo.setStage(Utils::shaderStageFromLanguage(config.sources[i].second));
+			stageInfo.setModule(module.get());
+			stageInfo.setPName("main");
+			config.pipelineConfig.shaderStages.push_back(stageInfo);
+			config.pipelineConfig.shaderHashes.push_back(Utils::hashSpirv(program.spirv[i]));
+
+			spirvBytes += program.spirv[i].size() * sizeof(uint32_t);
+			modules.push_back(std::move(module));
+		}
+
+		if (config.layoutCache)
+		{
+			LIB_QUICK_BAIL(Utils::applyReflection(config.pipelineConfig, reflection, *config.layoutCache));
+		}
+
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+		std::cout << "Created permutation family " << config.sources.front().first.string() << ": "
+		          << config.features.size() << " features (" << offset << " key bits), "
+		          << spirvBytes << " bytes of SPIR-V in " << elapsed.count() << "ms" << std::endl;
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<PermutationKey> ShaderPermutationFamily::makeKey(const std::unordered_map<std::string, uint32_t> &featureValues) const
+	{
+		PermutationKey key = 0;
+		size_t used = 0;
+		for (size_t i = 0; i < config.features.size(); ++i)
+		{
+			const auto &feature = config.features[i];
+			auto value = featureValues.find(feature.name);
+			if (value == featureValues.end())
+			{
+				continue;
+			}
+
+			if (feature.bitCount < 32 && value->second >= (1u << feature.bitCount))
+			{
+				return VulkanResult::BadUsage("Value " + std::to_string(value->second) + " doesn't fit in the " + std::to_string(feature.bitCount) + " bits of shader feature " + feature.name);
+			}
+
+			key |= PermutationKey(value->second) << featureOffsets[i];
+			++used;
+		}
+
+		if (used != featureValues.size())
+		{
+			return VulkanResult::BadUsage("Unknown shader feature in permutation of " + config.sources.front().first.string());
+		}
+
+		return key;
+	}
+
+	ResultValue<GraphicsPipeline *> ShaderPermutationFamily::getVariant(PermutationKey key)
+	{
+		if ((key & ~validBits) != 0)
+		{
+			return VulkanResult::BadUsage("Permutation key sets bits that aren't mapped to a shader feature");
+		}
+
+		// creation happens under the lock, two threads asking for the same new variant only build it once
+		std::lock_guard lock(mutex);
+
+		auto existing = variants.find(key);
+		if (existing != variants.end())
+		{
+			return &existing->second->pipeline;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		auto variant = std::make_unique<Variant>();
+		for (size_t i = 0; i < config.features.size(); ++i)
+		{
+			const auto &feature = config.features[i];
+			PermutationKey mask = (PermutationKey(1) << feature.bitCount) - 1;
+
+			variant->mapEntries.push_back({feature.constantId, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t)});
+			variant->data.push_back(static_cast<uint32_t>((key >> featureOffsets[i]) & mask));
+		}
+
+		// one info for every stage, entries for constants a stage doesn't declare are ignored
+		variant->specializationInfo.setMapEntries(variant->mapEntries);
+		variant->specializationInfo.setData<uint32_t>(variant->data);
+
+		// the pipeline keeps a copy of its config pointing at the variant's specialization info,
+		// which stays put because variants are heap allocated
+		auto pipelineConfig = config.pipelineConfig;
+		for (auto &stage : pipelineConfig.shaderStages)
+		{
+			stage.setPSpecializationInfo(variant->data.empty() ? nullptr : &variant->specializationInfo);
+		}
+
+		LIB_QUICK_BAIL(variant->pipeline.createGraphicsPipeline(pipelineConfig));
+
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+		std::cout << "Created variant 0x" << std::hex << key << std::dec << " of " << config.sources.front().first.string()
+		          << " in " << elapsed.count() << "ms" << std::endl;
+
+		GraphicsPipeline *pipeline = &variant->pipeline;
+		variants.emplace(key, std::move(variant));
+
+		return pipeline;
+	}
+
+	size_t ShaderPermutationFamily::getVariantCount()
+	{
+		std::lock_guard lock(mutex);
+		return variants.size();
+	}
+}
@@ -0,0 +1,801 @@
+#include "shader_reflection.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+namespace Vulkan
+{
+	// the handful of SPIR-V enums reflection needs, spelled out so we don't depend on one of
+	// the (conflicting) spirv.hpp copies shipped by glslang and SPIRV-Headers
+	namespace SpirvOp
+	{
+		constexpr uint32_t Name = 5;
+		constexpr uint32_t EntryPoint = 15;
+		constexpr uint32_t ExecutionMode = 16;
+		constexpr uint32_t TypeBool = 20;
+		constexpr uint32_t TypeInt = 21;
+		constexpr uint32_t TypeFloat = 22;
+		constexpr uint32_t TypeVector = 23;
+		constexpr uint32_t TypeMatrix = 24;
+		constexpr uint32_t TypeImage = 25;
+		constexpr uint32_t TypeSampler = 26;
+		constexpr uint32_t TypeSampledImage = 27;
+		constexpr uint32_t TypeArray = 28;
+		constexpr uint32_t TypeRuntimeArray = 29;
+		constexpr uint32_t TypeStruct = 30;
+		constexpr uint32_t TypePointer = 32;
+		constexpr uint32_t Constant = 43;
+		constexpr uint32_t SpecConstantTrue = 48;
+		constexpr uint32_t SpecConstantFalse = 49;
+		constexpr uint32_t SpecConstant = 50;
+		constexpr uint32_t SpecConstantComposite = 51;
+		constexpr uint32_t Variable = 59;
+		constexpr uint32_t Decorate = 71;
+		constexpr uint32_t MemberDecorate = 72;
+		constexpr uint32_t TypeAccelerationStructure = 5341;
+	}
+
+	namespace SpirvDecoration
+	{
+		constexpr uint32_t SpecId = 1;
+		constexpr uint32_t BufferBlock = 3;
+		constexpr uint32_t RowMajor = 4;
+		constexpr uint32_t ArrayStride = 6;
+		constexpr uint32_t MatrixStride = 7;
+		constexpr uint32_t BuiltIn = 11;
+		constexpr uint32_t Location = 30;
+		constexpr uint32_t Binding = 33;
+		constexpr uint32_t DescriptorSet = 34;
+		constexpr uint32_t Offset = 35;
+	}
+
+	namespace SpirvStorageClass
+	{
+		constexpr uint32_t UniformConstant = 0;
+		constexpr uint32_t Input = 1;
+		constexpr uint32_t Uniform = 2;
+		constexpr uint32_t PushConstant = 9;
+		constexpr uint32_t StorageBuffer = 12;
+	}
+
+	constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+	constexpr uint32_t SPIRV_EXECUTION_MODE_LOCAL_SIZE = 17;
+	constexpr uint32_t SPIRV_BUILTIN_WORKGROUP_SIZE = 25;
+	constexpr uint32_t SPIRV_IMAGE_DIM_BUFFER = 5;
+	constexpr uint32_t SPIRV_IMAGE_DIM_SUBPASS_DATA = 6;
+
+	struct SpirvModule
+	{
+		struct Variable
+		{
+			uint32_t id;
+			uint32_t pointerType;
+			uint32_t storageClass;
+		};
+
+		std::optional<vk::ShaderStageFlagBits> stage;
+		std::unordered_map<uint32_t, std::vector<uint32_t>> types;
+		std::unordered_map<uint32_t, uint32_t> constants;
+		std::unordered_map<uint32_t, std::unordered_map<uint32_t, uint32_t>> decorations;
+		std::map<std::pair<uint32_t, uint32_t>, std::unordered_map<uint32_t, uint32_t>> memberDecorations;
+		std::unordered_map<uint32_t, std::string> names;
+		std::vector<Variable> variables;
+		// spec constant id -> result type
+		std::unordered_map<uint32_t, uint32_t> specConstants;
+		// spec constant id -> default value, only for 32 bit and boolean constants
+		std::unordered_map<uint32_t, uint32_t> specConstantValues;
+		// composite id -> constituent ids
+		std::unordered_map<uint32_t, std::vector<uint32_t>> specConstantComposites;
+		std::optional<std::array<uint32_t, 3>> localSize;
+
+		std::optional<uint32_t> decoration(uint32_t id, uint32_t decoration) const
+		{
+			auto it = decorations.find(id);
+			if (it == decorations.end() || !it->second.contains(decoration))
+			{
+				return std::nullopt;
+			}
+			return it->second.at(decoration);
+		}
+
+		std::optional<uint32_t> memberDecoration(uint32_t id, uint32_t member, uint32_t decoration) const
+		{
+			auto it = memberDecorations.find({id, member});
+			if (it == memberDecorations.end() || !it->second.contains(decoration))
+			{
+				return std::nullopt;
+			}
+			return it->second.at(decoration);
+		}
+
+		// words of the type instruction, starting at the opcode word
+		const std::vector<uint32_t> *type(uint32_t id) const
+		{
+			auto it = types.find(id);
+			return it == types.end() ? nullptr : &it->second;
+		}
+
+		uint32_t opcode(uint32_t id) const
+		{
+			auto t = type(id);
+			return t ? (*t)[0] & 0xffff : 0;
+		}
+
+		uint32_t arrayLength(uint32_t arrayType) const
+		{
+			auto t = type(arrayType);
+			auto length = constants.find((*t)[3]);
+			return length == constants.end() ? 1 : length->second;
+		}
+
+		// byte size of a type as laid out in a block, used for push constant ranges
+		uint32_t typeSize(uint32_t id, std::optional<uint32_t> matrixStride = std::nullopt, bool rowMajor = false) const
+		{
+			auto t = type(id);
+			if (!t)
+			{
+				return 0;
+			}
+
+			switch ((*t)[0] & 0xffff)
+			{
+			case SpirvOp::TypeBool:
+				return 4;
+			case SpirvOp::TypeInt:
+			case SpirvOp::TypeFloat:
+				return (*t)[2] / 8;
+			case SpirvOp::TypeVector:
+				return (*t)[3] * typeSize((*t)[2]);
+			case SpirvOp::TypeMatrix:
+			{
+				auto columnType = type((*t)[2]);
+				uint32_t columns = (*t)[3];
+				uint32_t rows = columnType ? (*columnType)[3] : 0;
+				if (matrixStride.has_value())
+				{
+					return (rowMajor ? rows : columns) * matrixStride.value();
+				}
+				return columns * typeSize((*t)[2]);
+			}
+			case SpirvOp::TypeArray:
+			{
+				auto stride = decoration(id, SpirvDecoration::ArrayStride);
+				return arrayLength(id) * (stride.has_value() ? stride.value() : typeSize((*t)[2], matrixStride, rowMajor));
+			}
+			case SpirvOp::TypeStruct:
+			{
+				uint32_t size = 0;
+				for (uint32_t member = 0; member + 2 < t->size(); ++member)
+				{
+					auto offset = memberDecoration(id, member, SpirvDecoration::Offset).value_or(size);
+					auto memberSize = typeSize((*t)[member + 2],
+					                           memberDecoration(id, member, SpirvDecoration::MatrixStride),
+					                           memberDecoration(id, member, SpirvDecoration::RowMajor).has_value());
+					size = std::max(size, offset + memberSize);
+				}
+				return size;
+			}
+			default:
+				return 0;
+			}
+		}
+	};
+
+	static std::optional<vk::ShaderStageFlagBits> stageFromExecutionModel(uint32_t executionModel)
+	{
+		switch (executionModel)
+		{
+		case 0:
+			return vk::ShaderStageFlagBits::eVertex;
+		case 1:
+			return vk::ShaderStageFlagBits::eTessellationControl;
+		case 2:
+			return vk::ShaderStageFlagBits::eTessellationEvaluation;
+		case 3:
+			return vk::ShaderStageFlagBits::eGeometry;
+		case 4:
+			return vk::ShaderStageFlagBits::eFragment;
+		case 5:
+			return vk::ShaderStageFlagBits::eCompute;
+		default:
+			return std::nullopt;
+		}
+	}
+
+	static std::string readSpirvString(const uint32_t *words, size_t wordCount)
+	{
+		auto characters = reinterpret_cast<const char *>(words);
+		return std::string(characters, strnlen(characters, wordCount * sizeof(uint32_t)));
+	}
+
+	static ResultValue<SpirvModule> parseSpirv(std::span<const uint32_t> spirv)
+	{
+		constexpr size_t HEADER_WORDS = 5;
+
+		if (spirv.size() < HEADER_WORDS || spirv[0] != SPIRV_MAGIC)
+		{
+			return VulkanResult::BadUsage("Can't reflect shader, not a SPIR-V module");
+		}
+
+		SpirvModule module{};
+
+		for (size_t i = HEADER_WORDS; i < spirv.size();)
+		{
+			uint32_t wordCount = spirv[i] >> 16;
+			uint32_t opcode = spirv[i] & 0xffff;
+
+			if (wordCount == 0 || i + wordCount > spirv.size())
+			{
+				return VulkanResult::BadUsage("Can't reflect shader, truncated SPIR-V instruction");
+			}
+
+			const uint32_t *operands = spirv.data() + i + 1;
+
+			switch (opcode)
+			{
+			case SpirvOp::EntryPoint:
+				if (!module.stage.has_value())
+				{
+					module.stage = stageFromExecutionModel(operands[0]);
+				}
+				break;
+			case SpirvOp::ExecutionMode:
+				if (operands[1] == SPIRV_EXECUTION_MODE_LOCAL_SIZE && wordCount >= 6)
+				{
+					module.localSize = std::array<uint32_t, 3>{operands[2], operands[3], operands[4]};
+				}
+				break;
+			case SpirvOp::Name:
+				module.names[operands[0]] = readSpirvString(operands + 1, wordCount - 2);
+				break;
+			case SpirvOp::Decorate:
+				module.decorations[operands[0]][operands[1]] = wordCount > 3 ? operands[2] : 1;
+				break;
+			case SpirvOp::MemberDecorate:
+				module.memberDecorations[{operands[0], operands[1]}][operands[2]] = wordCount > 4 ? operands[3] : 1;
+				break;
+			case SpirvOp::Constant:
+				module.constants[operands[1]] = operands[2];
+				break;
+			case SpirvOp::SpecConstantTrue:
+			case SpirvOp::SpecConstantFalse:
+			case SpirvOp::SpecConstant:
+				module.specConstants[operands[1]] = operands[0];
+				if (opcode != SpirvOp::SpecConstant || wordCount == 4)
+				{
+					module.specConstantValues[operands[1]] = opcode == SpirvOp::SpecConstant ? operands[2] : opcode == SpirvOp::SpecConstantTrue;
+				}
+				break;
+			case SpirvOp::SpecConstantComposite:
+				module.specConstantComposites[operands[1]] = std::vector<uint32_t>(operands + 2, operands + wordCount - 1);
+				break;
+			case SpirvOp::Variable:
+				module.variables.push_back({
+				    .id = operands[1],
+				    .pointerType = operands[0],
+				    .storageClass = operands[2],
+				});
+				break;
+			case SpirvOp::TypeBool:
+			case SpirvOp::TypeInt:
+			case SpirvOp::TypeFloat:
+			case SpirvOp::TypeVector:
+			case SpirvOp::TypeMatrix:
+			case SpirvOp::TypeImage:
+			case SpirvOp::TypeSampler:
+			case SpirvOp::TypeSampledImage:
+			case SpirvOp::TypeArray:
+			case SpirvOp::TypeRuntimeArray:
+			case SpirvOp::TypeStruct:
+			case SpirvOp::TypePointer:
+			case SpirvOp::TypeAccelerationStructure:
+				module.types[operands[0]] = std::vector<uint32_t>(spirv.begin() + i, spirv.begin() + i + wordCount);
+				break;
+			default:
+				break;
+			}
+
+			i += wordCount;
+		}
+
+		if (!module.stage.has_value())
+		{
+			return VulkanResult::BadUsage("Can't reflect shader, no supported entry point");
+		}
+
+		return module;
+	}
+
+	static std::optional<vk::DescriptorType> descriptorType(const SpirvModule &module, uint32_t storageClass, uint32_t typeId)
+	{
+		auto type = module.type(typeId);
+		if (!type)
+		{
+			return std::nullopt;
+		}
+
+		switch (module.opcode(typeId))
+		{
+		case SpirvOp::TypeStruct:
+			if (storageClass == SpirvStorageClass::StorageBuffer ||
+			    module.decoration(typeId, SpirvDecoration::BufferBlock).has_value())
+			{
+				return vk::DescriptorType::eStorageBuffer;
+			}
+			return vk::DescriptorType::eUniformBuffer;
+		case SpirvOp::TypeSampler:
+			return vk::DescriptorType::eSampler;
+		case SpirvOp::TypeSampledImage:
+		{
+			auto image = module.type((*type)[2]);
+			if (image && (*image)[3] == SPIRV_IMAGE_DIM_BUFFER)
+			{
+				return vk::DescriptorType::eUniformTexelBuffer;
+			}
+			return vk::DescriptorType::eCombinedImageSampler;
+		}
+		case SpirvOp::TypeImage:
+		{
+			uint32_t dim = (*type)[3];
+			uint32_t sampled = (*type)[7];
+			if (dim == SPIRV_IMAGE_DIM_SUBPASS_DATA)
+			{
+				return vk::DescriptorType::eInputAttachment;
+			}
+			if (dim == SPIRV_IMAGE_DIM_BUFFER)
+			{
+				return sampled == 2 ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+			}
+			return sampled == 2 ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+		}
+		case SpirvOp::TypeAccelerationStructure:
+			return vk::DescriptorType::eAccelerationStructureKHR;
+		default:
+			return std::nullopt;
+		}
+	}
+
+	static std::optional<vk::Format> vertexFormat(const SpirvModule &module, uint32_t typeId, uint32_t &size)
+	{
+		auto type = module.type(typeId);
+		if (!type)
+		{
+			return std::nullopt;
+		}
+
+		uint32_t components = 1;
+		uint32_t scalarType = typeId;
+		if (module.opcode(typeId) == SpirvOp::TypeVector)
+		{
+			scalarType = (*type)[2];
+			components = (*type)[3];
+		}
+
+		auto scalar = module.type(scalarType);
+		if (!scalar)
+		{
+			return std::nullopt;
+		}
+
+		uint32_t width = (*scalar)[2];
+		size = components * width / 8;
+
+		constexpr vk::Format floats[] = {vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat};
+		constexpr vk::Format doubles[] = {vk::Format::eR64Sfloat, vk::Format::eR64G64Sfloat, vk::Format::eR64G64B64Sfloat, vk::Format::eR64G64B64A64Sfloat};
+		constexpr vk::Format ints[] = {vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint};
+		constexpr vk::Format uints[] = {vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint};
+
+		if (components < 1 || components > 4)
+		{
+			return std::nullopt;
+		}
+
+		switch (module.opcode(scalarType))
+		{
+		case SpirvOp::TypeFloat:
+			if (width == 64)
+			{
+				return doubles[components - 1];
+			}
+			return width == 32 ? std::optional(floats[components - 1]) : std::nullopt;
+		case SpirvOp::TypeInt:
+			if (width != 32)
+			{
+				return std::nullopt;
+			}
+			return (*scalar)[3] ? ints[components - 1] : uints[components - 1];
+		default:
+			return std::nullopt;
+		}
+	}
+
+	VulkanResult ShaderReflection::merge(const ShaderReflection &other)
+	{
+		stages |= other.stages;
+
+		for (const auto &[set, bindings] : other.descriptorSets)
+		{
+			auto &ownBindings = descriptorSets[set];
+			for (const auto &binding : bindings)
+			{
+				auto existing = std::find_if(ownBindings.begin(), ownBindings.end(), [&binding](const auto &own)
+				                             { return own.binding == binding.binding; });
+
+				if (existing == ownBindings.end())
+				{
+					ownBindings.push_back(binding);
+					continue;
+				}
+
+				if (existing->descriptorType != binding.descriptorType || existing->descriptorCount != binding.descriptorCount)
+				{
+					return VulkanResult::BadUsage("Stages disagree on the type of set " + std::to_string(set) + " binding " + std::to_string(binding.binding));
+				}
+
+				existing->stageFlags |= binding.stageFlags;
+			}
+		}
+
+		if (other.pushConstants.has_value())
+		{
+			if (!pushConstants.has_value())
+			{
+				pushConstants = other.pushConstants;
+			}
+			else
+			{
+				auto begin = std::min(pushConstants->offset, other.pushConstants->offset);
+				auto end = std::max(pushConstants->offset + pushConstants->size, other.pushConstants->offset + other.pushConstants->size);
+				pushConstants->stageFlags |= other.pushConstants->stageFlags;
+				pushConstants->offset = begin;
+				pushConstants->size = end - begin;
+			}
+		}
+
+		if (!other.vertexInputs.empty())
+		{
+			vertexInputs = other.vertexInputs;
+		}
+
+		if (other.stages & vk::ShaderStageFlagBits::eCompute)
+		{
+			localSize = other.localSize;
+			localSizeConstantIds = other.localSizeConstantIds;
+		}
+
+		for (const auto &constant : other.specializationConstants)
+		{
+			auto existing = std::find_if(specializationConstants.begin(), specializationConstants.end(), [&constant](const auto &own)
+			                             { return own.constantId == constant.constantId; });
+
+			if (existing == specializationConstants.end())
+			{
+				specializationConstants.push_back(constant);
+				continue;
+			}
+
+			if (existing->size != constant.size)
+			{
+				return VulkanResult::BadUsage("Stages disagree on the size of specialization constant " + std::to_string(constant.constantId));
+			}
+
+			existing->stageFlags |= constant.stageFlags;
+		}
+
+		return VulkanResult::Success();
+	}
+
+	VulkanResult ShaderReflection::useDynamicOffsets(uint32_t set, uint32_t binding)
+	{
+		auto bindings = descriptorSets.find(set);
+		if (bindings == descriptorSets.end())
+		{
+			return VulkanResult::BadUsage("Shaders don't use descriptor set " + std::to_string(set));
+		}
+
+		auto existing = std::find_if(bindings->second.begin(), bindings->second.end(), [binding](const auto &own)
+		                             { return own.binding == binding; });
+		if (existing == bindings->second.end())
+		{
+			return VulkanResult::BadUsage("Shaders don't use binding " + std::to_string(binding) + " of set " + std::to_string(set));
+		}
+
+		switch (existing->descriptorType)
+		{
+		case vk::DescriptorType::eUniformBuffer:
+			existing->descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+			break;
+		case vk::DescriptorType::eStorageBuffer:
+			existing->descriptorType = vk::DescriptorType::eStorageBufferDynamic;
+			break;
+		case vk::DescriptorType::eUniformBufferDynamic:
+		case vk::DescriptorType::eStorageBufferDynamic:
+			break;
+		default:
+			return VulkanResult::BadUsage("Only uniform and storage buffers can use dynamic offsets");
+		}
+
+		return VulkanResult::Success();
+	}
+
+	std::vector<vk::VertexInputAttributeDescription> ShaderReflection::getVertexAttributeDescriptions(uint32_t binding) const
+	{
+		std::vector<vk::VertexInputAttributeDescription> attributes;
+		uint32_t offset = 0;
+		for (const auto &input : vertexInputs)
+		{
+			attributes.push_back({input.location, binding, input.format, offset});
+			offset += input.size;
+		}
+		return attributes;
+	}
+
+	vk::VertexInputBindingDescription ShaderReflection::getVertexBindingDescription(uint32_t binding, vk::VertexInputRate inputRate) const
+	{
+		uint32_t stride = 0;
+		for (const auto &input : vertexInputs)
+		{
+			stride += input.size;
+		}
+		return {binding, stride, inputRate};
+	}
+
+	ResultValue<std::vector<vk::DescriptorSetLayout>> ShaderReflection::getDescriptorSetLayouts(DescriptorSetLayoutCache &cache) const
+	{
+		std::vector<vk::DescriptorSetLayout> layouts;
+		if (descriptorSets.empty())
+		{
+			return layouts;
+		}
+
+		uint32_t setCount = descriptorSets.rbegin()->first + 1;
+		for (uint32_t set = 0; set < setCount; ++set)
+		{
+			auto bindings = descriptorSets.find(set);
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
+			    cache.getLayout(bindings == descriptorSets.end() ? std::vector<vk::DescriptorSetLayoutBinding>{} : bindings->second),
+			    auto layout);
+			layouts.push_back(layout);
+		}
+
+		return layouts;
+	}
+
+	std::vector<vk::PushConstantRange> ShaderReflection::getPushConstantRanges() const
+	{
+		if (!pushConstants.has_value())
+		{
+			return {};
+		}
+		return {pushConstants.value()};
+	}
+
+	namespace Utils
+	{
+		ResultValue<ShaderReflection> reflectShader(std::span<const uint32_t> spirv)
+		{
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(parseSpirv(spirv), auto module);
+
+			ShaderReflection reflection{};
+			auto stage = module.stage.value();
+			reflection.stages = stage;
+
+			for (const auto &variable : module.variables)
+			{
+				auto pointer = module.type(variable.pointerType);
+				if (!pointer || module.opcode(variable.pointerType) != SpirvOp::TypePointer)
+				{
+					continue;
+				}
+				uint32_t typeId = (*pointer)[3];
+
+				switch (variable.storageClass)
+				{
+				case SpirvStorageClass::UniformConstant:
+				case SpirvStorageClass::Uniform:
+				case SpirvStorageClass::StorageBuffer:
+				{
+					uint32_t descriptorCount = 1;
+					if (module.opcode(typeId) == SpirvOp::TypeArray)
+					{
+						descriptorCount = module.arrayLength(typeId);
+						typeId = (*module.type(typeId))[2];
+					}
+					else if (module.opcode(typeId) == SpirvOp::TypeRuntimeArray)
+					{
+						// unsized arrays, the caller has to pick the real count when it matters
+						typeId = (*module.type(typeId))[2];
+					}
+
+					auto type = descriptorType(module, variable.storageClass, typeId);
+					auto binding = module.decoration(variable.id, SpirvDecoration::Binding);
+					if (!type.has_value() || !binding.has_value())
+					{
+						continue;
+					}
+
+					auto set = module.decoration(variable.id, SpirvDecoration::DescriptorSet).value_or(0);
+
+					vk::DescriptorSetLayoutBinding layoutBinding{};
+					layoutBinding.setBinding(binding.value());
+					layoutBinding.setDescriptorType(type.value());
+					layoutBinding.setDescriptorCount(descriptorCount);
+					layoutBinding.setStageFlags(stage);
+					reflection.descriptorSets[set].push_back(layoutBinding);
+					break;
+				}
+				case SpirvStorageClass::PushConstant:
+				{
+					auto type = module.type(typeId);
+					if (!type || module.opcode(typeId) != SpirvOp::TypeStruct)
+					{
+						continue;
+					}
+
+					uint32_t begin = UINT32_MAX;
+					for (uint32_t member = 0; member + 2 < type->size(); ++member)
+					{
+						begin = std::min(begin, module.memberDecoration(typeId, member, SpirvDecoration::Offset).value_or(0));
+					}
+					if (begin == UINT32_MAX)
+					{
+						continue;
+					}
+
+					reflection.pushConstants = vk::PushConstantRange{stage, begin, module.typeSize(typeId) - begin};
+					break;
+				}
+				case SpirvStorageClass::Input:
+				{
+					if (stage != vk::ShaderStageFlagBits::eVertex ||
+					    module.decoration(variable.id, SpirvDecoration::BuiltIn).has_value())
+					{
+						continue;
+					}
+
+					auto location = module.decoration(variable.id, SpirvDecoration::Location);
+					if (!location.has_value())
+					{
+						continue;
+					}
+
+					// matrices take one location per column
+					uint32_t locationCount = 1;
+					if (module.opcode(typeId) == SpirvOp::TypeMatrix)
+					{
+						locationCount = (*module.type(typeId))[3];
+						typeId = (*module.type(typeId))[2];
+					}
+
+					uint32_t size = 0;
+					auto format = vertexFormat(module, typeId, size);
+					if (!format.has_value())
+					{
+						return VulkanResult::BadUsage("Unsupported vertex input type at location " + std::to_string(location.value()));
+					}
+
+					auto name = module.names.contains(variable.id) ? module.names.at(variable.id) : "";
+					for (uint32_t i = 0; i < locationCount; ++i)
+					{
+						reflection.vertexInputs.push_back({location.value() + i, format.value(), size, name});
+					}
+					break;
+				}
+				default:
+					break;
+				}
+			}
+
+			for (const auto &[id, typeId] : module.specConstants)
+			{
+				auto constantId = module.decoration(id, SpirvDecoration::SpecId);
+				if (!constantId.has_value())
+				{
+					// a constant derived from other spec constants, it can't be specialized directly
+					continue;
+				}
+
+				auto name = module.names.contains(id) ? module.names.at(id) : "";
+				reflection.specializationConstants.push_back({constantId.value(), module.typeSize(typeId), stage, name});
+			}
+
+			if (stage == vk::ShaderStageFlagBits::eCompute)
+			{
+				reflection.localSize = module.localSize.value_or(std::array<uint32_t, 3>{1, 1, 1});
+
+				// local_size_x_id and friends show up as a WorkgroupSize built-in made of spec constants,
+				// it takes precedence over the LocalSize execution mode
+				for (const auto &[id, constituents] : module.specConstantComposites)
+				{
+					if (module.decoration(id, SpirvDecoration::BuiltIn) != SPIRV_BUILTIN_WORKGROUP_SIZE || constituents.size() != 3)
+					{
+						continue;
+					}
+
+					for (uint32_t i = 0; i < 3; ++i)
+					{
+						auto constituent = constituents[i];
+						if (module.constants.contains(constituent))
+						{
+							reflection.localSize[i] = module.constants.at(constituent);
+							continue;
+						}
+
+						reflection.localSizeConstantIds[i] = module.decoration(constituent, SpirvDecoration::SpecId);
+						if (module.specConstantValues.contains(constituent))
+						{
+							reflection.localSize[i] = module.specConstantValues.at(constituent);
+						}
+					}
+				}
+			}
+
+			std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(), [](const auto &a, const auto &b)
+			          { return a.location < b.location; });
+
+			std::sort(reflection.specializationConstants.begin(), reflection.specializationConstants.end(), [](const auto &a, const auto &b)
+			          { return a.constantId < b.constantId; });
+
+			for (auto &[set, bindings] : reflection.descriptorSets)
+			{
+				std::sort(bindings.begin(), bindings.end(), [](const auto &a, const auto &b)
+				          { return a.binding < b.binding; });
+			}
+
+			return reflection;
+		}
+
+		ResultValue<ShaderReflection> reflectProgram(const std::vector<std::span<const uint32_t>> &spirv)
+		{
+			ShaderReflection reflection{};
+			for (const auto &module : spirv)
+			{
+				LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(reflectShader(module), auto stageReflection);
+				LIB_QUICK_BAIL(reflection.merge(stageReflection));
+			}
+
+			return reflection;
+		}
+
+		ResultValue<ShaderReflection> reflectProgram(const std::vector<std::vector<uint32_t>> &spirv)
+		{
+			return reflectProgram(std::vector<std::span<const uint32_t>>(spirv.begin(), spirv.end()));
+		}
+
+		VulkanResult applyReflection(GraphicsPipelineConfig &config, const ShaderReflection &reflection, DescriptorSetLayoutCache &cache, uint32_t vertexBinding)
+		{
+			if (!reflection.vertexInputs.empty())
+			{
+				config.vertexBindingDescriptions = {reflection.getVertexBindingDescription(vertexBinding)};
+				config.vertexAttributeDescriptions = reflection.getVertexAttributeDescriptions(vertexBinding);
+			}
+			else
+			{
+				config.vertexBindingDescriptions = {};
+				config.vertexAttributeDescriptions = {};
+			}
+
+			LIB_SET_AND_BAIL_RESULT_VALUE(reflection.getDescriptorSetLayouts(cache), config.descriptorSetLayouts);
+			config.pushConstants = reflection.getPushConstantRanges();
+
+			return VulkanResult::Success();
+		}
+
+		VulkanResult applyReflection(ComputePipelineConfig &config, const ShaderReflection &reflection, DescriptorSetLayoutCache &cache)
+		{
+			if (!(reflection.stages & vk::ShaderStageFlagBits::eCompute))
+			{
+				return VulkanResult::BadUsage("Can't apply the reflection of a program without a compute stage to a compute pipeline");
+			}
+
+			LIB_SET_AND_BAIL_RESULT_VALUE(reflection.getDescriptorSetLayouts(cache), config.descriptorSetLayouts);
+			config.pushConstants = reflection.getPushConstantRanges();
+			config.localSize = reflection.localSize;
+			config.localSizeConstantIds = reflection.localSizeConstantIds;
+
+			return VulkanResult::Success();
+		}
+	}
+}
@@ -163,4 +163,64 @@ namespace Vulkan
 	{
 		return createImageViews();
 	}
+
+	void Swapchain::beginRendering(vk::CommandBuffer commandBuffer, uint32_t imageIndex, vk::ClearColorValue clearColor, vk::RenderingFlags flags)
+	{
+		auto &dispatcher = swapchainConfig.device->getDispatcher();
+
+		// the previous content is cleared anyway, undefined lets the driver skip preserving it
+		vk::ImageMemoryBarrier toAttachment{};
+		toAttachment.setSrcAccessMask({});
+		toAttachment.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite);
+		toAttachment.setOldLayout(vk::ImageLayout::eUndefined);
+		toAttachment.setNewLayout(vk::ImageLayout::eColorAttachmentOptimal);
+		toAttachment.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
+		toAttachment.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
+		toAttachment.setImage(swapchainImages[imageIndex]);
+		toAttachment.setSubresourceRange(imageViewConfig.subResourceRange);
+
+		// same stage as the image available semaphore wait, like the external subpass dependency did
+		commandBuffer.pipelineBarrier(
+		    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+		    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+		    {}, {}, {}, toAttachment, dispatcher);
+
+		vk::RenderingAttachmentInfoKHR colorAttachment{};
+		colorAttachment.setImageView(imageViews[imageIndex].get());
+		colorAttachment.setImageLayout(vk::ImageLayout::eColorAttachmentOptimal);
+		colorAttachment.setLoadOp(vk::AttachmentLoadOp::eClear);
+		colorAttachment.setStoreOp(vk::AttachmentStoreOp::eStore);
+		colorAttachment.setClearValue(clearColor);
+
+		vk::RenderingInfoKHR renderingInfo{};
+		renderingInfo.setFlags(flags);
+		renderingInfo.setRenderArea({{0, 0}, swapchainConfig.extent});
+		renderingInfo.setLayerCount(1);
+		renderingInfo.setColorAttachments(colorAttachment);
+
+		// the dispatcher falls back to vkCmdBeginRenderingKHR when the device is older than 1.3
+		commandBuffer.beginRendering(renderingInfo, dispatcher);
+	}
+
+	void Swapchain::endRendering(vk::CommandBuffer commandBuffer, uint32_t imageIndex)
+	{
+		auto &dispatcher = swapchainConfig.device->getDispatcher();
+
+		commandBuffer.endRendering(dispatcher);
+
+		vk::ImageMemoryBarrier toPresent{};
+		toPresent.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite);
+		toPresent.setDstAccessMask({});
+		toPresent.setOldLayout(vk::ImageLayout::eColorAttachmentOptimal);
+		toPresent.setNewLayout(vk::ImageLayout::ePresentSrcKHR);
+		toPresent.setSrcQueueFamilyIndex(vk::QueueFamilyIgnored);
+		toPresent.setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
+		toPresent.setImage(swapchainImages[imageIndex]);
+		toPresent.setSubresourceRange(imageViewConfig.subResourceRange);
+
+		commandBuffer.pipelineBarrier(
+		    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+		    vk::PipelineStageFlagBits::eBottomOfPipe,
+		    {}, {}, {}, toPresent, dispatcher);
+	}
 }
\ No newline at end of file
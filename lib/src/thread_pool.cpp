@@ -0,0 +1,83 @@
+#include "thread_pool.hpp"
+
+namespace Vulkan
+{
+	ThreadPool::~ThreadPool()
+	{
+		shutdown();
+	}
+
+	VulkanResult ThreadPool::createThreadPool(const ThreadPoolConfig &_config)
+	{
+		if (!workers.empty())
+		{
+			return VulkanResult::BadUsage("Thread pool was already created");
+		}
+
+		config = _config;
+		stopping = false;
+
+		uint32_t threadCount = config.threadCount;
+		if (threadCount == 0)
+		{
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			workers.emplace_back([this]()
+			                     { workerLoop(); });
+		}
+
+		return VulkanResult::Success();
+	}
+
+	void ThreadPool::shutdown()
+	{
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+
+		for (auto &worker : workers)
+		{
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	void ThreadPool::workerLoop()
+	{
+		if (config.onThreadStart)
+		{
+			config.onThreadStart();
+		}
+
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock lock(mutex);
+				condition.wait(lock, [this]()
+				               { return stopping || !jobs.empty(); });
+
+				// pending jobs are drained before exiting so no future is left without a value
+				if (jobs.empty())
+				{
+					break;
+				}
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+
+			job();
+		}
+
+		if (config.onThreadStop)
+		{
+			config.onThreadStop();
+		}
+	}
+}
@@ -0,0 +1,394 @@
+#include "upload_manager.hpp"
+#include "vulkan.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Vulkan
+{
+	UploadManager::~UploadManager()
+	{
+		if (!staging)
+		{
+			return;
+		}
+
+		// the fences, semaphores and command buffers go with their unique handles once the batches are done
+		auto _ = waitIdle();
+	}
+
+	VulkanResult UploadManager::createUploadManager(const UploadManagerConfig &_config)
+	{
+		config = _config;
+
+		if (!config.transferQueue || !config.destinationQueue)
+		{
+			return VulkanResult::BadUsage("An upload manager needs a transfer and a destination queue");
+		}
+		if (config.framesInFlight == 0)
+		{
+			return VulkanResult::BadUsage("An upload manager needs at least one frame in flight");
+		}
+		if (config.scheduler && config.scheduler->getConfig().transferQueue != config.transferQueue)
+		{
+			return VulkanResult::BadUsage("The upload manager's scheduler has to use the same transfer queue");
+		}
+
+		LIB_SET_AND_BAIL_RESULT_VALUE(config.allocator->createUniqueBuffer(
+		                                  config.stagingSize, vk::BufferUsageFlagBits::eTransferSrc,
+		                                  VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		                                  vk::MemoryPropertyFlagBits::eHostVisible,
+		                                  VMA_MEMORY_USAGE_AUTO_PREFER_HOST, MemoryCategory::Staging),
+		                              staging);
+
+		vk::CommandPoolCreateInfo commandPoolInfo{};
+		commandPoolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+		commandPoolInfo.setQueueFamilyIndex(config.transferQueue->queueIndex.value());
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE(config.device->getDevice().createCommandPoolUnique(commandPoolInfo), commandPool, "Couldn't create upload command pool");
+
+		createdAt = std::chrono::steady_clock::now();
+
+		std::cout << "Created upload manager with a " << config.stagingSize << " byte staging ring"
+		          << (ownershipTransfer() ? ", ownership moves from queue family " + std::to_string(config.transferQueue->queueIndex.value()) +
+		                                        " to " + std::to_string(config.destinationQueue->queueIndex.value())
+		                                  : ", transfer and destination share a queue family")
+		          << std::endl;
+
+		return VulkanResult::Success();
+	}
+
+	bool UploadManager::ownershipTransfer() const
+	{
+		// concurrent buffers are usable from both families as they are
+		return config.transferQueue->queueIndex != config.destinationQueue->queueIndex &&
+		       !config.allocator->sharesQueueFamilies(config.transferQueue->queueIndex.value(), config.destinationQueue->queueIndex.value());
+	}
+
+	VulkanResult UploadManager::upload(vk::Buffer destination, const void *data, vk::DeviceSize size, vk::DeviceSize destinationOffset,
+	                                   vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess)
+	{
+		if (size == 0)
+		{
+			return VulkanResult::Success();
+		}
+		if (size > config.stagingSize)
+		{
+			return VulkanResult::BadUsage("Upload of " + std::to_string(size) + " bytes doesn't fit in the " +
+			                              std::to_string(config.stagingSize) + " byte staging ring");
+		}
+
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(allocateStaging(size), auto stagingOffset);
+
+		std::memcpy(static_cast<char *>(staging->mapped) + stagingOffset, data, size);
+		LIB_QUICK_BAIL(config.allocator->flush(staging.get(), stagingOffset, size));
+
+		pending.push_back({destination, vk::BufferCopy{stagingOffset, destinationOffset, size}, dstStage, dstAccess});
+
+		stats.bytesUploaded += size;
+		++stats.uploadCount;
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<vk::DeviceSize> UploadManager::allocateStaging(vk::DeviceSize size)
+	{
+		const auto alignment = std::max(config.device->getPhysicalDevice().deviceProperties.limits.optimalBufferCopyOffsetAlignment, vk::DeviceSize(4));
+
+		while (true)
+		{
+			auto offset = (head + alignment - 1) / alignment * alignment;
+			auto padding = offset - head;
+			if (offset + size > config.stagingSize)
+			{
+				// the end of the ring is skipped and stays with this batch until it's retired
+				offset = 0;
+				padding = config.stagingSize - head;
+			}
+
+			if (used + padding + size <= config.stagingSize)
+			{
+				head = offset + size;
+				used += padding + size;
+				pendingStagingBytes += padding + size;
+				return offset;
+			}
+
+			if (!inFlight.empty())
+			{
+				LIB_QUICK_BAIL(retireBatches(true));
+			}
+			else
+			{
+				// only the queued copies hold the ring, their semaphore goes out with the next submit
+				LIB_QUICK_BAIL(submitPending());
+			}
+		}
+	}
+
+	VulkanResult UploadManager::submitPending()
+	{
+		if (pending.empty())
+		{
+			return VulkanResult::Success();
+		}
+
+		auto &device = config.device->getDevice();
+
+		Batch batch{};
+		if (freeCommandBuffers.empty())
+		{
+			vk::CommandBufferAllocateInfo allocateInfo{};
+			allocateInfo.setCommandPool(commandPool.get());
+			allocateInfo.setLevel(vk::CommandBufferLevel::ePrimary);
+			allocateInfo.setCommandBufferCount(1);
+
+			std::vector<vk::UniqueCommandBuffer> allocated;
+			VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(device.allocateCommandBuffersUnique(allocateInfo), allocated, "Couldn't allocate upload command buffer");
+			freeCommandBuffers.push_back(allocated[0].get());
+			commandBuffers.push_back(std::move(allocated[0]));
+		}
+		if (freeFences.empty() && !config.scheduler)
+		{
+			vk::UniqueFence fence;
+			VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(device.createFenceUnique(vk::FenceCreateInfo{}), fence, "Couldn't create upload fence");
+			freeFences.push_back(fence.get());
+			fences.push_back(std::move(fence));
+		}
+		if (freeSemaphores.empty() && !config.scheduler)
+		{
+			vk::UniqueSemaphore semaphore;
+			VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}), semaphore, "Couldn't create upload semaphore");
+			freeSemaphores.push_back(semaphore.get());
+			semaphores.push_back(std::move(semaphore));
+		}
+
+		batch.commandBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+		if (!config.scheduler)
+		{
+			batch.fence = freeFences.back();
+			batch.semaphore = freeSemaphores.back();
+			freeFences.pop_back();
+			freeSemaphores.pop_back();
+		}
+
+		auto commandBuffer = batch.commandBuffer;
+		VULKAN_QUICK_BAIL(commandBuffer.reset(), "Couldn't reset upload command buffer");
+		VULKAN_QUICK_BAIL(commandBuffer.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit}), "Couldn't begin upload command buffer");
+
+		vk::PipelineStageFlags waitStage = {};
+		std::vector<vk::BufferMemoryBarrier> releases;
+		for (const auto &copy : pending)
+		{
+			commandBuffer.copyBuffer(staging->buffer, copy.destination, copy.region);
+			waitStage |= copy.dstStage;
+
+			if (!ownershipTransfer())
+			{
+				// the semaphore wait alone makes the copy visible to the destination queue
+				continue;
+			}
+
+			vk::BufferMemoryBarrier barrier{};
+			barrier.setSrcQueueFamilyIndex(config.transferQueue->queueIndex.value());
+			barrier.setDstQueueFamilyIndex(config.destinationQueue->queueIndex.value());
+			barrier.setBuffer(copy.destination);
+			barrier.setOffset(copy.region.dstOffset);
+			barrier.setSize(copy.region.size);
+
+			// the release only has to make the copy available, the access on the other queue comes with the acquire
+			barrier.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+			releases.push_back(barrier);
+
+			barrier.setSrcAccessMask({});
+			barrier.setDstAccessMask(copy.dstAccess);
+			pendingAcquires.push_back(barrier);
+			acquireStages |= copy.dstStage;
+		}
+
+		if (!releases.empty())
+		{
+			commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, releases, {});
+		}
+
+		VULKAN_QUICK_BAIL(commandBuffer.end(), "Couldn't end upload command buffer");
+
+		if (config.scheduler)
+		{
+			LIB_SET_AND_BAIL_RESULT_VALUE(config.scheduler->submit(TimelineQueue::Transfer, {.commandBuffers = {commandBuffer}}), batch.timelineValue);
+
+			// the timeline only goes up, waiting on the last batch covers the earlier ones
+			if (ready.timelineWaits.empty())
+			{
+				ready.timelineWaits.push_back({TimelineQueue::Transfer, batch.timelineValue, waitStage});
+			}
+			else
+			{
+				ready.timelineWaits[0].value = batch.timelineValue;
+				ready.timelineWaits[0].stage |= waitStage;
+			}
+		}
+		else
+		{
+			vk::SubmitInfo submit{};
+			submit.setCommandBuffers(commandBuffer);
+			submit.setSignalSemaphores(batch.semaphore);
+
+			VULKAN_QUICK_BAIL(config.transferQueue->queue.submit(submit, batch.fence), "Couldn't submit to transfer queue");
+
+			ready.semaphores.push_back(batch.semaphore);
+			ready.waitStages.push_back(waitStage);
+		}
+
+		batch.stagingBytes = pendingStagingBytes;
+		batch.submittedFrame = currentFrame;
+		batch.submittedAt = std::chrono::steady_clock::now();
+		if (inFlight.empty())
+		{
+			busySince = batch.submittedAt;
+		}
+		inFlight.push_back(batch);
+
+		pending.clear();
+		pendingStagingBytes = 0;
+		++stats.batchCount;
+
+		return VulkanResult::Success();
+	}
+
+	VulkanResult UploadManager::retireBatches(bool waitForOldest)
+	{
+		auto &device = config.device->getDevice();
+
+		if (waitForOldest && !inFlight.empty())
+		{
+			if (config.scheduler)
+			{
+				LIB_QUICK_BAIL(config.scheduler->wait(TimelineQueue::Transfer, inFlight.front().timelineValue));
+			}
+			else
+			{
+				VULKAN_QUICK_BAIL(device.waitForFences(inFlight.front().fence, true, UINT64_MAX), "Couldn't wait for upload fence");
+			}
+		}
+
+		uint64_t completedValue = 0;
+		if (config.scheduler)
+		{
+			LIB_SET_AND_BAIL_RESULT_VALUE(config.scheduler->getCompletedValue(TimelineQueue::Transfer), completedValue);
+		}
+
+		// batches finish in submission order on the one queue, the first one not done ends the scan
+		while (!inFlight.empty())
+		{
+			auto &batch = inFlight.front();
+			if (config.scheduler)
+			{
+				if (batch.timelineValue > completedValue)
+				{
+					break;
+				}
+			}
+			else
+			{
+				auto status = device.getFenceStatus(batch.fence);
+				if (status == vk::Result::eNotReady)
+				{
+					break;
+				}
+				VULKAN_QUICK_BAIL(status, "Couldn't get upload fence status");
+				VULKAN_QUICK_BAIL(device.resetFences(batch.fence), "Couldn't reset upload fence");
+
+				freeFences.push_back(batch.fence);
+				retiredSemaphores.push_back({batch.semaphore, batch.submittedFrame});
+			}
+
+			used -= batch.stagingBytes;
+			freeCommandBuffers.push_back(batch.commandBuffer);
+			inFlight.pop_front();
+
+			if (inFlight.empty())
+			{
+				stats.transferTime += std::chrono::steady_clock::now() - busySince;
+			}
+		}
+
+		if (used == 0)
+		{
+			head = 0;
+		}
+
+		return VulkanResult::Success();
+	}
+
+	VulkanResult UploadManager::beginFrame(uint64_t frameNumber)
+	{
+		currentFrame = frameNumber;
+		LIB_QUICK_BAIL(retireBatches(false));
+
+		// a semaphore can be signaled again once the submission waiting on it is done, that's the fence of the
+		// frame it was handed out in which frameNumber has waited for when framesInFlight frames have passed
+		while (!retiredSemaphores.empty() && retiredSemaphores.front().second + config.framesInFlight <= frameNumber)
+		{
+			freeSemaphores.push_back(retiredSemaphores.front().first);
+			retiredSemaphores.pop_front();
+		}
+
+		return VulkanResult::Success();
+	}
+
+	ResultValue<UploadSubmission> UploadManager::submit()
+	{
+		LIB_QUICK_BAIL(retireBatches(false));
+		LIB_QUICK_BAIL(submitPending());
+
+		UploadSubmission submission = std::move(ready);
+		ready = {};
+
+		// batches that went out earlier because the ring was full already added theirs
+		acquires.insert(acquires.end(), pendingAcquires.begin(), pendingAcquires.end());
+		pendingAcquires.clear();
+
+		return submission;
+	}
+
+	void UploadManager::recordAcquireBarriers(vk::CommandBuffer commandBuffer)
+	{
+		if (acquires.empty())
+		{
+			return;
+		}
+
+		// chained to the semaphore wait, which happens at the same stages
+		commandBuffer.pipelineBarrier(acquireStages, acquireStages, {}, {}, acquires, {});
+		acquires.clear();
+		acquireStages = {};
+	}
+
+	VulkanResult UploadManager::waitIdle()
+	{
+		while (!inFlight.empty())
+		{
+			LIB_QUICK_BAIL(retireBatches(true));
+		}
+
+		return VulkanResult::Success();
+	}
+
+	UploadStats UploadManager::getStats()
+	{
+		auto now = std::chrono::steady_clock::now();
+
+		UploadStats current = stats;
+		if (!inFlight.empty())
+		{
+			current.transferTime += now - busySince;
+		}
+
+		std::chrono::duration<double, std::milli> lifetime = now - createdAt;
+		current.queueOccupancy = lifetime.count() > 0.0 ? current.transferTime.count() / lifetime.count() : 0.0;
+
+		return current;
+	}
+}
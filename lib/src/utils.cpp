@@ -6,8 +6,350 @@
 #include <vulkan_app.hpp>
 #include "utils.hpp"
 
+#include <chrono>
+#include <thread>
+
+#include "spirv-tools/optimizer.hpp"
+
 namespace Vulkan::Utils {
 
+    constexpr int SHADER_INPUT_VERSION = 100;
+    constexpr auto SHADER_CLIENT_VERSION = glslang::EShTargetVulkan_1_0;
+    constexpr auto SHADER_TARGET_VERSION = glslang::EShTargetSpv_1_0;
+
+    std::optional<std::vector<char>> readBinaryFile(const std::filesystem::path& fileName)
+    {
+        std::ifstream is(fileName, std::ios_base::in | std::ios_base::binary);
+        if (!is.is_open())
+        {
+            return std::nullopt;
+        }
+
+        return std::vector<char>(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    }
+
+    VulkanResult writeFileAtomic(const std::filesystem::path& fileName, const void* data, size_t size)
+    {
+        auto temporaryName = fileName;
+        temporaryName += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+        {
+            std::ofstream os(temporaryName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+            if (!os.is_open())
+            {
+                return VulkanResult::BadUsage("Couldn't open " + temporaryName.string() + " for writing");
+            }
+
+            os.write(static_cast<const char*>(data), size);
+            os.flush();
+
+            if (!os.good())
+            {
+                os.close();
+                std::error_code ignored;
+                std::filesystem::remove(temporaryName, ignored);
+                return VulkanResult::BadUsage("Couldn't write " + temporaryName.string());
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryName, fileName, error);
+        if (error)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(temporaryName, ignored);
+            return VulkanResult::BadUsage("Couldn't move " + temporaryName.string() + " to " + fileName.string() + ": " + error.message());
+        }
+
+        return VulkanResult::Success();
+    }
+
+    static ResultValue<std::vector<uint32_t>> optimizeSpirv(const std::vector<uint32_t>& spirv, const ShaderCompileOptions& options)
+    {
+        spvtools::Optimizer optimizer(SPV_ENV_VULKAN_1_0);
+
+        std::string messages;
+        optimizer.SetMessageConsumer([&messages](spv_message_level_t, const char*, const spv_position_t& position, const char* message)
+        {
+            messages += std::to_string(position.index) + ": " + message + "\n";
+        });
+
+        switch (options.optimization)
+        {
+        case ShaderOptimization::Performance:
+            optimizer.RegisterPerformancePasses();
+            break;
+        case ShaderOptimization::Size:
+            optimizer.RegisterSizePasses();
+            break;
+        case ShaderOptimization::None:
+            break;
+        }
+
+        if (options.stripDebugInfo)
+        {
+            optimizer.RegisterPass(spvtools::CreateStripDebugInfoPass());
+        }
+
+        std::vector<uint32_t> optimized;
+        if (!optimizer.Run(spirv.data(), spirv.size(), &optimized))
+        {
+            return VulkanResult::GLSLangError("SPIR-V optimization failed: " + messages);
+        }
+
+        return optimized;
+    }
+
+    static EShMessages shaderMessages(const ShaderCompileOptions& options)
+    {
+        return static_cast<EShMessages>(
+            EShMsgDefault | EShMsgVulkanRules | EShMsgSpvRules | (options.stripDebugInfo ? 0 : EShMsgDebugInfo));
+    }
+
+    uint64_t hashShaderCompileOptions(const ShaderCompileOptions& options, uint64_t seed)
+    {
+        uint64_t hash = seed;
+        for (const auto& directory : options.includeDirectories)
+        {
+            hash = hashString(directory.string(), hash);
+        }
+        hash = hashValue(shaderMessages(options), hash);
+        hash = hashValue(options.optimization, hash);
+        hash = hashValue(options.stripDebugInfo, hash);
+        for (const auto& [name, value] : options.defines)
+        {
+            hash = hashString(name, hash);
+            hash = hashString(value, hash);
+        }
+        hash = hashValue(SHADER_INPUT_VERSION, hash);
+        hash = hashValue(SHADER_CLIENT_VERSION, hash);
+        hash = hashValue(SHADER_TARGET_VERSION, hash);
+        return hash;
+    }
+
+    ResultValue<CompiledShaderProgram> compileShaderProgram(const ShaderProgramSources& shaders, const ShaderCompileOptions& options)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        EShMessages messages = shaderMessages(options);
+
+        std::vector<std::string> sources;
+        for (const auto &s : shaders)
+        {
+            auto shaderSource = readFile(s.first);
+
+            if (shaderSource == "")
+            {
+                return VulkanResult::GLSLangError("Couldn't read file " + s.first.string());
+            }
+
+            sources.push_back(std::move(shaderSource));
+        }
+
+        uint64_t cacheKey = HASH_SEED;
+        if (options.cache)
+        {
+            for (size_t i = 0; i < shaders.size(); ++i)
+            {
+                cacheKey = hashString(sources[i], cacheKey);
+                cacheKey = hashValue(shaders[i].second, cacheKey);
+            }
+            cacheKey = hashShaderCompileOptions(options, cacheKey);
+
+            auto cached = options.cache->load(cacheKey);
+            if (cached.has_value() && cached->spirv.size() == shaders.size())
+            {
+                auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+                std::cout << "Loaded " << shaders.size() << " shaders from cache in " << elapsed.count() << "ms" << std::endl;
+                return CompiledShaderProgram{
+                    .spirv = std::move(cached->spirv),
+                    .dependencies = std::move(cached->dependencies),
+                    .fromCache = true,
+                };
+            }
+        }
+
+        CompiledShaderProgram returnValue{};
+        std::vector<std::unique_ptr<glslang::TShader>> preparsedShaders;
+        glslang::TProgram program{};
+        ShaderIncluder includer(options.includeDirectories);
+
+        // glslang keeps the pointer, it has to outlive parsing
+        std::string preamble = "#extension GL_GOOGLE_include_directive : enable\n";
+        for (const auto& [name, value] : options.defines)
+        {
+            preamble += "#define " + name + " " + value + "\n";
+        }
+
+        for (size_t i = 0; i < shaders.size(); ++i)
+        {
+            auto language = shaders[i].second;
+            preparsedShaders.push_back(std::make_unique<glslang::TShader>(language));
+            auto& shader = *preparsedShaders.back();
+            auto shaderSources = sources[i].c_str();
+            auto shaderName = shaders[i].first.string();
+            auto shaderNames = shaderName.c_str();
+
+            std::cout << "Parsing " << shaderSources << std::endl;
+
+            // the name is what the includer resolves relative includes against
+            shader.setStringsWithLengthsAndNames(&shaderSources, nullptr, &shaderNames, 1);
+            shader.setPreamble(preamble.c_str());
+            shader.setEnvInput(glslang::EShSourceGlsl, language,
+                               glslang::EShClientVulkan, SHADER_INPUT_VERSION);
+            shader.setEnvClient(glslang::EShClientVulkan, SHADER_CLIENT_VERSION);
+            shader.setEnvTarget(glslang::EShTargetSpv, SHADER_TARGET_VERSION);
+
+            std::string vertOutput;
+
+            if (!shader.preprocess(GetDefaultResources(), 100, ENoProfile, false,
+                                   false, messages, &vertOutput, includer))
+            {
+
+                return VulkanResult::GLSLangError(
+                    std::string("Shader preprocessing failed: ") +
+                    shader.getInfoLog());
+            }
+
+            if (!shader.parse(GetDefaultResources(), 100, false, messages, includer))
+            {
+                return VulkanResult::GLSLangError(std::string("Shader parsing failed: ") +
+                                                  shader.getInfoLog());
+            }
+        }
+
+        for (auto &shader : preparsedShaders)
+        {
+            program.addShader(shader.get());
+        }
+
+        if (!program.link(messages))
+        {
+            std::cout <<  program.getInfoDebugLog() << std::endl;
+
+            return VulkanResult::GLSLangError(std::string("Program linking failed: ") +
+                                              program.getInfoLog());
+        }
+
+        for (const auto &shader : shaders)
+        {
+            auto language = shader.second;
+
+
+            // Get SPIR-V code for shader
+            glslang::TIntermediate *shaderIntermediate =
+                program.getIntermediate(language);
+            if (!shaderIntermediate)
+            {
+                return VulkanResult::GLSLangError(
+                    std::string(
+                        "Failed to get intermediate representation for shader: ") +
+                    program.getInfoLog());
+            }
+
+            std::vector<unsigned int> shaderSpirv;
+            glslang::GlslangToSpv(*shaderIntermediate, shaderSpirv);
+
+            if (options.optimization != ShaderOptimization::None || options.stripDebugInfo)
+            {
+                LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(optimizeSpirv(shaderSpirv, options), auto optimized);
+
+                SpirvOptimizationReport report{
+                    .instructionsBefore = countSpirvInstructions(shaderSpirv),
+                    .instructionsAfter = countSpirvInstructions(optimized),
+                    .bytesBefore = shaderSpirv.size() * sizeof(uint32_t),
+                    .bytesAfter = optimized.size() * sizeof(uint32_t),
+                };
+
+                std::cout << "Optimized " << shader.first.string() << ": "
+                          << report.instructionsBefore << " -> " << report.instructionsAfter << " instructions, "
+                          << report.bytesBefore << " -> " << report.bytesAfter << " bytes" << std::endl;
+
+                returnValue.optimizationReports.push_back(report);
+                shaderSpirv = std::move(optimized);
+            }
+
+            returnValue.spirv.push_back(shaderSpirv);
+        }
+
+        returnValue.dependencies = includer.getDependencies();
+
+        if (options.cache)
+        {
+            auto result = options.cache->store(cacheKey, {
+                .spirv = returnValue.spirv,
+                .dependencies = returnValue.dependencies,
+            });
+            if (result.type() != VulkanResultVariants::Success)
+            {
+                // a failed cache write only costs us the next startup, don't fail the compilation for it
+                std::cerr << "Couldn't store shaders in cache: " << result.description() << std::endl;
+            }
+        }
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        std::cout << "Compiled " << shaders.size() << " shaders (" << returnValue.dependencies.files().size() << " includes) in " << elapsed.count() << "ms" << std::endl;
+
+        return returnValue;
+    }
+
+    ResultValue<std::vector<std::vector<uint32_t>>> compileShaders(std::vector<std::pair<std::filesystem::path, EShLanguage>> shaders, const ShaderCompileOptions& options)
+    {
+        LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(compileShaderProgram(shaders, options), auto program);
+
+        return std::move(program.spirv);
+    }
+
+    ThreadPoolConfig shaderCompilerThreadPoolConfig(uint32_t threadCount)
+    {
+        // InitializeProcess is reference counted, older glslang versions also need it on
+        // each thread for their thread local pool allocator.
+        return ThreadPoolConfig{
+            .threadCount = threadCount,
+            .onThreadStart = []() { glslang::InitializeProcess(); },
+            .onThreadStop = []() { glslang::FinalizeProcess(); },
+        };
+    }
+
+    std::vector<ResultValue<CompiledShaderProgram>> compileShaderPrograms(const std::vector<ShaderProgramSources>& programs, const ShaderCompileOptions& options, ThreadPool* pool)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<ResultValue<CompiledShaderProgram>> results;
+
+        ThreadPool temporaryPool;
+        if (!pool)
+        {
+            auto result = temporaryPool.createThreadPool(shaderCompilerThreadPoolConfig());
+            if (result.type() != VulkanResultVariants::Success)
+            {
+                results.assign(programs.size(), result);
+                return results;
+            }
+            pool = &temporaryPool;
+        }
+
+        std::vector<std::future<ResultValue<CompiledShaderProgram>>> pending;
+        pending.reserve(programs.size());
+
+        for (const auto& program : programs)
+        {
+            pending.push_back(pool->submit([&program, &options]()
+                                           { return compileShaderProgram(program, options); }));
+        }
+
+        results.reserve(programs.size());
+        for (auto& future : pending)
+        {
+            results.push_back(future.get());
+        }
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        std::cout << "Compiled " << programs.size() << " shader programs on " << pool->getThreadCount() << " threads in " << elapsed.count() << "ms" << std::endl;
+
+        return results;
+    }
+
     VulkanResult recreateSwapchainFromWindow(GLFWwindow* window, Device& device, Swapchain& swapchain)
     {
 
@@ -27,7 +369,12 @@ namespace Vulkan::Utils {
 
         LIB_QUICK_BAIL(swapchain.recreateSwapchain());
         LIB_QUICK_BAIL(swapchain.recreateImageViews());
-        LIB_QUICK_BAIL(swapchain.recreateFramebuffers());
+
+        // with dynamic rendering there is no render pass and nothing else to rebuild
+        if (swapchain.usesFramebuffers())
+        {
+            LIB_QUICK_BAIL(swapchain.recreateFramebuffers());
+        }
 
         return VulkanResult::Success();
     }
@@ -4,14 +4,120 @@
 
 #include "allocator.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
 namespace Vulkan {
+    const char* to_string(MemoryCategory category) {
+        switch(category) {
+            case MemoryCategory::Auto: return "auto";
+            case MemoryCategory::Vertex: return "vertex";
+            case MemoryCategory::Index: return "index";
+            case MemoryCategory::Uniform: return "uniform";
+            case MemoryCategory::Staging: return "staging";
+            case MemoryCategory::Image: return "image";
+            default: return "other";
+        }
+    }
+
+    static MemoryCategory categoryFromUsage(vk::BufferUsageFlags usage) {
+        if(usage & vk::BufferUsageFlagBits::eVertexBuffer) {
+            return MemoryCategory::Vertex;
+        }
+        if(usage & vk::BufferUsageFlagBits::eIndexBuffer) {
+            return MemoryCategory::Index;
+        }
+        if(usage & vk::BufferUsageFlagBits::eUniformBuffer) {
+            return MemoryCategory::Uniform;
+        }
+        if(usage == vk::BufferUsageFlagBits::eTransferSrc) {
+            return MemoryCategory::Staging;
+        }
+        return MemoryCategory::Other;
+    }
+
+    struct Allocator::DefragmentationState {
+        enum class Phase {
+            Idle,
+            // copies submitted, waiting for the fence or the timeline
+            Copying,
+            // the handles switched, frames in flight may still use the old buffers
+            Retiring,
+        };
+
+        DefragmentationConfig config;
+        VmaDefragmentationContext context = nullptr;
+        VmaDefragmentationPassMoveInfo pass{};
+        Phase phase = Phase::Idle;
+
+        // one per move of the pass, null for skipped moves
+        std::vector<vk::Buffer> newBuffers;
+        std::vector<vk::Buffer> oldBuffers;
+
+        vk::UniqueCommandPool commandPool;
+        std::vector<vk::UniqueCommandBuffer> commandBuffers;
+        // both null with a scheduler, the copies signal timelineValue on its transfer timeline instead
+        vk::UniqueFence fence;
+        uint64_t timelineValue = 0;
+        // a pass hands out one semaphore and at most one pass starts a frame, by the time one comes around
+        // again the frame that waited on it is done
+        std::vector<vk::UniqueSemaphore> semaphores;
+        uint64_t passIndex = 0;
+
+        uint64_t switchedFrame = 0;
+        vk::DeviceSize blockBytesBefore = 0;
+        DefragmentationPassStats stats;
+
+        // VMA doesn't allow freeing an allocation that's part of the running pass
+        bool moving(VmaAllocation allocation) const {
+            if(phase == Phase::Idle) {
+                return false;
+            }
+            for(uint32_t i = 0; i < pass.moveCount; ++i) {
+                if(pass.pMoves[i].srcAllocation == allocation) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    static vk::DeviceSize totalBlockBytes(Allocator& allocator) {
+        vk::DeviceSize bytes = 0;
+        for(const auto& budget : allocator.getBudgets()) {
+            bytes += budget.blockBytes;
+        }
+        return bytes;
+    }
+
+    Allocator::~Allocator() {
+        if(!allocator) {
+            return;
+        }
+
+        flushDeferredDestructions();
+        vmaDestroyAllocator(allocator);
+    }
+
     VulkanResult Allocator::createAllocator(VulkanAllocatorConfig allocConfig) {
         config = allocConfig;
+
+        if(config.framesInFlight == 0) {
+            return VulkanResult::BadUsage("The allocator needs at least one frame in flight");
+        }
         
         VmaAllocatorCreateInfo allocatorInfo{};
         allocatorInfo.device = config.device->getDevice();
         allocatorInfo.instance = config.instance;
         allocatorInfo.physicalDevice = config.device->getPhysicalDevice().physicalDevice;
+
+        // VMA takes the core 1.1+ entry points, the budget query among them, only when told the version
+        auto apiVersion = config.device->getApiVersion();
+        allocatorInfo.vulkanApiVersion = std::min(VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(apiVersion), VK_API_VERSION_MINOR(apiVersion), 0), VK_API_VERSION_1_3);
+        if(config.device->isMemoryBudgetEnabled()) {
+            allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+        }
         
         VmaVulkanFunctions vulkanFunctions = {};
         vulkanFunctions.vkGetInstanceProcAddr = config.device->getDispatcher().vkGetInstanceProcAddr;
@@ -20,20 +126,29 @@ namespace Vulkan {
         allocatorInfo.pVulkanFunctions = &vulkanFunctions;
     
         VULKAN_QUICK_BAIL((vk::Result)vmaCreateAllocator(&allocatorInfo, &allocator), "Couldn't create allocator!");
+
+        const VkPhysicalDeviceMemoryProperties* memoryProperties;
+        vmaGetMemoryProperties(allocator, &memoryProperties);
+        heapsUnderPressure.assign(memoryProperties->memoryHeapCount, false);
         
         return VulkanResult::Success();
     }
 
     ResultValue<Buffer> Allocator::createBuffer(size_t size,
-        vk::BufferUsageFlagBits bufferUsage,
+        vk::BufferUsageFlags bufferUsage,
         VmaAllocationCreateFlags vmaAllocFlags,
         vk::MemoryPropertyFlags requiredFlags,
-        VmaMemoryUsage vmaUsage)
+        VmaMemoryUsage vmaUsage,
+        MemoryCategory category)
     {
         vk::BufferCreateInfo bufferInfo{};
 
         bufferInfo.setSize(size);
         bufferInfo.setUsage(bufferUsage);
+        if(config.sharedQueueFamilies.size() > 1) {
+            bufferInfo.setSharingMode(vk::SharingMode::eConcurrent);
+            bufferInfo.setQueueFamilyIndices(config.sharedQueueFamilies);
+        }
 
         VmaAllocationCreateInfo vmaAlloc{};
         vmaAlloc.flags = vmaAllocFlags;
@@ -41,12 +156,603 @@ namespace Vulkan {
         vmaAlloc.usage = vmaUsage;
 
         Buffer returnValue{};
+        VmaAllocationInfo allocationInfo{};
 
         VULKAN_QUICK_BAIL((vk::Result)vmaCreateBuffer(allocator,
-                                (VkBufferCreateInfo *)&bufferInfo, &vmaAlloc, (VkBuffer *)&returnValue.buffer, &returnValue.allocation, nullptr),
+                                (VkBufferCreateInfo *)&bufferInfo, &vmaAlloc, (VkBuffer *)&returnValue.buffer, &returnValue.allocation, &allocationInfo),
         "Couldn't create buffer!");
 
+        returnValue.mapped = allocationInfo.pMappedData;
+
+        VkMemoryPropertyFlags memoryFlags;
+        vmaGetAllocationMemoryProperties(allocator, returnValue.allocation, &memoryFlags);
+        returnValue.needsFlush = (memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(memoryFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+        track(returnValue.allocation, category == MemoryCategory::Auto ? categoryFromUsage(bufferUsage) : category, &bufferInfo);
+
+        return returnValue;
+    }
+
+    ResultValue<UniqueBuffer> Allocator::createUniqueBuffer(size_t size,
+        vk::BufferUsageFlags bufferUsage,
+        VmaAllocationCreateFlags vmaAllocFlags,
+        vk::MemoryPropertyFlags requiredFlags,
+        VmaMemoryUsage vmaUsage,
+        MemoryCategory category)
+    {
+        LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(createBuffer(size, bufferUsage, vmaAllocFlags, requiredFlags, vmaUsage, category), auto buffer);
+        return UniqueBuffer(this, buffer);
+    }
+
+    ResultValue<Image> Allocator::createImage(const vk::ImageCreateInfo& imageInfo,
+        VmaAllocationCreateFlags vmaAllocFlags,
+        vk::MemoryPropertyFlags requiredFlags,
+        VmaMemoryUsage vmaUsage)
+    {
+        VmaAllocationCreateInfo vmaAlloc{};
+        vmaAlloc.flags = vmaAllocFlags;
+        vmaAlloc.requiredFlags = (VkMemoryPropertyFlags)requiredFlags;
+        vmaAlloc.usage = vmaUsage;
+
+        Image returnValue{};
+        VULKAN_QUICK_BAIL((vk::Result)vmaCreateImage(allocator,
+                                (const VkImageCreateInfo *)&imageInfo, &vmaAlloc, (VkImage *)&returnValue.image, &returnValue.allocation, nullptr),
+        "Couldn't create image!");
+
+        track(returnValue.allocation, MemoryCategory::Image);
+
         return returnValue;
     }
 
+    ResultValue<UniqueImage> Allocator::createUniqueImage(const vk::ImageCreateInfo& imageInfo,
+        VmaAllocationCreateFlags vmaAllocFlags,
+        vk::MemoryPropertyFlags requiredFlags,
+        VmaMemoryUsage vmaUsage)
+    {
+        LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(createImage(imageInfo, vmaAllocFlags, requiredFlags, vmaUsage), auto image);
+        return UniqueImage(this, image);
+    }
+
+    void Allocator::destroyBuffer(Buffer& buffer) {
+        if(buffer.allocation) {
+            untrack(buffer.allocation);
+            vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+        }
+        buffer = Buffer{};
+    }
+
+    void Allocator::destroyImage(Image& image) {
+        if(image.allocation) {
+            untrack(image.allocation);
+            vmaDestroyImage(allocator, image.image, image.allocation);
+        }
+        image = Image{};
+    }
+
+    void Allocator::destroyBufferDeferred(Buffer& buffer) {
+        if(buffer.allocation) {
+            // the owner goes away now, defragmentation mustn't touch the buffer until it's destroyed
+            setOwner(buffer.allocation, nullptr);
+
+            std::lock_guard lock(deferredMutex);
+            deferred.push_back({currentFrame, buffer.allocation, buffer.buffer, {}});
+        }
+        buffer = Buffer{};
+    }
+
+    void Allocator::destroyImageDeferred(Image& image) {
+        if(image.allocation) {
+            std::lock_guard lock(deferredMutex);
+            deferred.push_back({currentFrame, image.allocation, {}, image.image});
+        }
+        image = Image{};
+    }
+
+    void Allocator::destroy(const DeferredDestruction& destruction) {
+        untrack(destruction.allocation);
+        if(destruction.buffer) {
+            vmaDestroyBuffer(allocator, destruction.buffer, destruction.allocation);
+        } else {
+            vmaDestroyImage(allocator, destruction.image, destruction.allocation);
+        }
+    }
+
+    void Allocator::beginFrame(uint64_t frameNumber) {
+        {
+            std::lock_guard lock(deferredMutex);
+            currentFrame = frameNumber;
+
+            // queued in frame order, frame + framesInFlight is the first frame whose fence wait covers the last use
+            while(!deferred.empty() && deferred.front().frame + config.framesInFlight <= frameNumber) {
+                // the rest waits for the pass to end, keeps the queue in frame order
+                if(defragmentation && defragmentation->moving(deferred.front().allocation)) {
+                    break;
+                }
+                destroy(deferred.front());
+                deferred.pop_front();
+            }
+        }
+
+        // VMA fetches the budget from the driver again when the frame index changes
+        vmaSetCurrentFrameIndex(allocator, static_cast<uint32_t>(frameNumber));
+
+        if(!config.onBudgetPressure) {
+            return;
+        }
+
+        // outside the lock, the callback is expected to free things
+        for(const auto& budget : getBudgets()) {
+            bool underPressure = budget.usage > budget.budget * config.budgetPressureThreshold;
+            if(underPressure && !heapsUnderPressure[budget.heapIndex]) {
+                config.onBudgetPressure(budget);
+            }
+            heapsUnderPressure[budget.heapIndex] = underPressure;
+        }
+    }
+
+    void Allocator::flushDeferredDestructions() {
+        endDefragmentation();
+
+        std::lock_guard lock(deferredMutex);
+        for(const auto& destruction : deferred) {
+            destroy(destruction);
+        }
+        deferred.clear();
+    }
+
+    size_t Allocator::getPendingDestructionCount() {
+        std::lock_guard lock(deferredMutex);
+        return deferred.size();
+    }
+
+    void Allocator::track(VmaAllocation allocation, MemoryCategory category, const vk::BufferCreateInfo* bufferInfo) {
+        // the record rides along in the user data so nothing needs a lookup, the name shows up in VMA's JSON
+        auto record = new AllocationRecord{category};
+        if(bufferInfo) {
+            record->size = bufferInfo->size;
+            record->usage = bufferInfo->usage;
+            record->concurrent = bufferInfo->sharingMode == vk::SharingMode::eConcurrent;
+        }
+        vmaSetAllocationUserData(allocator, allocation, record);
+        vmaSetAllocationName(allocator, allocation, to_string(category));
+
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator, allocation, &info);
+
+        std::lock_guard lock(statsMutex);
+        auto& stats = categories[static_cast<size_t>(category)];
+        ++stats.allocations;
+        stats.bytes += info.size;
+    }
+
+    void Allocator::untrack(VmaAllocation allocation) {
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator, allocation, &info);
+        auto record = static_cast<AllocationRecord*>(info.pUserData);
+
+        std::lock_guard lock(statsMutex);
+        auto& stats = categories[static_cast<size_t>(record->category)];
+        --stats.allocations;
+        stats.bytes -= info.size;
+        delete record;
+    }
+
+    Allocator::AllocationRecord* Allocator::getRecord(VmaAllocation allocation) {
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator, allocation, &info);
+        return static_cast<AllocationRecord*>(info.pUserData);
+    }
+
+    void Allocator::setOwner(VmaAllocation allocation, Buffer* owner) {
+        auto record = getRecord(allocation);
+        std::lock_guard lock(statsMutex);
+        record->owner = owner;
+    }
+
+    bool Allocator::sharesQueueFamilies(uint32_t first, uint32_t second) {
+        const auto& families = config.sharedQueueFamilies;
+        return families.size() > 1 &&
+               std::find(families.begin(), families.end(), first) != families.end() &&
+               std::find(families.begin(), families.end(), second) != families.end();
+    }
+
+    VulkanResult Allocator::beginDefragmentation(const DefragmentationConfig& defragmentationConfig) {
+        if(defragmentation) {
+            return VulkanResult::BadUsage("A defragmentation is already running");
+        }
+
+        if(defragmentationConfig.scheduler && defragmentationConfig.scheduler->getConfig().transferQueue != defragmentationConfig.transferQueue) {
+            return VulkanResult::BadUsage("The defragmentation's scheduler has to use the same transfer queue");
+        }
+
+        auto state = std::make_unique<DefragmentationState>();
+        state->config = defragmentationConfig;
+        auto& device = config.device->getDevice();
+
+        vk::CommandPoolCreateInfo commandPoolInfo{};
+        commandPoolInfo.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+        commandPoolInfo.setQueueFamilyIndex(state->config.transferQueue->queueIndex.value());
+        VULKAN_SET_AND_BAIL_RESULT_VALUE(device.createCommandPoolUnique(commandPoolInfo), state->commandPool, "Couldn't create defragmentation command pool");
+
+        vk::CommandBufferAllocateInfo allocateInfo{};
+        allocateInfo.setCommandPool(state->commandPool.get());
+        allocateInfo.setLevel(vk::CommandBufferLevel::ePrimary);
+        allocateInfo.setCommandBufferCount(1);
+        VULKAN_SET_AND_BAIL_RESULT_VALUE(device.allocateCommandBuffersUnique(allocateInfo), state->commandBuffers, "Couldn't allocate defragmentation command buffer");
+
+        if(!state->config.scheduler) {
+            VULKAN_SET_AND_BAIL_RESULT_VALUE(device.createFenceUnique(vk::FenceCreateInfo{}), state->fence, "Couldn't create defragmentation fence");
+
+            for(uint32_t i = 0; i <= config.framesInFlight; ++i) {
+                vk::UniqueSemaphore semaphore;
+                VULKAN_SET_AND_BAIL_RESULT_VALUE(device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}), semaphore, "Couldn't create defragmentation semaphore");
+                state->semaphores.push_back(std::move(semaphore));
+            }
+        }
+
+        VmaDefragmentationInfo info{};
+        info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+        info.maxAllocationsPerPass = state->config.maxMovesPerPass;
+        info.maxBytesPerPass = state->config.maxBytesPerPass;
+        VULKAN_QUICK_BAIL((vk::Result)vmaBeginDefragmentation(allocator, &info, &state->context), "Couldn't begin defragmentation!");
+
+        defragmentation = std::move(state);
+        return VulkanResult::Success();
+    }
+
+    ResultValue<DefragmentationStep> Allocator::stepDefragmentation() {
+        DefragmentationStep step{};
+        if(!defragmentation) {
+            step.finished = true;
+            return step;
+        }
+
+        auto& state = *defragmentation;
+        auto& device = config.device->getDevice();
+        auto transferFamily = state.config.transferQueue->queueIndex.value();
+        auto destinationFamily = state.config.destinationQueue->queueIndex.value();
+
+        if(state.phase == DefragmentationState::Phase::Idle) {
+            state.blockBytesBefore = totalBlockBytes(*this);
+
+            auto result = (vk::Result)vmaBeginDefragmentationPass(allocator, state.context, &state.pass);
+            if(result == vk::Result::eSuccess) {
+                // nothing left to move
+                endDefragmentation();
+                step.finished = true;
+                return step;
+            }
+            VULKAN_QUICK_BAIL(result == vk::Result::eIncomplete ? vk::Result::eSuccess : result, "Couldn't begin defragmentation pass!");
+
+            state.stats = {};
+            state.newBuffers.assign(state.pass.moveCount, vk::Buffer{});
+            state.oldBuffers.assign(state.pass.moveCount, vk::Buffer{});
+
+            auto commandBuffer = state.commandBuffers[0].get();
+            VULKAN_QUICK_BAIL(commandBuffer.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit}), "Couldn't begin defragmentation command buffer");
+
+            // uploads earlier on the transfer queue may still be writing the buffers about to be read
+            vk::MemoryBarrier previousWrites{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferRead};
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, previousWrites, {}, {});
+
+            for(uint32_t i = 0; i < state.pass.moveCount; ++i) {
+                auto& move = state.pass.pMoves[i];
+                auto record = getRecord(move.srcAllocation);
+
+                std::lock_guard lock(statsMutex);
+                bool movable = record->owner && !record->owner->mapped &&
+                               (record->concurrent || transferFamily == destinationFamily);
+                if(!movable) {
+                    move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                    ++state.stats.skipped;
+                    continue;
+                }
+
+                vk::BufferCreateInfo bufferInfo{};
+                bufferInfo.setSize(record->size);
+                bufferInfo.setUsage(record->usage);
+                if(record->concurrent) {
+                    bufferInfo.setSharingMode(vk::SharingMode::eConcurrent);
+                    bufferInfo.setQueueFamilyIndices(config.sharedQueueFamilies);
+                }
+
+                auto created = device.createBuffer(bufferInfo);
+                if(created.result != vk::Result::eSuccess) {
+                    move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                    ++state.stats.skipped;
+                    continue;
+                }
+                if(vmaBindBufferMemory(allocator, move.dstTmpAllocation, created.value) != VK_SUCCESS) {
+                    device.destroyBuffer(created.value);
+                    move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                    ++state.stats.skipped;
+                    continue;
+                }
+
+                state.newBuffers[i] = created.value;
+                commandBuffer.copyBuffer(record->owner->buffer, created.value, vk::BufferCopy{0, 0, record->size});
+
+                ++state.stats.moves;
+                state.stats.bytesMoved += record->size;
+            }
+
+            VULKAN_QUICK_BAIL(commandBuffer.end(), "Couldn't end defragmentation command buffer");
+
+            if(state.config.scheduler) {
+                LIB_SET_AND_BAIL_RESULT_VALUE(state.config.scheduler->submit(TimelineQueue::Transfer, {.commandBuffers = {commandBuffer}}), state.timelineValue);
+            } else {
+                auto semaphore = state.semaphores[state.passIndex % state.semaphores.size()].get();
+                vk::SubmitInfo submit{};
+                submit.setCommandBuffers(commandBuffer);
+                submit.setSignalSemaphores(semaphore);
+                VULKAN_QUICK_BAIL(state.config.transferQueue->queue.submit(submit, state.fence.get()), "Couldn't submit defragmentation copies");
+            }
+
+            state.phase = DefragmentationState::Phase::Copying;
+            return step;
+        }
+
+        if(state.phase == DefragmentationState::Phase::Copying) {
+            if(state.config.scheduler) {
+                LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(state.config.scheduler->getCompletedValue(TimelineQueue::Transfer), auto completedValue);
+                if(completedValue < state.timelineValue) {
+                    return step;
+                }
+            } else {
+                auto status = device.getFenceStatus(state.fence.get());
+                if(status == vk::Result::eNotReady) {
+                    return step;
+                }
+                VULKAN_QUICK_BAIL(status, "Couldn't get defragmentation fence status");
+                VULKAN_QUICK_BAIL(device.resetFences(state.fence.get()), "Couldn't reset defragmentation fence");
+            }
+
+            // from this frame on the new buffers are used, the old ones stay bound until no frame reads them
+            for(uint32_t i = 0; i < state.pass.moveCount; ++i) {
+                if(!state.newBuffers[i]) {
+                    continue;
+                }
+
+                auto record = getRecord(state.pass.pMoves[i].srcAllocation);
+                Buffer* owner = nullptr;
+                {
+                    std::lock_guard lock(statsMutex);
+                    owner = record->owner;
+                    if(owner) {
+                        state.oldBuffers[i] = owner->buffer;
+                        owner->buffer = state.newBuffers[i];
+                    }
+                }
+
+                if(!owner) {
+                    // released while the copy ran, keep it where it is and drop the copy
+                    state.pass.pMoves[i].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                    device.destroyBuffer(state.newBuffers[i]);
+                    state.newBuffers[i] = nullptr;
+                    --state.stats.moves;
+                    continue;
+                }
+
+                if(state.config.onBufferMoved) {
+                    state.config.onBufferMoved(state.oldBuffers[i], *owner);
+                }
+            }
+
+            if(state.config.scheduler) {
+                step.timelineWait = TimelineWait{TimelineQueue::Transfer, state.timelineValue, step.waitStage};
+            } else {
+                step.waitSemaphore = state.semaphores[state.passIndex % state.semaphores.size()].get();
+            }
+            state.switchedFrame = currentFrame;
+            state.phase = DefragmentationState::Phase::Retiring;
+            return step;
+        }
+
+        if(currentFrame < state.switchedFrame + config.framesInFlight) {
+            return step;
+        }
+
+        for(uint32_t i = 0; i < state.pass.moveCount; ++i) {
+            // a buffer released since the switch was queued with its new handle, the allocation follows it below
+            if(state.oldBuffers[i]) {
+                device.destroyBuffer(state.oldBuffers[i]);
+            }
+        }
+
+        // the allocations now point at the new memory, the old regions and emptied blocks are freed
+        vmaEndDefragmentationPass(allocator, state.context, &state.pass);
+
+        auto blockBytesAfter = totalBlockBytes(*this);
+        state.stats.bytesReclaimed = state.blockBytesBefore > blockBytesAfter ? state.blockBytesBefore - blockBytesAfter : 0;
+        step.pass = state.stats;
+
+        ++state.passIndex;
+        state.phase = DefragmentationState::Phase::Idle;
+        return step;
+    }
+
+    void Allocator::endDefragmentation() {
+        if(!defragmentation) {
+            return;
+        }
+
+        auto& state = *defragmentation;
+        auto& device = config.device->getDevice();
+
+        // only reached mid pass on shutdown, the copies are waited for and the moves that didn't switch dropped
+        if(state.phase != DefragmentationState::Phase::Idle) {
+            // once retiring the copies are done and the fence was reset already
+            if(state.phase == DefragmentationState::Phase::Copying) {
+                if(state.config.scheduler) {
+                    auto _ = state.config.scheduler->wait(TimelineQueue::Transfer, state.timelineValue);
+                } else {
+                    auto _ = device.waitForFences(state.fence.get(), true, UINT64_MAX);
+                }
+            }
+            for(uint32_t i = 0; i < state.pass.moveCount; ++i) {
+                if(state.oldBuffers[i]) {
+                    device.destroyBuffer(state.oldBuffers[i]);
+                } else if(state.newBuffers[i]) {
+                    device.destroyBuffer(state.newBuffers[i]);
+                    state.pass.pMoves[i].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                }
+            }
+            vmaEndDefragmentationPass(allocator, state.context, &state.pass);
+        }
+
+        VmaDefragmentationStats stats{};
+        vmaEndDefragmentation(allocator, state.context, &stats);
+        std::cout << "Defragmentation moved " << stats.allocationsMoved << " allocations (" << stats.bytesMoved << " bytes), freed "
+                  << stats.deviceMemoryBlocksFreed << " blocks (" << stats.bytesFreed << " bytes)" << std::endl;
+
+        defragmentation.reset();
+    }
+
+    std::vector<HeapBudget> Allocator::getBudgets() {
+        const VkPhysicalDeviceMemoryProperties* memoryProperties;
+        vmaGetMemoryProperties(allocator, &memoryProperties);
+
+        std::vector<VmaBudget> vmaBudgets(memoryProperties->memoryHeapCount);
+        vmaGetHeapBudgets(allocator, vmaBudgets.data());
+
+        std::vector<HeapBudget> budgets;
+        for(uint32_t i = 0; i < memoryProperties->memoryHeapCount; ++i) {
+            HeapBudget budget{};
+            budget.heapIndex = i;
+            budget.flags = vk::MemoryHeapFlags(memoryProperties->memoryHeaps[i].flags);
+            budget.usage = vmaBudgets[i].usage;
+            budget.budget = vmaBudgets[i].budget;
+            budget.blockBytes = vmaBudgets[i].statistics.blockBytes;
+            budget.allocationBytes = vmaBudgets[i].statistics.allocationBytes;
+            budgets.push_back(budget);
+        }
+        return budgets;
+    }
+
+    CategoryStats Allocator::getCategoryStats(MemoryCategory category) {
+        std::lock_guard lock(statsMutex);
+        return categories[static_cast<size_t>(category)];
+    }
+
+    std::string Allocator::statsToJson(bool detailedMap) {
+        std::ostringstream json;
+
+        json << "{\"budgets\":[";
+        auto budgets = getBudgets();
+        for(size_t i = 0; i < budgets.size(); ++i) {
+            const auto& budget = budgets[i];
+            json << (i ? "," : "") << "{\"heap\":" << budget.heapIndex
+                 << ",\"deviceLocal\":" << ((budget.flags & vk::MemoryHeapFlagBits::eDeviceLocal) ? "true" : "false")
+                 << ",\"usage\":" << budget.usage
+                 << ",\"budget\":" << budget.budget
+                 << ",\"blockBytes\":" << budget.blockBytes
+                 << ",\"allocationBytes\":" << budget.allocationBytes << "}";
+        }
+
+        json << "],\"categories\":{";
+        for(size_t i = static_cast<size_t>(MemoryCategory::Vertex); i < static_cast<size_t>(MemoryCategory::Count); ++i) {
+            auto stats = getCategoryStats(static_cast<MemoryCategory>(i));
+            json << (i > static_cast<size_t>(MemoryCategory::Vertex) ? "," : "")
+                 << "\"" << to_string(static_cast<MemoryCategory>(i)) << "\":{\"allocations\":" << stats.allocations
+                 << ",\"bytes\":" << stats.bytes << "}";
+        }
+
+        json << "},\"pendingDestructions\":" << getPendingDestructionCount();
+
+        // already JSON, embedded as it is
+        char* vmaStats = nullptr;
+        vmaBuildStatsString(allocator, &vmaStats, detailedMap);
+        json << ",\"vma\":" << vmaStats << "}";
+        vmaFreeStatsString(allocator, vmaStats);
+
+        return json.str();
+    }
+
+    UniqueBuffer::UniqueBuffer(Allocator* allocator, Buffer buffer) : allocator{allocator}, buffer{std::make_unique<Buffer>(buffer)} {
+        if(allocator && buffer.allocation) {
+            allocator->setOwner(buffer.allocation, this->buffer.get());
+        }
+    }
+
+    UniqueBuffer& UniqueBuffer::operator=(UniqueBuffer&& other) noexcept {
+        if(this != &other) {
+            reset();
+            allocator = other.allocator;
+            buffer = std::move(other.buffer);
+        }
+        return *this;
+    }
+
+    void UniqueBuffer::reset() {
+        if(allocator && buffer) {
+            allocator->destroyBufferDeferred(*buffer);
+        }
+        buffer.reset();
+    }
+
+    Buffer UniqueBuffer::release() {
+        if(!buffer) {
+            return Buffer{};
+        }
+
+        Buffer released = *buffer;
+        if(allocator && released.allocation) {
+            allocator->setOwner(released.allocation, nullptr);
+        }
+        buffer.reset();
+        return released;
+    }
+
+    const Buffer& UniqueBuffer::get() const {
+        static const Buffer empty{};
+        return buffer ? *buffer : empty;
+    }
+
+    UniqueImage::UniqueImage(UniqueImage&& other) noexcept : allocator{other.allocator}, image{other.release()} {}
+
+    UniqueImage& UniqueImage::operator=(UniqueImage&& other) noexcept {
+        if(this != &other) {
+            reset();
+            allocator = other.allocator;
+            image = other.release();
+        }
+        return *this;
+    }
+
+    void UniqueImage::reset() {
+        if(allocator) {
+            allocator->destroyImageDeferred(image);
+        }
+        image = Image{};
+    }
+
+    Image UniqueImage::release() {
+        Image released = image;
+        image = Image{};
+        return released;
+    }
+
+    VulkanResult Allocator::write(const Buffer& buffer, const void* data, size_t size, size_t offset) {
+        if(!buffer.mapped) {
+            return VulkanResult::BadUsage("Buffer isn't persistently mapped, create it with VMA_ALLOCATION_CREATE_MAPPED_BIT");
+        }
+
+        memcpy(static_cast<char*>(buffer.mapped) + offset, data, size);
+
+        if(buffer.needsFlush) {
+            return flush(buffer, offset, size);
+        }
+        return VulkanResult::Success();
+    }
+
+    VulkanResult Allocator::flush(const Buffer& buffer, size_t offset, size_t size) {
+        if(!buffer.needsFlush) {
+            return VulkanResult::Success();
+        }
+
+        // vma rounds the range to nonCoherentAtomSize
+        VULKAN_QUICK_BAIL((vk::Result)vmaFlushAllocation(allocator, buffer.allocation, offset, size), "Couldn't flush buffer!");
+        return VulkanResult::Success();
+    }
+
 }
\ No newline at end of file
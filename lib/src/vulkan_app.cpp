@@ -25,8 +25,18 @@
 
 namespace Vulkan
 {
-
-
+	VulkanApplication::~VulkanApplication()
+	{
+		// the surface, swapchain and pipelines of the derived application are gone by now, they need both alive
+		if (glslangInitialized)
+		{
+			glslang::FinalizeProcess();
+		}
+		if (glfwInitialized)
+		{
+			glfwTerminate();
+		}
+	}
 
 	VulkanResult VulkanApplication::run()
 	{
@@ -40,10 +50,12 @@ namespace Vulkan
 		if(!glfwInit()) {
 			return VulkanResult::GLFWError();
 		}
+		glfwInitialized = true;
 
 		if(!glslang::InitializeProcess()) {
 			return VulkanResult::GLSLangError("Couldn't initialize glslang");
 		}
+		glslangInitialized = true;
 
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
@@ -57,10 +69,8 @@ namespace Vulkan
 
 	void VulkanApplication::cleanup_vulkan()
 	{	
+		// GLFW and glslang stay up until the destructor, members still free GPU resources after this
 		OnDestroy();
-
-		glslang::FinalizeProcess();
-		glfwTerminate();
 	}
 
 } // namespace Vulkan
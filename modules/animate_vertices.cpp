@@ -0,0 +1,374 @@
+#include "vulkan.hpp"
+
+#include "allocator.hpp"
+#include "common.hpp"
+#include "compute_pipeline.hpp"
+#include "descriptor_layout_cache.hpp"
+#include "device.hpp"
+#include "instance.hpp"
+#include "shader_bundle.hpp"
+#include "shader_cache.hpp"
+#include "shader_reflection.hpp"
+#include "shared.hpp"
+#include "utils.hpp"
+#include "vulkan_app.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <glm/glm.hpp>
+#include <iostream>
+#include <random>
+
+#ifdef _WIN32
+#define MODULES_DLL __declspec(dllexport)
+#else
+#define MODULES_DLL
+#endif
+
+// Headless example moving per-vertex animation from the CPU to a compute shader. Every frame the
+// vertices are animated once on the GPU and once on the CPU so both timings can be compared, the
+// last frame is read back and checked against the CPU result.
+
+using namespace Vulkan;
+
+// matches SourceVertex in animate_vertices.comp.glsl (std430)
+struct SourceVertex
+{
+	glm::vec2 position;
+	float phase;
+	float amplitude;
+};
+
+struct AnimationConstants
+{
+	float time;
+	uint32_t vertexCount;
+};
+
+const uint32_t VERTEX_COUNT = 1 << 20;
+const uint32_t FRAME_COUNT = 120;
+
+static glm::vec2 animateVertex(const SourceVertex &vertex, float time)
+{
+	float angle = time * 2.0f + vertex.phase;
+	return vertex.position + glm::vec2(std::cos(angle), std::sin(angle)) * vertex.amplitude;
+}
+
+struct ComputeApp : VulkanApplication
+{
+	void onDebugMessage(vk::DebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+	                    vk::DebugUtilsMessageTypeFlagsEXT messageTypes,
+	                    const vk::DebugUtilsMessengerCallbackDataEXT *pCallbackData)
+	{
+		std::cout << vk::to_string(messageSeverity) << " " << vk::to_string(messageTypes) << " " << pCallbackData->pMessage << std::endl;
+	}
+
+	virtual VulkanResult OnInit() override
+	{
+		using vk::DebugUtilsMessageSeverityFlagBitsEXT::eError, vk::DebugUtilsMessageSeverityFlagBitsEXT::eWarning;
+		using vk::DebugUtilsMessageTypeFlagBitsEXT::eGeneral, vk::DebugUtilsMessageTypeFlagBitsEXT::ePerformance, vk::DebugUtilsMessageTypeFlagBitsEXT::eValidation;
+
+		LIB_QUICK_BAIL(instance.createInstance({
+		    .appName = "Vulkan Compute Animation",
+		    .appVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
+		    .engineName = "Vulkan Engine",
+		    .engineVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
+		    .vulkanVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
+
+		    .requiredInstanceExtensions = {VK_EXT_DEBUG_UTILS_EXTENSION_NAME},
+
+		    .enableLayers = true,
+		    .requiredLayers = {"VK_LAYER_KHRONOS_validation"},
+
+		    .usesWindow = false,
+
+		    .createDebugCallbackMessenger = true,
+
+		    .messageSeverity = eError | eWarning,
+		    .messageTypes = eGeneral | eValidation | ePerformance,
+
+		    .debugCallback = {
+		        std::bind(&ComputeApp::onDebugMessage, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)},
+		}));
+
+		LIB_QUICK_BAIL(device.createDevice({
+		    .instance = &instance,
+		    .queueRequirements = {
+		        QueueInformation{
+		            .requiredFlags = vk::QueueFlagBits::eCompute,
+		            .queuePriority = 1.0,
+		            .name = "computeQueue"},
+		    },
+		    .features = vk::PhysicalDeviceFeatures{},
+
+		    .checkSuitability = Utils::defaultCheckSuitability,
+		    .pickBestPhysicalDevice = Utils::defaultPickBestPhysicalDevice,
+
+		    .requiresSwapchainSupport = false,
+		}));
+
+		computeQueue = &device.getQueue(0);
+
+		std::cout << "Created device!" << std::endl;
+
+		LIB_QUICK_BAIL(shaderCache.createShaderCache({
+		    .directory = "shader_cache",
+		    .maxSizeBytes = 64 * 1024 * 1024,
+		}));
+
+		shaderCompileOptions.cache = &shaderCache;
+#ifdef NDEBUG
+		shaderCompileOptions.optimization = Utils::ShaderOptimization::Performance;
+		shaderCompileOptions.stripDebugInfo = true;
+#endif
+
+		auto bundleResult = shaderBundle.createShaderBundle({.path = "shaders.bundle"});
+		if (bundleResult.type() != VulkanResultVariants::Success)
+		{
+			std::cout << "No shader bundle, compiling shaders at runtime: " << bundleResult.description() << std::endl;
+		}
+
+		Utils::ShaderProgramSources animateSources = {
+		    {std::filesystem::path("shaders") / "animate_vertices.comp.glsl", EShLanguage::EShLangCompute},
+		};
+
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::loadShaderProgram(animateSources, shaderCompileOptions, &shaderBundle),
+		                                        auto animateProgram);
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createShaderModule(device, animateProgram.spirv[0]), auto computeShaderModule);
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::reflectProgram(animateProgram.spirv), auto animateReflection);
+
+		LIB_QUICK_BAIL(layoutCache.createDescriptorSetLayoutCache(&device));
+
+		ComputePipelineConfig pipelineConfig{
+		    .device = &device,
+		};
+		pipelineConfig.shaderStage.setPName("main");
+		pipelineConfig.shaderStage.setModule(computeShaderModule.get());
+		pipelineConfig.shaderStage.setStage(vk::ShaderStageFlagBits::eCompute);
+
+		// descriptor set layouts, push constants and the local_size_x_id constant come from the shader
+		LIB_QUICK_BAIL(Utils::applyReflection(pipelineConfig, animateReflection, layoutCache));
+		pipelineConfig.localSize = Utils::computeWorkgroupSize(device, 1);
+
+		LIB_QUICK_BAIL(pipeline.createComputePipeline(pipelineConfig));
+
+		LIB_QUICK_BAIL(
+		    allocator.createAllocator({
+		        .device = &device,
+		        .instance = instance.getInstance(),
+		    }));
+
+		LIB_SET_AND_BAIL_RESULT_VALUE(allocator.createUniqueBuffer(
+		                                  sizeof(SourceVertex) * VERTEX_COUNT, vk::BufferUsageFlagBits::eStorageBuffer,
+		                                  VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		                                  vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		                                  VMA_MEMORY_USAGE_AUTO_PREFER_HOST),
+		                              sourceBuffer);
+
+		LIB_SET_AND_BAIL_RESULT_VALUE(allocator.createUniqueBuffer(
+		                                  sizeof(glm::vec2) * VERTEX_COUNT, vk::BufferUsageFlagBits::eStorageBuffer,
+		                                  VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		                                  vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		                                  VMA_MEMORY_USAGE_AUTO),
+		                              animatedBuffer);
+
+		LIB_QUICK_BAIL(fillSourceBuffer());
+		LIB_QUICK_BAIL(createDescriptorSet());
+
+		vk::CommandPoolCreateInfo commandPoolInfo{};
+		commandPoolInfo.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
+		commandPoolInfo.setQueueFamilyIndex(computeQueue->queueIndex.value());
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE(device.getDevice().createCommandPoolUnique(commandPoolInfo), commandPool, "Couldn't create compute command pool");
+
+		vk::CommandBufferAllocateInfo allocateInfo{};
+		allocateInfo.setCommandPool(commandPool.get());
+		allocateInfo.setLevel(vk::CommandBufferLevel::ePrimary);
+		allocateInfo.setCommandBufferCount(1);
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE(device.getDevice().allocateCommandBuffersUnique(allocateInfo), commandBuffers, "Couldn't allocate compute command buffer");
+		VULKAN_SET_AND_BAIL_RESULT_VALUE(device.getDevice().createFenceUnique(vk::FenceCreateInfo{}), fence, "Couldn't create compute fence");
+
+		return VulkanResult::Success();
+	}
+
+	VulkanResult MainLoop() override
+	{
+		std::chrono::duration<double, std::milli> gpuTime{0};
+		std::chrono::duration<double, std::milli> cpuTime{0};
+		float time = 0.0f;
+
+		for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			time = frame / 60.0f;
+
+			auto gpuStart = std::chrono::steady_clock::now();
+			LIB_QUICK_BAIL(animateOnGpu(time));
+			gpuTime += std::chrono::steady_clock::now() - gpuStart;
+
+			auto cpuStart = std::chrono::steady_clock::now();
+			animateOnCpu(time);
+			cpuTime += std::chrono::steady_clock::now() - cpuStart;
+		}
+
+		LIB_QUICK_BAIL(compareResults());
+
+		std::cout << "Animated " << VERTEX_COUNT << " vertices over " << FRAME_COUNT << " frames: "
+		          << gpuTime.count() / FRAME_COUNT << "ms per frame on the GPU (submit to fence), "
+		          << cpuTime.count() / FRAME_COUNT << "ms per frame on the CPU" << std::endl;
+
+		auto _ = device.getDevice().waitIdle();
+		return VulkanResult::Success();
+	}
+
+	VulkanResult animateOnGpu(float time)
+	{
+		auto commandBuffer = commandBuffers[0].get();
+		VULKAN_QUICK_BAIL(commandBuffer.reset(), "Couldn't reset compute command buffer!");
+
+		VULKAN_QUICK_BAIL(commandBuffer.begin(vk::CommandBufferBeginInfo{vk::CommandBufferUsageFlagBits::eOneTimeSubmit}), "Couldn't begin compute command buffer!");
+
+		commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getPipeline());
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.getPipelineLayout(), 0, {descriptorSet.get()}, {});
+
+		AnimationConstants constants{time, VERTEX_COUNT};
+		commandBuffer.pushConstants(pipeline.getPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+
+		LIB_QUICK_BAIL(pipeline.dispatch(commandBuffer, VERTEX_COUNT));
+
+		// make the shader writes visible to the host read in compareResults
+		vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead};
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, barrier, {}, {});
+
+		VULKAN_QUICK_BAIL(commandBuffer.end(), "Couldn't end compute command buffer!");
+
+		vk::SubmitInfo submit{};
+		submit.setCommandBuffers(commandBuffer);
+
+		VULKAN_QUICK_BAIL(device.getDevice().resetFences(fence.get()), "Couldn't reset compute fence!");
+		VULKAN_QUICK_BAIL(computeQueue->queue.submit(submit, fence.get()), "Couldn't submit to compute queue");
+		VULKAN_QUICK_BAIL(device.getDevice().waitForFences(fence.get(), true, UINT64_MAX), "Couldn't wait for compute fence");
+
+		return VulkanResult::Success();
+	}
+
+	void animateOnCpu(float time)
+	{
+		for (uint32_t i = 0; i < VERTEX_COUNT; ++i)
+		{
+			cpuPositions[i] = animateVertex(sourceVertices[i], time);
+		}
+	}
+
+	VulkanResult compareResults()
+	{
+		// host coherent, the barrier in animateOnGpu is all the read needs
+		auto gpuPositions = static_cast<const glm::vec2 *>(animatedBuffer->mapped);
+		float maxError = 0.0f;
+		for (uint32_t i = 0; i < VERTEX_COUNT; ++i)
+		{
+			auto difference = glm::abs(gpuPositions[i] - cpuPositions[i]);
+			maxError = std::max(maxError, std::max(difference.x, difference.y));
+		}
+
+		std::cout << "Largest difference between GPU and CPU positions: " << maxError << std::endl;
+
+		// sin and cos only have to be accurate to about 2^-11 in shaders
+		if (maxError > 1e-2f)
+		{
+			return VulkanResult::BadUsage("GPU animation doesn't match the CPU one");
+		}
+
+		return VulkanResult::Success();
+	}
+
+	VulkanResult fillSourceBuffer()
+	{
+		std::mt19937 random(42);
+		std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> phase(0.0f, 6.2831853f);
+		std::uniform_real_distribution<float> amplitude(0.0f, 0.05f);
+
+		sourceVertices.resize(VERTEX_COUNT);
+		cpuPositions.resize(VERTEX_COUNT);
+		for (auto &vertex : sourceVertices)
+		{
+			vertex = {glm::vec2(position(random), position(random)), phase(random), amplitude(random)};
+		}
+
+		return allocator.write(sourceBuffer.get(), sourceVertices.data(), sourceVertices.size() * sizeof(SourceVertex));
+	}
+
+	VulkanResult createDescriptorSet()
+	{
+		vk::DescriptorPoolSize descriptorPoolSize{vk::DescriptorType::eStorageBuffer, 2};
+
+		vk::DescriptorPoolCreateInfo createInfo{};
+		createInfo.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
+		createInfo.setPoolSizes({descriptorPoolSize});
+		createInfo.setMaxSets(1);
+
+		VULKAN_SET_AND_BAIL_RESULT_VALUE(device.getDevice().createDescriptorPoolUnique(createInfo), descriptorPool, "Couldn't create descriptor pool");
+
+		vk::DescriptorSetAllocateInfo allocInfo{};
+		allocInfo.setDescriptorPool(descriptorPool.get());
+		allocInfo.setSetLayouts(pipeline.getPipelineConfig().descriptorSetLayouts[0]);
+
+		std::vector<vk::UniqueDescriptorSet> descriptorSets;
+		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(device.getDevice().allocateDescriptorSetsUnique(allocInfo), descriptorSets, "Couldn't create descriptor set.");
+		descriptorSets[0].swap(descriptorSet);
+
+		vk::DescriptorBufferInfo sourceInfo{sourceBuffer->buffer, 0, VK_WHOLE_SIZE};
+		vk::DescriptorBufferInfo animatedInfo{animatedBuffer->buffer, 0, VK_WHOLE_SIZE};
+
+		std::array<vk::WriteDescriptorSet, 2> writes{};
+		writes[0].setDstSet(descriptorSet.get());
+		writes[0].setDstBinding(0);
+		writes[0].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		writes[0].setBufferInfo(sourceInfo);
+		writes[1].setDstSet(descriptorSet.get());
+		writes[1].setDstBinding(1);
+		writes[1].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+		writes[1].setBufferInfo(animatedInfo);
+
+		device.getDevice().updateDescriptorSets(writes, {});
+
+		return VulkanResult::Success();
+	}
+
+private:
+	Instance instance;
+	Device device;
+	ShaderCache shaderCache;
+	ShaderBundle shaderBundle;
+	Utils::ShaderCompileOptions shaderCompileOptions;
+
+	DescriptorSetLayoutCache layoutCache;
+	ComputePipeline pipeline;
+	vk::UniqueDescriptorPool descriptorPool;
+	vk::UniqueDescriptorSet descriptorSet;
+
+	Allocator allocator;
+	vk::UniqueCommandPool commandPool;
+	std::vector<vk::UniqueCommandBuffer> commandBuffers;
+	vk::UniqueFence fence;
+
+	QueueInformation *computeQueue;
+
+	// released into the allocator's queue, which destroys them with itself
+	UniqueBuffer sourceBuffer;
+	UniqueBuffer animatedBuffer;
+
+	std::vector<SourceVertex> sourceVertices;
+	std::vector<glm::vec2> cpuPositions;
+};
+
+extern "C"
+{
+	MODULES_DLL VulkanApplication *create_application()
+	{
+		return new ComputeApp();
+	}
+}
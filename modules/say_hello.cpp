@@ -1,20 +1,39 @@
 #include "vulkan.hpp"
 
 #include "allocator.hpp"
+#include "async_pipeline.hpp"
+#include "command_buffer_cache.hpp"
 #include "common.hpp"
+#include "descriptor_layout_cache.hpp"
 #include "device.hpp"
+#include "dynamic_state.hpp"
+#include "frame_allocator.hpp"
+#include "frame_manager.hpp"
+#include "frame_scheduler.hpp"
+#include "parallel_recorder.hpp"
 #include "glslang/Public/ShaderLang.h"
 #include "graphics_pipeline.hpp"
 #include "instance.hpp"
+#include "pipeline_state_cache.hpp"
+#include "shader_bundle.hpp"
+#include "shader_cache.hpp"
+#include "shader_hot_reload.hpp"
+#include "shader_permutations.hpp"
+#include "shader_reflection.hpp"
 #include "shared.hpp"
 #include "swapchain.hpp"
+#include "thread_pool.hpp"
 #include "thread"
+#include "upload_manager.hpp"
 #include "utils.hpp"
 #include "vulkan/vulkan_core.h"
 #include "vulkan/vulkan_enums.hpp"
 #include "vulkan/vulkan_handles.hpp"
 #include "vulkan_app.hpp"
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
 #include <functional>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp> // after <glm/glm.hpp>
@@ -35,54 +54,10 @@ struct Vertex
 	glm::vec2 position;
 	glm::vec3 color;
 	glm::vec2 uv;
-
-
-	static vk::VertexInputBindingDescription getBindingDescription()
-	{
-		vk::VertexInputBindingDescription bindingDescription{};
-		bindingDescription.setBinding(0);
-		bindingDescription.setStride(sizeof(Vertex));
-		bindingDescription.setInputRate(vk::VertexInputRate::eVertex);
-
-		return bindingDescription;
-	}
-
-	static std::vector<vk::VertexInputAttributeDescription> getAttributeDescription()
-	{
-		std::vector<vk::VertexInputAttributeDescription> attributeDescription(3);
-
-		attributeDescription[0].setBinding(0);
-		attributeDescription[0].setLocation(0);
-		attributeDescription[0].setFormat(vk::Format::eR32G32Sfloat);
-		attributeDescription[0].setOffset(offsetof(Vertex, position));
-
-		attributeDescription[1].setBinding(0);
-		attributeDescription[1].setLocation(1);
-		attributeDescription[1].setFormat(vk::Format::eR32G32B32Sfloat);
-		attributeDescription[1].setOffset(offsetof(Vertex, color));
-
-		attributeDescription[2].setBinding(0);
-		attributeDescription[2].setLocation(2);
-		attributeDescription[2].setFormat(vk::Format::eR32G32Sfloat);
-		attributeDescription[2].setOffset(offsetof(Vertex, uv));
-
-		return attributeDescription;
-	}
 };
 
 struct UniformBuffer {
 	glm::mat4 model{}, view{}, projection{};
-
-	static std::vector<vk::DescriptorSetLayoutBinding>  getBindingDescription() {
-		vk::DescriptorSetLayoutBinding uboLayoutBinding{};
-		uboLayoutBinding.setBinding(0);
-		uboLayoutBinding.setDescriptorType(vk::DescriptorType::eUniformBuffer);
-		uboLayoutBinding.setDescriptorCount(1);
-		uboLayoutBinding.setStageFlags(vk::ShaderStageFlagBits::eVertex);
-
-
-		return {uboLayoutBinding};
-	}
 };
 
 std::array<Vertex, 4> vertices = {
@@ -115,21 +90,11 @@ std::array<uint32_t, 6> indices{
 
 using namespace Vulkan;
 
-struct FrameData
-{
-	vk::UniqueSemaphore imageAvailableSemaphore;
-	vk::UniqueSemaphore renderFinishedSemaphore;
-	vk::UniqueFence inFlightFence;
-	vk::CommandBuffer commandBuffer;
-	Buffer uniformBuffer;
-	vk::UniqueDescriptorSet descriptorSet;
-};
-
-
 uint32_t WIDTH = 1280;
 uint32_t HEIGHT = 800;
 std::string title = "Vulkan Application";
-const uint32_t MAX_FRAMES_IN_FLIGHT = 1;
+// the starting value, 1 to 3 change it while running
+uint32_t FRAMES_IN_FLIGHT = 2;
 
 struct VkApp : VulkanApplication
 {
@@ -147,6 +112,45 @@ struct VkApp : VulkanApplication
 		app->framebufferResized = true;
 	}
 
+	// P compiles a new pipeline in the background, O compiles one on the render thread,
+	// the worst frame time in the title shows the hitch either of them causes. D defragments the allocator,
+	// 1 to 3 set the number of frames in flight and R switches to recording the draws on worker threads.
+	static void GLFWkey(GLFWwindow *window, int key, int, int action, int)
+	{
+		VkApp *app = (VkApp *)glfwGetWindowUserPointer(window);
+		if (action != GLFW_PRESS)
+		{
+			return;
+		}
+
+		if (key == GLFW_KEY_P)
+		{
+			app->benchmarkRequest = BenchmarkRequest::Async;
+		}
+		else if (key == GLFW_KEY_O)
+		{
+			app->benchmarkRequest = BenchmarkRequest::Sync;
+		}
+		else if (key == GLFW_KEY_D)
+		{
+			app->defragmentRequest = true;
+		}
+		else if (key >= GLFW_KEY_1 && key <= GLFW_KEY_3)
+		{
+			app->framesInFlightRequest = key - GLFW_KEY_1 + 1;
+		}
+		else if (key == GLFW_KEY_R)
+		{
+			app->parallelRecording = !app->parallelRecording;
+			std::cout << "Parallel recording " << (app->parallelRecording ? "on" : "off") << std::endl;
+		}
+		else if (key == GLFW_KEY_C)
+		{
+			app->cacheStaticPass = !app->cacheStaticPass;
+			std::cout << "Static pass caching " << (app->cacheStaticPass ? "on" : "off") << std::endl;
+		}
+	}
+
 	virtual VulkanResult OnInit() override
 	{
 		std::cout << "Running OnInit()! " << std::endl;
@@ -156,6 +160,7 @@ struct VkApp : VulkanApplication
 
 		window = glfwCreateWindow(WIDTH, HEIGHT, title.c_str(), nullptr, nullptr);
 		glfwSetFramebufferSizeCallback(window, GLFWframebuffersize);
+		glfwSetKeyCallback(window, GLFWkey);
 		glfwSetWindowUserPointer(window, this);
 		if (!window)
 		{
@@ -170,7 +175,8 @@ struct VkApp : VulkanApplication
 		    .appVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
 		    .engineName = "Vulkan Engine",
 		    .engineVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
-		    .vulkanVersion = VK_MAKE_API_VERSION(0, 1, 0, 0),
+		    // dynamic rendering is core in 1.3, older drivers still get it through the extension
+		    .vulkanVersion = VK_API_VERSION_1_3,
 
 		    .requiredInstanceExtensions = {VK_EXT_DEBUG_UTILS_EXTENSION_NAME},
 
@@ -222,6 +228,18 @@ struct VkApp : VulkanApplication
 
 		    // if this is set to true, the swapchain KHR extension will automatically be added to the device
 		    .requiresSwapchainSupport = true,
+
+		    // no render pass or framebuffers when the device supports it, resizes only recreate image views
+		    .enableDynamicRendering = true,
+
+		    // state the driver can set while recording doesn't need its own pipeline
+		    .enableExtendedDynamicState = true,
+
+		    // real per heap budgets for the allocator's pressure callback
+		    .enableMemoryBudget = true,
+
+		    // frames are paced on a timeline per queue instead of fences when the device has them
+		    .enableTimelineSemaphores = true,
 		}));
 
 		std::cout << "Created device!" << std::endl;
@@ -274,27 +292,38 @@ struct VkApp : VulkanApplication
 
 		std::cout << "Created image views!" << std::endl;
 
-		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::compileShaders({
-		                                            {std::filesystem::path("shaders") / "simple_triangle.frag.glsl", EShLanguage::EShLangFragment},
-		                                            {std::filesystem::path("shaders") / "simple_triangle.vert.glsl", EShLanguage::EShLangVertex},
-		                                        }),
-		                                        auto shaders);
+		LIB_QUICK_BAIL(shaderCache.createShaderCache({
+		    .directory = "shader_cache",
+		    .maxSizeBytes = 64 * 1024 * 1024,
+		}));
 
-		std::cout << "Created shaders!" << std::endl;
+		Utils::ShaderProgramSources triangleSources = {
+		    {std::filesystem::path("shaders") / "simple_triangle.frag.glsl", EShLanguage::EShLangFragment},
+		    {std::filesystem::path("shaders") / "simple_triangle.vert.glsl", EShLanguage::EShLangVertex},
+		};
+
+		shaderCompileOptions.cache = &shaderCache;
+#ifdef NDEBUG
+		shaderCompileOptions.optimization = Utils::ShaderOptimization::Performance;
+		shaderCompileOptions.stripDebugInfo = true;
+#endif
 
-		vk::ShaderModuleCreateInfo fragmentShaderInfo = {};
-		fragmentShaderInfo.setCode(shaders[0]);
+		// built next to the executable by the ShaderCompiler target, the GLSL is compiled when it's missing or stale
+		auto bundleResult = shaderBundle.createShaderBundle({.path = "shaders.bundle"});
+		if (bundleResult.type() != VulkanResultVariants::Success)
+		{
+			std::cout << "No shader bundle, compiling shaders at runtime: " << bundleResult.description() << std::endl;
+		}
 
-		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
-		    device.getDevice().createShaderModuleUnique(fragmentShaderInfo),
-		    auto fragmentShaderModule, "Couldn't create fragment shader");
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::loadShaderProgram(triangleSources, shaderCompileOptions, &shaderBundle),
+		                                        auto triangleProgram);
+		auto &shaders = triangleProgram.spirv;
 
-		vk::ShaderModuleCreateInfo vertexShaderInfo = {};
-		vertexShaderInfo.setCode(shaders[1]);
+		auto shaderCacheStats = shaderCache.getStats();
+		std::cout << "Created shaders! (shader cache: " << shaderCacheStats.hits << " hits, " << shaderCacheStats.misses << " misses)" << std::endl;
 
-		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(
-		    device.getDevice().createShaderModuleUnique(vertexShaderInfo),
-		    auto vertexShaderModule, "Couldn't create vertex shader");
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createShaderModule(device, shaders[0]), triangleFragmentModule);
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createShaderModule(device, shaders[1]), triangleVertexModule);
 
 		std::cout << "Created shader modules" << std::endl;
 
@@ -302,33 +331,37 @@ struct VkApp : VulkanApplication
 		    {}, {}};
 
 		shaderStages[0].setPName("main");
-		shaderStages[0].setModule(fragmentShaderModule.get());
+		shaderStages[0].setModule(triangleFragmentModule.get());
 		shaderStages[0].setStage(vk::ShaderStageFlagBits::eFragment);
 
 		shaderStages[1].setPName("main");
-		shaderStages[1].setModule(vertexShaderModule.get());
+		shaderStages[1].setModule(triangleVertexModule.get());
 		shaderStages[1].setStage(vk::ShaderStageFlagBits::eVertex);
 
-		LIB_QUICK_BAIL(createRenderPass());
-
-
-
-		std::cout << "Created render pass!" << std::endl;
+		if (!device.isDynamicRenderingEnabled())
+		{
+			LIB_QUICK_BAIL(createRenderPass());
+			std::cout << "Created render pass!" << std::endl;
+		}
 
-		LIB_QUICK_BAIL(createDescriptorSetLayout());
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::reflectProgram(shaders), auto triangleReflection);
+		// the uniforms live in the frame allocator, bound with a dynamic offset per frame
+		LIB_QUICK_BAIL(triangleReflection.useDynamicOffsets(0, 0));
+		LIB_QUICK_BAIL(layoutCache.createDescriptorSetLayoutCache(&device));
 
-		LIB_QUICK_BAIL(pipeline.createGraphicsPipeline({
+		GraphicsPipelineConfig pipelineConfig{
 		    .device = &device,
 		    .renderPass = renderPass.get(),
 		    .subpass = 0,
+		    .renderingConfig = {
+		        .colorFormats = {swapchain.getSwapchainConfig().surfaceFormat.format},
+		    },
 		    .shaderStages = shaderStages,
+		    .shaderHashes = {Utils::hashSpirv(shaders[0]), Utils::hashSpirv(shaders[1])},
 		    .dynamicStates = {
 		        vk::DynamicState::eViewport,
 		        vk::DynamicState::eScissor},
 
-		    .vertexBindingDescriptions = {Vertex::getBindingDescription()},
-		    .vertexAttributeDescriptions = Vertex::getAttributeDescription(),
-
 		    .topology = vk::PrimitiveTopology::eTriangleList,
 		    .primitiveRestart = false,
 
@@ -351,52 +384,142 @@ struct VkApp : VulkanApplication
 		                         .enableLogicOp = false,
 		                         .logicOp = vk::LogicOp::eCopy},
 
-		    .descriptorSetLayouts = {descriptorSetLayout.get()},
-		    .pushConstants = {},
+		};
+
+		// vertex input, descriptor set layouts and push constants all come from the shaders
+		LIB_QUICK_BAIL(Utils::applyReflection(pipelineConfig, triangleReflection, layoutCache));
+
+		if (pipelineConfig.vertexBindingDescriptions[0].stride != sizeof(Vertex))
+		{
+			return VulkanResult::BadUsage("Vertex doesn't match the inputs of simple_triangle.vert.glsl");
+		}
+		descriptorSetLayout = pipelineConfig.descriptorSetLayouts[0];
+
+		Utils::enableExtendedDynamicState(pipelineConfig);
+
+		LIB_QUICK_BAIL(pipelineStateCache.createPipelineStateCache({.device = &device}));
+		pipelineConfig.stateCache = &pipelineStateCache;
+
+		LIB_QUICK_BAIL(pipeline.createGraphicsPipeline(pipelineConfig));
+		triangleConfig = pipelineConfig;
+
+		auto pipelineStats = pipelineStateCache.getStats();
+		std::cout << "Created graphics pipeline! (pipeline state cache: " << pipelineStats.hits << " hits, " << pipelineStats.misses << " misses, "
+		          << pipelineStats.creationTime.count() << "ms creating)" << std::endl;
+
+		LIB_QUICK_BAIL(benchmarkShaderPermutations(pipelineConfig));
+
+		LIB_QUICK_BAIL(hotReloader.createPipelineHotReloader({
+		    .device = &device,
+		    .compileOptions = shaderCompileOptions,
+		    .directory = "shaders",
+		    .framesInFlight = FRAMES_IN_FLIGHT,
+		}));
+		hotReloader.addProgram(&pipeline, triangleSources, triangleProgram.dependencies);
+
+		LIB_QUICK_BAIL(pipelineCompiler.createAsyncPipelineCompiler({
+		    .threadCount = 2,
+		    .fallback = &pipeline,
 		}));
 
-		std::cout << "Created graphics pipeline!" << std::endl;
+		// uploads and defragmentation copies signal the transfer timeline, frames wait on it
+		if (device.isTimelineSemaphoreEnabled())
+		{
+			LIB_QUICK_BAIL(frameScheduler.createFrameScheduler({
+			    .device = &device,
+			    .graphicsQueue = graphicsQueue,
+			    .computeQueue = computeQueue,
+			    .transferQueue = transferQueue,
+			}));
+		}
+
+		// buffers are shared with the transfer queue so defragmentation can copy them without ownership transfers
+		std::vector<uint32_t> sharedQueueFamilies;
+		if (graphicsQueue->queueIndex != transferQueue->queueIndex)
+		{
+			sharedQueueFamilies = {graphicsQueue->queueIndex.value(), transferQueue->queueIndex.value()};
+		}
 
 		LIB_QUICK_BAIL(
 		    allocator.createAllocator({
 		        .device = &device,
 		        .instance = instance.getInstance(),
+		        .framesInFlight = FRAMES_IN_FLIGHT,
+		        .onBudgetPressure = [](const HeapBudget &budget)
+		        {
+			        // nothing here is evictable yet, a streaming cache would drop resources at this point
+			        std::cout << "Memory heap " << budget.heapIndex << " is at " << budget.pressure() * 100.0f << "% of its budget ("
+			                  << budget.usage << " of " << budget.budget << " bytes)" << std::endl;
+		        },
+		        .sharedQueueFamilies = sharedQueueFamilies,
 		    }));
 
-		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(allocator.createBuffer(
-		                                            sizeof(Vertex) * 6, vk::BufferUsageFlagBits::eVertexBuffer,
-		                                            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-		                                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-		                                            VMA_MEMORY_USAGE_AUTO_PREFER_HOST),
+		// geometry goes through a staging ring on the transfer queue into device local memory
+		LIB_QUICK_BAIL(uploadManager.createUploadManager({
+		    .device = &device,
+		    .allocator = &allocator,
+		    .transferQueue = transferQueue,
+		    .destinationQueue = graphicsQueue,
+		    .framesInFlight = FRAMES_IN_FLIGHT,
+		    .stagingSize = 1024 * 1024,
+		    .scheduler = device.isTimelineSemaphoreEnabled() ? &frameScheduler : nullptr,
+		}));
+
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(allocator.createUniqueBuffer(
+		                                            sizeof(Vertex) * 6, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		                                            {},
+		                                            vk::MemoryPropertyFlagBits::eDeviceLocal,
+		                                            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE),
 		                                        vertexBuffer);
 
 		std::cout << "Created vertex buffer" << std::endl;
 
-		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(allocator.createBuffer(
-		                                            sizeof(Vertex) * 6, vk::BufferUsageFlagBits::eIndexBuffer,
-		                                            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-		                                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-		                                            VMA_MEMORY_USAGE_AUTO_PREFER_HOST),
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(allocator.createUniqueBuffer(
+		                                            sizeof(Vertex) * 6, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		                                            {},
+		                                            vk::MemoryPropertyFlagBits::eDeviceLocal,
+		                                            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE),
 		                                        indexBuffer);
 
 		std::cout << "Created Vertex & Index Buffer" << std::endl;
 
 		LIB_QUICK_BAIL(fillVertexBuffer());
 
-		LIB_QUICK_BAIL(swapchain.createFramebuffers({.renderPass = renderPass.get(),
-		                                             .layers = 1}));
+		if (renderPass)
+		{
+			LIB_QUICK_BAIL(swapchain.createFramebuffers({.renderPass = renderPass.get(),
+			                                             .layers = 1}));
 
-		std::cout << "Created framebuffers" << std::endl;
+			std::cout << "Created framebuffers" << std::endl;
+		}
 
-		LIB_QUICK_BAIL(createFrameDatas());
+		// sync objects, command buffers and a uniform region and descriptor set for every frame in flight
+		LIB_QUICK_BAIL(frameManager.createFrameManager({
+		    .device = &device,
+		    .allocator = &allocator,
+		    .graphicsQueue = graphicsQueue,
+		    .presentQueue = presentQueue,
+		    .framesInFlight = FRAMES_IN_FLIGHT,
+		    .uniformFrameSize = 256 * 1024,
+		    .descriptorSetLayout = descriptorSetLayout,
+		    .uniformBinding = 0,
+		    .uniformRange = sizeof(UniformBuffer),
+		    .scheduler = device.isTimelineSemaphoreEnabled() ? &frameScheduler : nullptr,
+		}));
 
-		std::cout << "Created frame data" << std::endl;
+		std::cout << "Created frame manager" << std::endl;
 
-		LIB_QUICK_BAIL(createDescriptorPool());
-		std::cout << "Created descriptor pool!" << std::endl;
+		LIB_QUICK_BAIL(benchmarkUniformUploads());
 
-		LIB_QUICK_BAIL(createDescriptorSets());
-		std::cout << "Created descriptor sets!" << std::endl;
+		LIB_QUICK_BAIL(recordingThreads.createThreadPool({}));
+		LIB_QUICK_BAIL(createParallelRecorder());
+		LIB_QUICK_BAIL(benchmarkParallelRecording());
+		LIB_QUICK_BAIL(benchmarkShaderCompilation());
+
+		LIB_QUICK_BAIL(staticPass.createCommandBufferCache({
+		    .device = &device,
+		    .queue = graphicsQueue,
+		}));
 
 
 		return VulkanResult::Success();
@@ -408,6 +531,7 @@ struct VkApp : VulkanApplication
 		static float currentTime = previousTime;
 		static float totalTime = 0;
 		static int fps = 0;
+		static float worstFrameTime = 0;
 
 		std::thread render_thread([this]()
 		                          {
@@ -423,12 +547,21 @@ struct VkApp : VulkanApplication
 			currentTime = glfwGetTime();
 			auto diff = currentTime - previousTime;
 			totalTime += diff;
+			worstFrameTime = std::max(worstFrameTime, diff);
 			++rendered_frames;
 			if(totalTime > 1) {
-				std::string newTitle = title + " - " + std::to_string(fps) + "fps - " + std::to_string(rendered_frames) + " rendered fps";
+				std::string newTitle = title + " - " + std::to_string(fps) + "fps - " + std::to_string(rendered_frames) + " rendered fps - worst frame " + std::to_string(worstFrameTime * 1000.0f) + "ms";
+				if (frameManager.getConfig().scheduler) {
+					newTitle += " - gpu latency " + std::to_string(takeAverageFrameLatency()) + "ms";
+				}
+				if (benchmarkPending) {
+					std::cout << "Worst frame time while creating a pipeline: " << worstFrameTime * 1000.0f << "ms" << std::endl;
+					benchmarkPending = false;
+				}
 				totalTime = 0;
 				fps = 0;
 				rendered_frames = 0;
+				worstFrameTime = 0;
 				glfwSetWindowTitle(window, newTitle.c_str());
 			}
 
@@ -442,20 +575,86 @@ struct VkApp : VulkanApplication
 		}
 
 		render_thread.join();
+		hotReloader.stop();
+		pipelineCompiler.shutdown();
 		auto _ = device.getDevice().waitIdle();
+
+		auto uploadStats = uploadManager.getStats();
+		std::cout << "Uploaded " << uploadStats.bytesUploaded << " bytes in " << uploadStats.batchCount << " transfer batches at "
+		          << uploadStats.megabytesPerSecond() << "MB/s, transfer queue busy " << uploadStats.queueOccupancy * 100.0 << "% of the time" << std::endl;
+
+		for (const auto &budget : allocator.getBudgets())
+		{
+			std::cout << "Memory heap " << budget.heapIndex << ": " << budget.usage << " of " << budget.budget << " bytes used, "
+			          << budget.allocationBytes << " bytes allocated by us" << std::endl;
+		}
+
+		if (frameManager.getConfig().scheduler)
+		{
+			auto schedulerStats = frameScheduler.getStats();
+			std::cout << "Frames took " << schedulerStats.averageLatency() << "ms on average from submission to completion, "
+			          << schedulerStats.submissions << " timeline submissions" << std::endl;
+		}
+
+		auto staticPassStats = staticPass.getStats();
+		std::cout << "Static pass replayed " << staticPassStats.hits << " times, recorded " << staticPassStats.recordings << " times" << std::endl;
+
+		auto frameStats = frameManager.getStats();
+		std::cout << "Waited " << frameStats.averageFenceWait() << "ms on average for frame fences (worst " << frameStats.worstFenceWait.count()
+		          << "ms) and " << frameStats.totalImageWait.count() << "ms in total for swapchain images with "
+		          << frameManager.getFramesInFlight() << " frames in flight" << std::endl;
+
+		auto commandBufferStats = frameManager.getCommandBuffers().getStats();
+		std::cout << "Allocated " << commandBufferStats.totalAllocated << " frame command buffers and reused them " << commandBufferStats.totalReused
+		          << " times, the last frame allocated " << commandBufferStats.lastFrame.allocated << " and reused " << commandBufferStats.lastFrame.reused << std::endl;
+
+		std::ofstream statsFile("allocator_stats.json");
+		statsFile << allocator.statsToJson();
+		std::cout << "Wrote allocator statistics to allocator_stats.json" << std::endl;
 		return VulkanResult::Success();
 	}
 
 	VulkanResult drawFrame()
 	{
-		VULKAN_QUICK_BAIL(device.getDevice().waitForFences(frameData[currentFrame].inFlightFence.get(), true, UINT32_MAX), "Coudln't wait for inflight fence");
+		LIB_QUICK_BAIL(applyFramesInFlightRequest());
+
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(frameManager.beginFrame(), auto frame);
+		auto frameNumber = frameManager.getFrameNumber();
+		// buffers released up to framesInFlight frames ago are no longer used by the GPU
+		allocator.beginFrame(frameNumber);
+		LIB_QUICK_BAIL(parallelRecorder.beginFrame(frameManager.getCurrentFrame()));
+		LIB_QUICK_BAIL(uploadManager.beginFrame(frameNumber));
+
+		// the fence wait above is the frame boundary, nothing recorded with a swapped out pipeline is still pending
+		hotReloader.applyPendingReloads(frameNumber);
+
+		auto cacheResult = device.savePipelineCacheIfDue();
+		if (cacheResult.type() != VulkanResultVariants::Success)
+		{
+			std::cerr << "Couldn't save pipeline cache: " << cacheResult.description() << std::endl;
+		}
+
+		LIB_QUICK_BAIL(handleBenchmarkRequest());
+
+		drawPipeline = &pipeline;
+		if (benchmarkPipeline.valid())
+		{
+			// the fallback until the background compilation is done
+			drawPipeline = benchmarkPipeline.get();
+		}
+		else if (syncBenchmarkPipeline.getPipeline())
+		{
+			drawPipeline = &syncBenchmarkPipeline;
+		}
 
 		uint32_t imageIndex;
-		auto image = device.getDevice().acquireNextImageKHR(swapchain.getSwapchain(), UINT64_MAX, frameData[currentFrame].imageAvailableSemaphore.get());
+		auto image = device.getDevice().acquireNextImageKHR(swapchain.getSwapchain(), UINT64_MAX, frame->imageAvailableSemaphore.get());
 
 		if (image.result == vk::Result::eErrorOutOfDateKHR)
 		{
 			Utils::recreateSwapchainFromWindow(window, device, swapchain);
+			// new framebuffers and extent
+			staticPass.invalidate();
 			return VulkanResult::Success();
 		}
 		else if (image.result != vk::Result::eSuccess && image.result != vk::Result::eSuboptimalKHR)
@@ -463,29 +662,50 @@ struct VkApp : VulkanApplication
 			return VulkanResult::VulkanError(image.result, "Couldn't acquire image for rendering!");
 		}
 		
-		updateUniformBuffer(currentFrame);
-
-		VULKAN_QUICK_BAIL(device.getDevice().resetFences(frameData[currentFrame].inFlightFence.get()), "Couldn't reset inflightfence!");
+		LIB_QUICK_BAIL(updateUniformBuffer(*frame));
+		LIB_QUICK_BAIL(frameManager.getFrameAllocator().flush());
 
 		imageIndex = image.value;
+		LIB_QUICK_BAIL(frameManager.claimImage(imageIndex));
+
+		// past the last early return, a step's semaphore has to be waited on by this frame's submission
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(stepDefragmentation(), auto defragmentation);
 
+		// copies queued since the last frame, this frame's acquire barriers and semaphore waits cover them
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(uploadManager.submit(), auto uploads);
 
-		frameData[currentFrame].commandBuffer.reset();
-		LIB_QUICK_BAIL(recordCommand(frameData[currentFrame].commandBuffer, imageIndex));
+		// reset with the rest of the frame's pool in beginFrame
+		auto commandBuffer = frame->commandBuffer;
+		LIB_QUICK_BAIL(recordCommand(commandBuffer, imageIndex));
 
-		auto waitSemaphores = {frameData[currentFrame].imageAvailableSemaphore.get()};
+		std::vector<vk::Semaphore> waitSemaphores = {frame->imageAvailableSemaphore.get()};
 		std::vector<vk::PipelineStageFlags> waitStages = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+		waitSemaphores.insert(waitSemaphores.end(), uploads.semaphores.begin(), uploads.semaphores.end());
+		waitStages.insert(waitStages.end(), uploads.waitStages.begin(), uploads.waitStages.end());
+		if (defragmentation.waitSemaphore)
+		{
+			waitSemaphores.push_back(defragmentation.waitSemaphore);
+			waitStages.push_back(defragmentation.waitStage);
+		}
 
-		vk::SubmitInfo submit{
-		    waitSemaphores,
-		    waitStages,
-		    frameData[currentFrame].commandBuffer,
-		    {frameData[currentFrame].renderFinishedSemaphore.get()}};
+		// with a scheduler both wait on the transfer timeline instead
+		std::vector<TimelineWait> timelineWaits = uploads.timelineWaits;
+		if (defragmentation.timelineWait)
+		{
+			timelineWaits.push_back(*defragmentation.timelineWait);
+		}
 
-		VULKAN_QUICK_BAIL(graphicsQueue->queue.submit(submit, frameData[currentFrame].inFlightFence.get()), "Couldn't submit to graphics queue");
+		// signals the frame's fence, or the graphics timeline with a scheduler
+		LIB_QUICK_BAIL(frameManager.submit({
+		    .commandBuffers = {commandBuffer},
+		    .timelineWaits = timelineWaits,
+		    .waitSemaphores = waitSemaphores,
+		    .waitStages = waitStages,
+		    .signalSemaphores = {frame->renderFinishedSemaphore.get()},
+		}));
 
 		vk::PresentInfoKHR presentInfo{
-		    {frameData[currentFrame].renderFinishedSemaphore.get()},
+		    {frame->renderFinishedSemaphore.get()},
 		    swapchain.getSwapchain(),
 		    imageIndex,
 		    {}};
@@ -496,13 +716,15 @@ struct VkApp : VulkanApplication
 		{
 			framebufferResized = false;
 			Utils::recreateSwapchainFromWindow(window, device, swapchain);
+			// new framebuffers and extent
+			staticPass.invalidate();
 		}
 		else if (presentResult != vk::Result::eSuccess)
 		{
 			return VulkanResult::VulkanError(presentResult, "Couldn't present to screen!");
 		}
 
-		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		frameManager.endFrame();
 
 		return VulkanResult::Success();
 	}
@@ -554,95 +776,111 @@ struct VkApp : VulkanApplication
 		return VulkanResult::Success();
 	}
 
-	VulkanResult createFrameDatas()
+	// over the frames seen done since the last call
+	double takeAverageFrameLatency()
 	{
-		frameData.resize(MAX_FRAMES_IN_FLIGHT);
-
-		LIB_QUICK_BAIL(createCommandBuffers());
-
-		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		auto completed = frameScheduler.takeCompletedFrames();
+		if (completed.empty())
 		{
-			vk::SemaphoreCreateInfo sempahoreInfo{
-			    vk::SemaphoreCreateFlags{},
-			    nullptr};
-
-			vk::FenceCreateInfo fenceInfo{
-			    vk::FenceCreateFlagBits::eSignaled,
-			    nullptr};
-			auto result1 = device.getDevice().createSemaphoreUnique(sempahoreInfo);
-			VULKAN_QUICK_BAIL(result1.result, "Couldn't create imageAvailableSemaphore");
-			auto result2 = device.getDevice().createSemaphoreUnique(sempahoreInfo);
-			VULKAN_QUICK_BAIL(result2.result, "Couldn't create renderFinishedSemaphore");
-			auto result3 = device.getDevice().createFenceUnique(fenceInfo);
-			VULKAN_QUICK_BAIL(result3.result, "Couldn't create inFlightFence");
-
-			result1.value.swap(frameData[i].imageAvailableSemaphore);
-			result2.value.swap(frameData[i].renderFinishedSemaphore);
-			result3.value.swap(frameData[i].inFlightFence);
-			
-			
-			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(allocator.createBuffer(
-				sizeof(UniformBuffer), vk::BufferUsageFlagBits::eUniformBuffer,
-				VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
-				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-				VMA_MEMORY_USAGE_AUTO_PREFER_HOST),
-				frameData[i].uniformBuffer);
-				
-			}
-		std::cout << "Created sync objects" << std::endl;
-		std::cout << "Created Uniform Buffers" << std::endl;
-			
+			return 0.0;
+		}
 
-		return VulkanResult();
+		double total = 0.0;
+		for (const auto &frame : completed)
+		{
+			total += frame.latency().count();
+		}
+		return total / completed.size();
 	}
 
-	ResultValue<std::vector<vk::UniqueCommandBuffer>> allocateCommandBuffers(vk::CommandPool commandPool, size_t count, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary)
+	VulkanResult applyFramesInFlightRequest()
 	{
-		// allocate main frame command buffers
-		vk::CommandBufferAllocateInfo allocateInfo{};
-		allocateInfo.setCommandPool(commandPool);
-		allocateInfo.setLevel(level);
-		allocateInfo.setCommandBufferCount(count);
-
-		auto commandBuffersResult = device.getDevice().allocateCommandBuffersUnique(allocateInfo);
-
-		VULKAN_QUICK_BAIL(commandBuffersResult.result, "Couldn't allocate command buffers!");
+		auto request = framesInFlightRequest.exchange(0);
+		if (request == 0 || request == frameManager.getFramesInFlight())
+		{
+			return VulkanResult::Success();
+		}
 
-		return std::move(commandBuffersResult.value);
+		// waits for every frame, nothing recorded or queued with the old count is still pending afterwards
+		LIB_QUICK_BAIL(frameManager.setFramesInFlight(request));
+		uploadManager.getConfig().framesInFlight = request;
+		hotReloader.getConfig().framesInFlight = request;
+		// the descriptor sets were recreated and the keys are laid out by frame
+		staticPass.invalidate();
+		return createParallelRecorder();
 	}
 
-	VulkanResult createCommandBuffers()
+	VulkanResult createParallelRecorder()
 	{
+		return parallelRecorder.createParallelRecorder({
+		    .device = &device,
+		    .queue = graphicsQueue,
+		    .threadPool = &recordingThreads,
+		    .framesInFlight = frameManager.getFramesInFlight(),
+		});
+	}
 
-		vk::CommandPoolCreateInfo commandPoolInfo{};
-		commandPoolInfo.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
-		commandPoolInfo.setQueueFamilyIndex(graphicsQueue->queueIndex.value());
-
-		VULKAN_SET_AND_BAIL_RESULT_VALUE(
-		    device.getDevice().createCommandPoolUnique(commandPoolInfo),
-		    commandPool,
-		    "Couldn't create command pool");
-		std::cout << "Created main command pool" << std::endl;
+	ResultValue<DefragmentationStep> stepDefragmentation()
+	{
+		if (defragmentRequest.exchange(false) && !allocator.isDefragmenting())
+		{
+			// vertex and index buffers are read through their UniqueBuffer every recording, nothing to fix up
+			LIB_QUICK_BAIL(allocator.beginDefragmentation({
+			    .transferQueue = transferQueue,
+			    .destinationQueue = graphicsQueue,
+			    .scheduler = device.isTimelineSemaphoreEnabled() ? &frameScheduler : nullptr,
+			}));
+			std::cout << "Started defragmentation" << std::endl;
+		}
 
-		commandPoolInfo.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
-		commandPoolInfo.setQueueFamilyIndex(transferQueue->queueIndex.value());
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(allocator.stepDefragmentation(), auto step);
+		if (step.pass)
+		{
+			std::cout << "Defragmentation pass: moved " << step.pass->moves << " buffers (" << step.pass->bytesMoved << " bytes), skipped "
+			          << step.pass->skipped << ", reclaimed " << step.pass->bytesReclaimed << " bytes" << std::endl;
+		}
+		return step;
+	}
 
-		VULKAN_SET_AND_BAIL_RESULT_VALUE(
-		    device.getDevice().createCommandPoolUnique(commandPoolInfo),
-		    transferCommandPool,
-		    "Couldn't create transfer command pool");
-		std::cout << "Created transfer command pool" << std::endl;
+	VulkanResult handleBenchmarkRequest()
+	{
+		// beginFrame waited for every frame that could still draw with them
+		uint64_t frameNumber = frameManager.getFrameNumber();
+		std::erase_if(retiredBenchmarkPipelines, [this, frameNumber](const RetiredBenchmarkPipeline &retired)
+		              { return retired.retiredAt + frameManager.getFramesInFlight() <= frameNumber; });
 
-		LIB_SET_AND_BAIL_RESULT_VALUE(
-		    allocateCommandBuffers(commandPool.get(), MAX_FRAMES_IN_FLIGHT),
-		    commandBuffers);
+		auto request = benchmarkRequest.exchange(BenchmarkRequest::None);
+		if (request == BenchmarkRequest::None)
+		{
+			return VulkanResult::Success();
+		}
 
-		for (size_t i = 0; i < commandBuffers.size(); ++i)
+		// a depth bias no other pipeline uses makes sure neither cache can hand back an existing pipeline. Not
+		// pipeline's own config, after a hot reload its modules are gone.
+		auto benchmarkConfig = triangleConfig;
+		benchmarkConfig.razterizationInfo.depthBiasConstantFactor = static_cast<float>(++benchmarkPipelineCount);
+		benchmarkConfig.stateCache = nullptr;
+		benchmarkPending = true;
+
+		// the previous benchmark pipeline may still be used by a frame in flight, waiting for them here would
+		// show up in the frame time being measured
+		retiredBenchmarkPipelines.push_back({
+		    .handle = std::move(benchmarkPipeline),
+		    .pipeline = std::move(syncBenchmarkPipeline),
+		    .retiredAt = frameManager.getFrameNumber(),
+		});
+		// a new pipeline can get the old one's handle, which the static pass state wouldn't tell apart
+		staticPass.invalidate();
+
+		if (request == BenchmarkRequest::Async)
 		{
-			frameData[i].commandBuffer = commandBuffers[i].get();
+			benchmarkPipeline = pipelineCompiler.compile(benchmarkConfig);
+			syncBenchmarkPipeline = GraphicsPipeline{};
+			return VulkanResult::Success();
 		}
 
-		return VulkanResult();
+		benchmarkPipeline = PipelineHandle{};
+		return syncBenchmarkPipeline.createGraphicsPipeline(benchmarkConfig);
 	}
 
 	VulkanResult recordCommand(vk::CommandBuffer buffer, uint32_t imageIndex)
@@ -655,34 +893,150 @@ struct VkApp : VulkanApplication
 
 		VULKAN_QUICK_BAIL(buffer.begin(commandBegin), "Couldn't begin command buffer!");
 
-		auto clearColors = {vk::ClearValue{vk::ClearColorValue{0.0f, 0.0f, 0.0f, 1.0f}}};
+		// takes ownership of freshly uploaded buffers from the transfer queue family
+		uploadManager.recordAcquireBarriers(buffer);
+
+		vk::ClearColorValue clearColor{0.0f, 0.0f, 0.0f, 1.0f};
+		auto clearColors = {vk::ClearValue{clearColor}};
 
 		vk::Extent2D swapchainExtent = swapchain.getSwapchainConfig().extent;
 
-		vk::RenderPassBeginInfo passBegin = {
-		    renderPass.get(),
-		    swapchain.getFramebuffers()[imageIndex].get(),
-		    {
-		        vk::Offset2D{0, 0},
-		        swapchainExtent,
-		    },
-		    clearColors,
-		    nullptr};
+		// the draws go into secondaries recorded on the worker threads, nothing is drawn inline then
+		bool parallel = parallelRecording;
+		// or into one recorded once and replayed while nothing it uses changed
+		bool cached = cacheStaticPass;
+		if (cached)
+		{
+			updateStaticPassState();
+		}
+		staticPassCached = cached;
 
-		vk::Buffer vertexBuffers[] = {vertexBuffer.buffer};
-		VmaAllocationInfo vertexAlloc;
-		vmaGetAllocationInfo(allocator.getAllocator(), vertexBuffer.allocation, &vertexAlloc);
-		vk::DeviceSize vertexBufferOffsets = {0};
+		if (renderPass)
+		{
+			vk::RenderPassBeginInfo passBegin = {
+			    renderPass.get(),
+			    swapchain.getFramebuffers()[imageIndex].get(),
+			    {
+			        vk::Offset2D{0, 0},
+			        swapchainExtent,
+			    },
+			    clearColors,
+			    nullptr};
 
-		buffer.bindVertexBuffers(0, vertexBuffers, vertexBufferOffsets);
+			buffer.beginRenderPass(passBegin, parallel || cached ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline);
+		}
+		else
+		{
+			swapchain.beginRendering(buffer, imageIndex, clearColor,
+			                         parallel || cached ? vk::RenderingFlagBits::eContentsSecondaryCommandBuffers : vk::RenderingFlags{});
+		}
 
-		VmaAllocationInfo indexAlloc;
-		vmaGetAllocationInfo(allocator.getAllocator(), indexBuffer.allocation, &indexAlloc);
+		if (cached)
+		{
+			Inheritance inheritance;
+			fillInheritance(inheritance, imageIndex);
+			// the frame's descriptor set is baked in, so an entry per image and frame in flight
+			uint32_t key = imageIndex * frameManager.getFramesInFlight() + frameManager.getCurrentFrame();
+			LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(staticPass.get(key, frameManager.getFrame().uniformOffset, inheritance.info, [this](vk::CommandBuffer commandBuffer)
+			                                                        { return recordDraws(commandBuffer, *drawPipeline, 0, 1); }),
+			                                        auto commands);
+			buffer.executeCommands(commands);
+		}
+		else if (parallel)
+		{
+			Inheritance inheritance;
+			fillInheritance(inheritance, imageIndex);
+			LIB_QUICK_BAIL(parallelRecorder.recordInto(buffer, 1, inheritance.info, [this](vk::CommandBuffer commandBuffer, uint32_t first, uint32_t last)
+			                                           { return recordDraws(commandBuffer, *drawPipeline, first, last); }));
+		}
+		else
+		{
+			LIB_QUICK_BAIL(recordDraws(buffer, *drawPipeline, 0, 1));
+		}
 
-		buffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
+		if (renderPass)
+		{
+			buffer.endRenderPass();
+		}
+		else
+		{
+			swapchain.endRendering(buffer, imageIndex);
+		}
 
-		buffer.beginRenderPass(passBegin, vk::SubpassContents::eInline);
-		buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getPipeline());
+		VULKAN_QUICK_BAIL(buffer.end(), "Couldn't end recording of command buffer!");
+
+		return VulkanResult::Success();
+	}
+
+	// what the static pass's draws reference, the vertex and index buffers change handles when defragmented
+	struct StaticPassState
+	{
+		vk::Pipeline pipeline;
+		vk::Buffer vertexBuffer;
+		vk::Buffer indexBuffer;
+
+		bool operator==(const StaticPassState &) const = default;
+	};
+
+	// invalidates the cached static pass when the pipeline or geometry changed since the last frame
+	void updateStaticPassState()
+	{
+		// turned on again, the entries weren't kept up to date
+		if (!staticPassCached)
+		{
+			staticPass.invalidate();
+		}
+
+		StaticPassState state{drawPipeline->getPipeline(), vertexBuffer->buffer, indexBuffer->buffer};
+		if (state != staticPassState)
+		{
+			staticPass.invalidate();
+			staticPassState = state;
+		}
+	}
+
+	// the state secondaries inherit, the rendering info is pointed to by info when there's no render pass
+	struct Inheritance
+	{
+		vk::Format colorFormat = vk::Format::eUndefined;
+		vk::CommandBufferInheritanceRenderingInfo rendering;
+		vk::CommandBufferInheritanceInfo info;
+
+		// info points into the struct
+		Inheritance() = default;
+		Inheritance(const Inheritance &) = delete;
+	};
+
+	void fillInheritance(Inheritance &inheritance, uint32_t imageIndex)
+	{
+		if (renderPass)
+		{
+			inheritance.info.setRenderPass(renderPass.get());
+			inheritance.info.setSubpass(0);
+			inheritance.info.setFramebuffer(swapchain.getFramebuffers()[imageIndex].get());
+			return;
+		}
+
+		inheritance.colorFormat = swapchain.getSwapchainConfig().surfaceFormat.format;
+		inheritance.rendering.setColorAttachmentFormats(inheritance.colorFormat);
+		inheritance.rendering.setRasterizationSamples(vk::SampleCountFlagBits::e1);
+		inheritance.info.setPNext(&inheritance.rendering);
+	}
+
+	// draws [first, last) of the scene, every draw is the quad. Binds everything itself, a secondary
+	// inherits nothing from its primary.
+	VulkanResult recordDraws(vk::CommandBuffer buffer, GraphicsPipeline &drawWith, uint32_t first, uint32_t last)
+	{
+		vk::Extent2D swapchainExtent = swapchain.getSwapchainConfig().extent;
+
+		vk::Buffer vertexBuffers[] = {vertexBuffer->buffer};
+		vk::DeviceSize vertexBufferOffsets = {0};
+
+		buffer.bindVertexBuffers(0, vertexBuffers, vertexBufferOffsets);
+		buffer.bindIndexBuffer(indexBuffer->buffer, 0, vk::IndexType::eUint32);
+
+		buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, drawWith.getPipeline());
+		Utils::recordDynamicState(buffer, drawWith.getPipelineConfig());
 
 
 		vk::Viewport viewport{
@@ -702,122 +1056,263 @@ struct VkApp : VulkanApplication
 
 		buffer.setScissor(0, scissor);
 
-		buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline.getPipelineLayout(), 0, {frameData[currentFrame].descriptorSet.get()}, {});
+		buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, drawWith.getPipelineLayout(), 0, {frameManager.getFrame().descriptorSet}, {frameManager.getFrame().uniformOffset});
 
-		buffer.drawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		for (uint32_t i = first; i < last; ++i)
+		{
+			buffer.drawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		}
 
-		buffer.endRenderPass();
+		return VulkanResult::Success();
+	}
 
-		VULKAN_QUICK_BAIL(buffer.end(), "Couldn't end recording of command buffer!");
+	// records BENCHMARK_DRAWS draws into secondaries with 1 to N threads, nothing is submitted
+	VulkanResult benchmarkParallelRecording()
+	{
+		constexpr uint32_t BENCHMARK_DRAWS = 100000;
+		uint32_t maxThreads = std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+		Inheritance inheritance;
+		fillInheritance(inheritance, 0);
+
+		std::chrono::duration<double, std::milli> singleThreaded{0};
+		for (uint32_t threads = 1; threads <= maxThreads; ++threads)
+		{
+			ThreadPool pool;
+			LIB_QUICK_BAIL(pool.createThreadPool({.threadCount = threads}));
+
+			ParallelRecorder recorder;
+			LIB_QUICK_BAIL(recorder.createParallelRecorder({
+			    .device = &device,
+			    .queue = graphicsQueue,
+			    .threadPool = &pool,
+			    .framesInFlight = 1,
+			}));
+
+			// the first run allocates the secondaries, the second one is what a frame costs
+			for (uint32_t run = 0; run < 2; ++run)
+			{
+				LIB_QUICK_BAIL(recorder.beginFrame(0));
+				LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(recorder.record(BENCHMARK_DRAWS, inheritance.info, [this](vk::CommandBuffer commandBuffer, uint32_t first, uint32_t last)
+				                                                        { return recordDraws(commandBuffer, pipeline, first, last); }),
+				                                        auto commandBuffers);
+			}
+
+			auto recordTime = recorder.getStats().lastRecordTime;
+			if (threads == 1)
+			{
+				singleThreaded = recordTime;
+			}
+			std::cout << "Recorded " << BENCHMARK_DRAWS << " draws with " << threads << " threads in " << recordTime.count() << "ms ("
+			          << singleThreaded / recordTime << "x)" << std::endl;
+		}
 
 		return VulkanResult::Success();
 	}
 
-	VulkanResult fillVertexBuffer()
+	// compiles the module's programs on 1 to N threads without the shader cache, every program is queued
+	// PROGRAM_COPIES times so each thread count has enough work to spread
+	VulkanResult benchmarkShaderCompilation()
 	{
+		constexpr uint32_t PROGRAM_COPIES = 4;
+		uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
 
-		void *data;
-		VULKAN_QUICK_BAIL((vk::Result)vmaMapMemory(allocator.getAllocator(), vertexBuffer.allocation, (void **)&data), "Couldn't map vertex buffer memory");
+		std::vector<Utils::ShaderProgramSources> programs;
+		for (uint32_t i = 0; i < PROGRAM_COPIES; ++i)
+		{
+			programs.push_back({
+			    {std::filesystem::path("shaders") / "simple_triangle.frag.glsl", EShLanguage::EShLangFragment},
+			    {std::filesystem::path("shaders") / "simple_triangle.vert.glsl", EShLanguage::EShLangVertex},
+			});
+			programs.push_back({
+			    {std::filesystem::path("shaders") / "lit_triangle.frag.glsl", EShLanguage::EShLangFragment},
+			    {std::filesystem::path("shaders") / "simple_triangle.vert.glsl", EShLanguage::EShLangVertex},
+			});
+		}
 
-		memcpy(data, vertices.data(), vertices.size() * sizeof(Vertex));
-		vmaUnmapMemory(allocator.getAllocator(), vertexBuffer.allocation);
+		// a cache hit would skip glslang entirely
+		auto options = shaderCompileOptions;
+		options.cache = nullptr;
 
-		std::cout << "Filled vertex buffer !" << std::endl;
+		std::chrono::duration<double, std::milli> singleThreaded{0};
+		for (uint32_t threads = 1; threads <= maxThreads; ++threads)
+		{
+			ThreadPool pool;
+			LIB_QUICK_BAIL(pool.createThreadPool(Utils::shaderCompilerThreadPoolConfig(threads)));
+
+			auto start = std::chrono::steady_clock::now();
+			auto results = Utils::compileShaderPrograms(programs, options, &pool);
+			std::chrono::duration<double, std::milli> compileTime = std::chrono::steady_clock::now() - start;
 
-		void *indexData;
-		VULKAN_QUICK_BAIL((vk::Result)vmaMapMemory(allocator.getAllocator(), indexBuffer.allocation, (void **)&indexData), "Couldn't map index buffer memory");
+			for (const auto &result : results)
+			{
+				LIB_QUICK_BAIL(result.result);
+			}
 
-		memcpy(indexData, indices.data(), indices.size() * sizeof(uint32_t));
-		vmaUnmapMemory(allocator.getAllocator(), indexBuffer.allocation);
+			if (threads == 1)
+			{
+				singleThreaded = compileTime;
+			}
+			std::cout << "Compiled " << programs.size() << " shader programs with " << threads << " threads in " << compileTime.count() << "ms ("
+			          << singleThreaded / compileTime << "x)" << std::endl;
+		}
 
-		std::cout << "Filled index buffer !" << std::endl;
 		return VulkanResult::Success();
 	}
 
-	VulkanResult createDescriptorSetLayout() {
-		auto binding = UniformBuffer::getBindingDescription();
-		vk::DescriptorSetLayoutCreateInfo createInfo{};
-		createInfo.setBindings(binding);
+	VulkanResult fillVertexBuffer()
+	{
+		// queued here, the first frame submits the copies and waits on them
+		LIB_QUICK_BAIL(uploadManager.upload(vertexBuffer->buffer, vertices.data(), vertices.size() * sizeof(Vertex), 0,
+		                                    vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead));
+
+		std::cout << "Filled vertex buffer !" << std::endl;
 
-		VULKAN_SET_AND_BAIL_RESULT_VALUE(device.getDevice().createDescriptorSetLayoutUnique(createInfo), descriptorSetLayout, "Couldn't create descriptor set layout!");
+		LIB_QUICK_BAIL(uploadManager.upload(indexBuffer->buffer, indices.data(), indices.size() * sizeof(uint32_t), 0,
+		                                    vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eIndexRead));
 
+		std::cout << "Filled index buffer !" << std::endl;
 		return VulkanResult::Success();
 	}
 
-	void updateUniformBuffer(uint32_t currentImage) {
-		auto& buffer = frameData[currentImage].uniformBuffer;
-		auto ubo = UniformBuffer{};
-		ubo.model = glm::translate(glm::vec3(1.0, 0, 0));
-		vk::Extent2D swapchainExtent = swapchain.getSwapchainConfig().extent;
+	// builds every variant of lit_triangle.frag.glsl (vertex color on or off, 0 to 3 lights) from one compile with
+	// specialization constants, then compiling each variant on its own with defines. Nothing is drawn with them.
+	VulkanResult benchmarkShaderPermutations(const GraphicsPipelineConfig &baseConfig)
+	{
+		constexpr uint32_t MAX_LIGHTS = 3;
 
-		ubo.projection = glm::perspective(glm::radians(45.0f), (float)swapchainExtent.width / (float) swapchainExtent.height, 0.1f, 10.0f);
-		ubo.projection[1][1] *= -1;
+		Utils::ShaderProgramSources sources = {
+		    {std::filesystem::path("shaders") / "lit_triangle.frag.glsl", EShLanguage::EShLangFragment},
+		    {std::filesystem::path("shaders") / "simple_triangle.vert.glsl", EShLanguage::EShLangVertex},
+		};
 
-		ubo.view = glm::lookAt(
-			glm::vec3(0.0f, 0.0f, 3.0f),  // Camera position (in front of the object)
-			glm::vec3(0.0f, 0.0f, 0.0f),  // Look at the origin
-			glm::vec3(0.0f, 1.0f, 0.0f)   // Up direction
-		);
+		// both sides compile from GLSL every time
+		auto options = shaderCompileOptions;
+		options.cache = nullptr;
 
-		void* uniformDataMap;
-		vmaMapMemory(allocator.getAllocator(), buffer.allocation, &uniformDataMap);
+		// same layout and vertex input as the triangle, only the shader stages differ
+		auto variantConfig = baseConfig;
+		variantConfig.stateCache = nullptr;
 
-		memcpy(uniformDataMap, &ubo, sizeof(ubo));
+		auto start = std::chrono::steady_clock::now();
 
-		vmaUnmapMemory(allocator.getAllocator(), buffer.allocation);
+		ShaderPermutationFamily family;
+		LIB_QUICK_BAIL(family.createShaderPermutationFamily({
+		    .device = &device,
+		    .sources = sources,
+		    .compileOptions = options,
+		    .features = {
+		        {.name = "VERTEX_COLOR", .constantId = 0},
+		        {.name = "LIGHT_COUNT", .constantId = 1, .bitCount = 2},
+		    },
+		    .pipelineConfig = variantConfig,
+		}));
 
+		for (uint32_t vertexColor = 0; vertexColor < 2; ++vertexColor)
+		{
+			for (uint32_t lights = 0; lights <= MAX_LIGHTS; ++lights)
+			{
+				LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(family.makeKey({{"VERTEX_COLOR", vertexColor}, {"LIGHT_COUNT", lights}}), auto key);
+				LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(family.getVariant(key), auto variant);
+			}
+		}
 
+		std::chrono::duration<double, std::milli> familyTime = std::chrono::steady_clock::now() - start;
+		size_t familyBytes = 0;
+		for (const auto &spirv : family.getProgram().spirv)
+		{
+			familyBytes += spirv.size() * sizeof(uint32_t);
+		}
 
-	}
+		start = std::chrono::steady_clock::now();
 
-	VulkanResult createDescriptorPool() 
-	{
-		vk::DescriptorPoolSize descriptorPoolSize{};
-		descriptorPoolSize.setType(vk::DescriptorType::eUniformBuffer);
-		descriptorPoolSize.setDescriptorCount(MAX_FRAMES_IN_FLIGHT);
+		size_t separateBytes = 0;
+		for (uint32_t vertexColor = 0; vertexColor < 2; ++vertexColor)
+		{
+			for (uint32_t lights = 0; lights <= MAX_LIGHTS; ++lights)
+			{
+				auto variantOptions = options;
+				variantOptions.defines = {{"VERTEX_COLOR", vertexColor ? "true" : "false"}, {"LIGHT_COUNT", std::to_string(lights)}};
+				LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::compileShaderProgram(sources, variantOptions), auto program);
+
+				LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createShaderModule(device, program.spirv[0]), auto fragmentModule);
+				LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(Utils::createShaderModule(device, program.spirv[1]), auto vertexModule);
+
+				auto config = variantConfig;
+				config.shaderStages = {
+				    {{}, vk::ShaderStageFlagBits::eFragment, fragmentModule.get(), "main"},
+				    {{}, vk::ShaderStageFlagBits::eVertex, vertexModule.get(), "main"},
+				};
+
+				GraphicsPipeline variant;
+				LIB_QUICK_BAIL(variant.createGraphicsPipeline(config));
+
+				for (const auto &spirv : program.spirv)
+				{
+					separateBytes += spirv.size() * sizeof(uint32_t);
+				}
+			}
+		}
 
-		vk::DescriptorPoolCreateInfo createInfo{};
-		createInfo.setPoolSizes({descriptorPoolSize});
-		createInfo.setMaxSets(static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT));
+		std::chrono::duration<double, std::milli> separateTime = std::chrono::steady_clock::now() - start;
 
-		VULKAN_SET_AND_BAIL_RESULT_VALUE(device.getDevice().createDescriptorPoolUnique(createInfo), descriptorPool, "Coudln't create descriptor pool");
+		std::cout << "Shader permutations: " << family.getVariantCount() << " variants from one compile in " << familyTime.count() << "ms ("
+		          << familyBytes << " bytes of SPIR-V), compiled separately in " << separateTime.count() << "ms (" << separateBytes
+		          << " bytes of SPIR-V)" << std::endl;
 
 		return VulkanResult::Success();
 	}
 
-	VulkanResult createDescriptorSets()
+	// what updateUniformBuffer used to cost with a map and unmap every frame against the persistent mapping
+	VulkanResult benchmarkUniformUploads()
 	{
-		std::vector<vk::DescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout.get());
-		vk::DescriptorSetAllocateInfo allocInfo{};
-		allocInfo.setDescriptorPool(descriptorPool.get());
-		allocInfo.setSetLayouts(layouts);
+		constexpr uint32_t ITERATIONS = 10000;
+		auto &buffer = frameManager.getFrameAllocator().getAllocation();
+		UniformBuffer ubo{};
 
-		std::vector<vk::UniqueDescriptorSet> descriptorsets;
-		VULKAN_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(device.getDevice().allocateDescriptorSetsUnique(allocInfo), descriptorsets, "Couldn't create descriptor sets.");
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < ITERATIONS; ++i)
+		{
+			void *data;
+			VULKAN_QUICK_BAIL((vk::Result)vmaMapMemory(allocator.getAllocator(), buffer.allocation, &data), "Couldn't map uniform buffer memory");
+			memcpy(data, &ubo, sizeof(ubo));
+			vmaUnmapMemory(allocator.getAllocator(), buffer.allocation);
+		}
+		auto mapped = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
 
-		for(size_t i = 0; i < frameData.size(); ++i) {
-			descriptorsets[i].swap(frameData[i].descriptorSet);
+		start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < ITERATIONS; ++i)
+		{
+			LIB_QUICK_BAIL(allocator.write(buffer, &ubo, sizeof(ubo)));
 		}
+		auto persistent = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+
+		std::cout << "Uniform upload: " << mapped.count() / ITERATIONS << "us with map/unmap, "
+		          << persistent.count() / ITERATIONS << "us persistently mapped" << std::endl;
+
+		return VulkanResult::Success();
+	}
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vk::DescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = frameData[i].uniformBuffer.buffer;
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBuffer);
+	VulkanResult updateUniformBuffer(FrameData &frame) {
+		auto ubo = UniformBuffer{};
+		ubo.model = glm::translate(glm::vec3(1.0, 0, 0));
+		vk::Extent2D swapchainExtent = swapchain.getSwapchainConfig().extent;
 
-            vk::WriteDescriptorSet descriptorWrite{};
-            descriptorWrite.dstSet = frameData[i].descriptorSet.get();
-            descriptorWrite.dstBinding = 0;
-            descriptorWrite.dstArrayElement = 0;
-            descriptorWrite.descriptorType = vk::DescriptorType::eUniformBuffer;
-            descriptorWrite.descriptorCount = 1;
-            descriptorWrite.pBufferInfo = &bufferInfo;
+		ubo.projection = glm::perspective(glm::radians(45.0f), (float)swapchainExtent.width / (float) swapchainExtent.height, 0.1f, 10.0f);
+		ubo.projection[1][1] *= -1;
 
-            device.getDevice().updateDescriptorSets(1, &descriptorWrite, 0, nullptr);
-        }
+		ubo.view = glm::lookAt(
+			glm::vec3(0.0f, 0.0f, 3.0f),  // Camera position (in front of the object)
+			glm::vec3(0.0f, 0.0f, 0.0f),  // Look at the origin
+			glm::vec3(0.0f, 1.0f, 0.0f)   // Up direction
+		);
 
+		// a pointer bump and a memcpy, the region was reclaimed by beginFrame after the fence wait
+		LIB_SET_AND_BAIL_RESULT_VALUE_UNSCOPPED(frameManager.getFrameAllocator().push(ubo), auto allocation);
+		frame.uniformOffset = allocation.offset;
 
 		return VulkanResult::Success();
+
+
 	}
 
 private:
@@ -825,27 +1320,69 @@ private:
 	Instance instance;
 	Device device;
 	Swapchain swapchain;
+	ShaderCache shaderCache;
+	ShaderBundle shaderBundle;
+	Utils::ShaderCompileOptions shaderCompileOptions;
 	vk::UniqueRenderPass renderPass;
 	
-	vk::UniqueDescriptorSetLayout descriptorSetLayout;
-	vk::UniqueDescriptorPool descriptorPool;
+	DescriptorSetLayoutCache layoutCache;
+	PipelineStateCache pipelineStateCache;
+	vk::DescriptorSetLayout descriptorSetLayout;
 
 
+	// kept for the whole run, the benchmark pipelines are built from triangleConfig
+	vk::UniqueShaderModule triangleFragmentModule;
+	vk::UniqueShaderModule triangleVertexModule;
+	GraphicsPipelineConfig triangleConfig;
 	GraphicsPipeline pipeline;
+	PipelineHotReloader hotReloader;
+
+	enum class BenchmarkRequest
+	{
+		None,
+		Async,
+		Sync,
+	};
+
+	AsyncPipelineCompiler pipelineCompiler;
+	PipelineHandle benchmarkPipeline;
+	GraphicsPipeline syncBenchmarkPipeline;
+
+	struct RetiredBenchmarkPipeline
+	{
+		PipelineHandle handle;
+		GraphicsPipeline pipeline;
+		uint64_t retiredAt;
+	};
+	std::vector<RetiredBenchmarkPipeline> retiredBenchmarkPipelines;
+	GraphicsPipeline *drawPipeline = nullptr;
+	std::atomic<BenchmarkRequest> benchmarkRequest = BenchmarkRequest::None;
+	uint32_t benchmarkPipelineCount = 0;
+	bool benchmarkPending = false;
+	std::atomic<bool> defragmentRequest = false;
+	std::atomic<uint32_t> framesInFlightRequest = 0;
+	std::atomic<bool> parallelRecording = false;
+	std::atomic<bool> cacheStaticPass = false;
+	// before everything waiting on its timelines when destroyed
+	FrameScheduler frameScheduler;
 	Allocator allocator;
-	vk::UniqueCommandPool commandPool, transferCommandPool;
-	std::vector<vk::UniqueCommandBuffer> commandBuffers;
+	UploadManager uploadManager;
+	FrameManager frameManager;
+	ThreadPool recordingThreads;
+	ParallelRecorder parallelRecorder;
+	// the draws recorded once per swapchain image and frame in flight
+	CommandBufferCache staticPass;
+	StaticPassState staticPassState;
+	bool staticPassCached = false;
 
 	QueueInformation *graphicsQueue;
 	QueueInformation *presentQueue;
 	QueueInformation *computeQueue;
 	QueueInformation *transferQueue;
 
-	Buffer vertexBuffer;
-	Buffer indexBuffer;
+	UniqueBuffer vertexBuffer;
+	UniqueBuffer indexBuffer;
 
-	std::vector<FrameData> frameData;
-	size_t currentFrame = 0;
 	bool framebufferResized = false;
 	size_t rendered_frames = 0;
 };
@@ -0,0 +1,171 @@
+#include "shader_bundle.hpp"
+#include "utils.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <vector>
+
+// Compiles GLSL ahead of time into a bundle the library maps at runtime.
+//
+// ShaderCompiler [-o shaders.bundle] [-I include_dir]... [-O none|performance|size] [--strip] <shader or directory>...
+//
+// Stages come from the file names (name.vert.glsl, name.frag.glsl, ...), files that only differ
+// by their stage are linked together as one program, like the modules do at runtime.
+
+static void printUsage()
+{
+	std::cerr << "usage: ShaderCompiler [-o shaders.bundle] [-I include_dir]... [-O none|performance|size] [--strip] <shader or directory>..." << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+	std::filesystem::path output = "shaders.bundle";
+	std::vector<std::filesystem::path> inputs;
+	Vulkan::Utils::ShaderCompileOptions options{};
+	std::vector<std::filesystem::path> includeDirectories;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (argument == "-o" && hasValue)
+		{
+			output = argv[++i];
+		}
+		else if (argument == "-I" && hasValue)
+		{
+			includeDirectories.push_back(argv[++i]);
+		}
+		else if (argument == "-O" && hasValue)
+		{
+			std::string level = argv[++i];
+			if (level == "none")
+			{
+				options.optimization = Vulkan::Utils::ShaderOptimization::None;
+			}
+			else if (level == "performance")
+			{
+				options.optimization = Vulkan::Utils::ShaderOptimization::Performance;
+			}
+			else if (level == "size")
+			{
+				options.optimization = Vulkan::Utils::ShaderOptimization::Size;
+			}
+			else
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (argument == "--strip")
+		{
+			options.stripDebugInfo = true;
+		}
+		else if (!argument.empty() && argument[0] == '-')
+		{
+			printUsage();
+			return 1;
+		}
+		else
+		{
+			inputs.push_back(argument);
+		}
+	}
+
+	if (inputs.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	if (!includeDirectories.empty())
+	{
+		options.includeDirectories = includeDirectories;
+	}
+
+	// program name (path without the stage and .glsl extensions) -> its stages
+	std::map<std::string, Vulkan::Utils::ShaderProgramSources> grouped;
+	auto addShader = [&grouped](const std::filesystem::path &path)
+	{
+		auto language = Vulkan::Utils::shaderLanguageFromPath(path);
+		if (!language.has_value())
+		{
+			return;
+		}
+
+		auto name = path.lexically_normal();
+		name.replace_extension();
+		if (name.has_extension())
+		{
+			name.replace_extension();
+		}
+
+		grouped[name.generic_string()].push_back({path.lexically_normal(), language.value()});
+	};
+
+	for (const auto &input : inputs)
+	{
+		if (std::filesystem::is_directory(input))
+		{
+			for (const auto &entry : std::filesystem::recursive_directory_iterator(input))
+			{
+				if (entry.is_regular_file())
+				{
+					addShader(entry.path());
+				}
+			}
+		}
+		else if (std::filesystem::is_regular_file(input))
+		{
+			addShader(input);
+		}
+		else
+		{
+			std::cerr << input.string() << " doesn't exist" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<Vulkan::Utils::ShaderProgramSources> programs;
+	for (auto &[name, sources] : grouped)
+	{
+		programs.push_back(std::move(sources));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	auto results = Vulkan::Utils::compileShaderPrograms(programs, options);
+
+	std::vector<Vulkan::Utils::CompiledShaderProgram> compiled;
+	bool failed = false;
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		if (results[i].result.type() != Vulkan::VulkanResultVariants::Success)
+		{
+			std::cerr << programs[i].front().first.string() << ": " << results[i].result.description() << std::endl;
+			failed = true;
+			continue;
+		}
+		compiled.push_back(std::move(results[i].value));
+	}
+
+	if (failed)
+	{
+		return 1;
+	}
+
+	auto result = Vulkan::Utils::writeShaderBundle(output, programs, compiled, options);
+	if (result.type() != Vulkan::VulkanResultVariants::Success)
+	{
+		std::cerr << result.description() << std::endl;
+		return 1;
+	}
+
+	auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+	std::cout << "Wrote " << programs.size() << " programs to " << output.string() << " in " << elapsed.count() << "ms" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+#version 450
+
+// x is specialized from the device limits when the pipeline is created
+layout(local_size_x_id = 0) in;
+
+struct SourceVertex {
+    vec2 position;
+    float phase;
+    float amplitude;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer SourceVertices {
+    SourceVertex vertices[];
+} source;
+
+layout(std430, set = 0, binding = 1) writeonly buffer AnimatedVertices {
+    vec2 positions[];
+} animated;
+
+layout(push_constant) uniform Animation {
+    float time;
+    uint vertexCount;
+} animation;
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= animation.vertexCount) {
+        return;
+    }
+
+    SourceVertex vertex = source.vertices[index];
+    float angle = animation.time * 2.0 + vertex.phase;
+    animated.positions[index] = vertex.position + vec2(cos(angle), sin(angle)) * vertex.amplitude;
+}
@@ -0,0 +1,37 @@
+#version 450
+
+layout(location = 0) out vec4 outColor;
+layout(location = 0) in vec3 v_fragColor;
+layout(location = 1) in vec2 v_UV;
+
+// specialization constants picked per variant by a permutation family, or plain defines when every variant is
+// compiled on its own
+#if !defined(VERTEX_COLOR) || !defined(LIGHT_COUNT)
+layout(constant_id = 0) const bool VERTEX_COLOR = true;
+layout(constant_id = 1) const int LIGHT_COUNT = 0;
+#endif
+
+const vec3 LIGHT_DIRECTIONS[3] = vec3[](
+    vec3(0.0, 0.0, 1.0),
+    vec3(0.577, 0.577, 0.577),
+    vec3(-0.707, 0.0, 0.707)
+);
+
+void main() {
+    vec3 color = VERTEX_COLOR ? v_fragColor : vec3(1.0);
+
+    float d = 1 - length(v_UV);
+    d = step(0.0, d);
+
+    // the disc shaded as a sphere facing the camera
+    if (LIGHT_COUNT > 0) {
+        vec3 normal = vec3(v_UV, sqrt(max(0.0, 1.0 - dot(v_UV, v_UV))));
+        float light = 0.0;
+        for (int i = 0; i < LIGHT_COUNT; ++i) {
+            light += max(0.0, dot(normal, LIGHT_DIRECTIONS[i]));
+        }
+        color *= light / float(LIGHT_COUNT);
+    }
+
+    outColor = vec4(color, 1.0) * d;
+}